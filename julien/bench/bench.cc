@@ -0,0 +1,827 @@
+// Benchmark driver for every container under julien/.
+//
+// Build using:
+//   cmake -S julien -B build && cmake --build build && ./build/bench
+// or directly:
+//   g++ -Wall -Werror -O2 -DNDEBUG -pthread -o bench bench.cc && ./bench
+//
+// Usage:
+//   ./bench [--filter substring] [--sizes 1000,100000] [--threads 1,2,4]
+//           [--dists uniform,zipf,sequential] [--label name] [--json file]
+//
+// Every workload runs once per size (and per key distribution and thread
+// count when it uses them). Results go to stdout as a table and, with --json,
+// to a file that can be compared across commits.
+//
+// Operations are timed in batches of kBatch so that the clock doesn't dominate
+// sub-100ns operations: ns_per_op is the total time divided by the number of
+// operations while p50/p99 are percentiles of the per-batch mean. Allocations
+// are counted through operator new.
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <new>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../wk2/vector.h"
+#include "../wk3/rope.h"
+#include "../wk4/doubly_linked_list.h"
+#include "../wk4/ring_buffer.h"
+#include "../wk4/singly_linked_list.h"
+#include "../wk5/hash_set.h"
+#include "../wk5/hash_table.h"
+#include "../wk6/priority_queue.h"
+#include "../wk6/queue.h"
+#include "../wk6/stack.h"
+#include "../wk7/btree_map.h"
+
+static std::atomic<uint64_t> g_allocatedBytes{0};
+static std::atomic<uint64_t> g_allocations{0};
+
+// Kept out of line, otherwise GCC sees free() paired with operator new.
+__attribute__((noinline)) void* operator new(size_t size) {
+  g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+__attribute__((noinline)) void* operator new[](size_t size) {
+  return operator new(size);
+}
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+  std::free(p);
+}
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+__attribute__((noinline)) void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+__attribute__((noinline)) void operator delete[](void* p, size_t) noexcept {
+  std::free(p);
+}
+// Over-aligned types, such as nodes padded to a cache line, come here.
+__attribute__((noinline)) void* operator new(size_t size, std::align_val_t alignment) {
+  g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  size_t align = static_cast<size_t>(alignment);
+  // aligned_alloc() wants a non zero multiple of the alignment.
+  size_t rounded = (std::max<size_t>(size, 1) + align - 1) / align * align;
+  if (void* p = std::aligned_alloc(align, rounded)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+__attribute__((noinline)) void* operator new[](size_t size, std::align_val_t alignment) {
+  return operator new(size, alignment);
+}
+__attribute__((noinline)) void operator delete(void* p, std::align_val_t) noexcept {
+  std::free(p);
+}
+__attribute__((noinline)) void operator delete(void* p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+__attribute__((noinline)) void operator delete[](void* p, std::align_val_t) noexcept {
+  std::free(p);
+}
+__attribute__((noinline)) void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+constexpr size_t kBatch = 64;
+
+struct Params {
+  size_t size;
+  size_t threads;
+  std::string dist;
+};
+
+struct Result {
+  std::string container;
+  std::string workload;
+  Params params;
+  size_t ops;
+  double nsPerOp;
+  double p50;
+  double p99;
+  uint64_t bytesAllocated;
+  uint64_t allocations;
+};
+
+// Index sequences in [0, n) following a named distribution. They are
+// generated before timing starts.
+std::vector<uint32_t> makeKeys(const std::string& dist, size_t n, size_t count, uint64_t seed) {
+  std::vector<uint32_t> keys(count);
+  std::mt19937_64 rng(seed);
+  if (dist == "sequential") {
+    for (size_t i = 0; i < count; ++i) {
+      keys[i] = i % n;
+    }
+  } else if (dist == "zipf") {
+    // theta = 0.99, the YCSB default.
+    std::vector<double> cdf(n);
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+      sum += 1.0 / std::pow(i + 1.0, 0.99);
+      cdf[i] = sum;
+    }
+    std::uniform_real_distribution<double> uniform(0.0, sum);
+    for (size_t i = 0; i < count; ++i) {
+      size_t idx = std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+      keys[i] = std::min(idx, n - 1);
+    }
+  } else {
+    for (size_t i = 0; i < count; ++i) {
+      keys[i] = rng() % n;
+    }
+  }
+  return keys;
+}
+
+// Distinct, well spread, positive int keys: i * odd is a bijection mod 2^31.
+int distinctKey(size_t i) {
+  return int((i * 2654435761u) & 0x7fffffff);
+}
+
+double percentile(std::vector<double>& samples, double p) {
+  if (samples.empty()) {
+    return 0;
+  }
+  size_t idx = std::min(samples.size() - 1, size_t(p * samples.size()));
+  std::nth_element(samples.begin(), samples.begin() + idx, samples.end());
+  return samples[idx];
+}
+
+// Times op(i) for i in [0, ops) on |params.threads| threads, thread t running
+// the indices congruent to t. Setup done before calling measure() is neither
+// timed nor counted.
+template<typename Op>
+Result measure(const Params& params, size_t ops, Op&& op) {
+  size_t threads = std::max<size_t>(params.threads, 1);
+  std::vector<std::vector<double>> samples(threads);
+  for (std::vector<double>& s : samples) {
+    s.reserve(ops / threads / kBatch + 1);
+  }
+  std::atomic<bool> go{threads == 1};
+  auto worker = [&](size_t t) {
+    while (!go.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+    std::vector<double>& local = samples[t];
+    for (size_t i = t; i < ops;) {
+      size_t n = 0;
+      auto start = std::chrono::steady_clock::now();
+      for (; n < kBatch && i < ops; ++n, i += threads) {
+        op(i);
+      }
+      double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+      local.push_back(ns / n);
+    }
+  };
+  // Threads are started and parked first so that neither their creation nor
+  // the sample buffers show up in the allocation counts.
+  std::vector<std::thread> pool;
+  if (threads > 1) {
+    for (size_t t = 0; t < threads; ++t) {
+      pool.emplace_back(worker, t);
+    }
+  }
+  uint64_t bytes = g_allocatedBytes.load();
+  uint64_t allocations = g_allocations.load();
+  auto start = std::chrono::steady_clock::now();
+  if (threads == 1) {
+    worker(0);
+  } else {
+    go.store(true, std::memory_order_release);
+    for (std::thread& th : pool) {
+      th.join();
+    }
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  uint64_t bytesAllocated = g_allocatedBytes.load() - bytes;
+  uint64_t allocationCount = g_allocations.load() - allocations;
+
+  std::vector<double> all;
+  for (const std::vector<double>& s : samples) {
+    all.insert(all.end(), s.begin(), s.end());
+  }
+  Result r;
+  r.params = params;
+  r.ops = ops;
+  r.nsPerOp = ops ? ns / ops : 0;
+  r.p50 = percentile(all, 0.5);
+  r.p99 = percentile(all, 0.99);
+  r.bytesAllocated = bytesAllocated;
+  r.allocations = allocationCount;
+  return r;
+}
+
+struct Workload {
+  std::string container;
+  std::string name;
+  // Whether the workload draws keys from a distribution.
+  bool usesKeys;
+  // Whether the container is thread safe and runs on every thread count.
+  bool threaded;
+  // Larger sizes are skipped, for containers with quadratic operations.
+  size_t maxSize;
+  std::function<Result(const Params&)> run;
+};
+
+// Keeps the optimizer from dropping reads.
+static volatile uint64_t g_sink;
+
+// Lookups of which 9 in 10 miss, the case the HashSet prefilter is for.
+template<typename Set>
+Result containsMostlyMissing(const Params& p) {
+  Set s(p.size);
+  for (size_t i = 0; i < p.size; ++i) {
+    s.set(distinctKey(i));
+  }
+  // Small sets make for few lookups, too few to time on their own.
+  size_t lookups = std::max<size_t>(p.size, 1 << 20);
+  std::vector<uint32_t> keys = makeKeys(p.dist, 10 * p.size, lookups, 4);
+  uint64_t hits = 0;
+  Result r = measure(p, lookups, [&](size_t i) { hits += s.contains(distinctKey(keys[i])); });
+  g_sink = hits;
+  return r;
+}
+
+// Ingest threads deduplicating ids into a shared set which starts empty, so
+// that it grows while they insert. Keys repeat except for "sequential".
+template<typename Set>
+Result insertDeduplicated(const Params& p) {
+  Set s(1);
+  std::vector<uint32_t> keys = makeKeys(p.dist, p.size, p.size, 8);
+  // One counter per thread and per cache line, op(i) runs on thread i % threads.
+  std::vector<std::array<uint64_t, 8>> added(p.threads);
+  Result r = measure(p, p.size, [&](size_t i) { added[i % p.threads][0] += s.insert(distinctKey(keys[i])); });
+  for (const std::array<uint64_t, 8>& a : added) {
+    g_sink = g_sink + a[0];
+  }
+  return r;
+}
+
+// Pushes kCycle elements then pops them, over and over, so that runtime and
+// compile time sized containers can be compared at the same capacity.
+constexpr size_t kCycle = 1024;
+template<typename Push, typename Pop>
+Result cycle(const Params& p, Push&& push, Pop&& pop) {
+  uint64_t sum = 0;
+  Result r = measure(p, 2 * p.size, [&](size_t i) {
+    if ((i / kCycle) % 2 == 0) {
+      push(i);
+    } else {
+      sum += pop();
+    }
+  });
+  g_sink = sum;
+  return r;
+}
+
+// Keys 0..n-1 inserted in random order, then scans of kScanLength
+// consecutive keys from random starts.
+constexpr size_t kScanLength = 100;
+template<typename Insert, typename Scan>
+Result rangeScans(const Params& p, Insert&& insert, Scan&& scan) {
+  std::vector<uint32_t> order(p.size);
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), std::mt19937_64(5));
+  for (uint32_t k : order) {
+    insert(int(k));
+  }
+  size_t scans = std::max<size_t>(p.size / 10, 1000);
+  std::vector<uint32_t> starts = makeKeys(p.dist, std::max(p.size, kScanLength) - kScanLength + 1, scans, 6);
+  uint64_t sum = 0;
+  Result r = measure(p, scans, [&](size_t i) { sum += scan(int(starts[i]), int(starts[i] + kScanLength)); });
+  g_sink = sum;
+  return r;
+}
+
+// Payloads of kBytes, to compare RowLayout and ColumnarLayout as payloads
+// outgrow the priorities and keys that sifts and probes compare.
+template<size_t kBytes>
+struct Payload {
+  uint64_t words[kBytes / 8];
+};
+
+// Pushes p.size elements then pops them all.
+template<size_t kBytes, typename Layout>
+Result pushPopPayloads(const Params& p) {
+  PriorityQueue<Payload<kBytes>, 4, std::allocator<Payload<kBytes>>, Layout> q(1);
+  std::vector<uint32_t> keys = makeKeys(p.dist, p.size, p.size, 4);
+  uint64_t sum = 0;
+  Result r = measure(p, 2 * p.size, [&](size_t i) {
+    if (i < p.size) {
+      q.push(keys[i], Payload<kBytes>{{i}});
+    } else {
+      sum += q.pop().words[0];
+    }
+  });
+  g_sink = sum;
+  return r;
+}
+
+// Lookups of which half miss, reading the payload of every hit.
+template<size_t kBytes, typename Layout>
+Result findPayloads(const Params& p) {
+  HashTable<Payload<kBytes>, NoHashStats, std::allocator<Payload<kBytes>>, Layout> t(p.size);
+  for (size_t i = 0; i < p.size; ++i) {
+    t.set(distinctKey(i), Payload<kBytes>{{i}});
+  }
+  size_t lookups = std::max<size_t>(p.size, 1 << 20);
+  std::vector<uint32_t> keys = makeKeys(p.dist, 2 * p.size, lookups, 3);
+  uint64_t sum = 0;
+  Result r = measure(p, lookups, [&](size_t i) {
+    if (Payload<kBytes>* v = t.find(distinctKey(keys[i]))) {
+      sum += v->words[0];
+    }
+  });
+  g_sink = sum;
+  return r;
+}
+
+std::vector<Workload> workloads() {
+  constexpr size_t kUnbounded = std::numeric_limits<size_t>::max();
+  std::vector<Workload> w;
+
+  w.push_back({"BetterVector", "append", false, false, kUnbounded, [](const Params& p) {
+    BetterVector<int> v(0, 0);
+    return measure(p, p.size, [&](size_t i) { v.append(i); });
+  }});
+  w.push_back({"BetterVector", "read", true, false, kUnbounded, [](const Params& p) {
+    BetterVector<int> v(p.size, 1);
+    std::vector<uint32_t> keys = makeKeys(p.dist, p.size, p.size, 1);
+    uint64_t sum = 0;
+    Result r = measure(p, p.size, [&](size_t i) { sum += v[keys[i]]; });
+    g_sink = sum;
+    return r;
+  }});
+  w.push_back({"BetterVector", "insert_front", false, false, 100000, [](const Params& p) {
+    BetterVector<int> v(0, 0);
+    return measure(p, p.size, [&](size_t i) { v.insert(0, i); });
+  }});
+
+  // Appending walks the right spine, so both are quadratic.
+  w.push_back({"Rope", "append", false, false, 20000, [](const Params& p) {
+    Rope r;
+    return measure(p, p.size, [&](size_t) { r.append("abcd"); });
+  }});
+  w.push_back({"Rope", "length", false, false, 20000, [](const Params& p) {
+    Rope r;
+    for (size_t i = 0; i < p.size; ++i) {
+      r.append("abcd");
+    }
+    uint64_t sum = 0;
+    Result res = measure(p, p.size, [&](size_t) { sum += r.length(); });
+    g_sink = sum;
+    return res;
+  }});
+
+  w.push_back({"RingBuffer", "write_read", false, false, kUnbounded, [](const Params& p) {
+    RingBuffer<int> b(p.size + 1);
+    bool read;
+    uint64_t sum = 0;
+    // Fill then drain, twice, so that the indices wrap around.
+    Result r = measure(p, 4 * p.size, [&](size_t i) {
+      if ((i / p.size) % 2 == 0) {
+        b.writeOne(i);
+      } else {
+        sum += b.readOne(read);
+      }
+    });
+    g_sink = sum;
+    return r;
+  }});
+
+  w.push_back({"RingBuffer", "cycle_1024", false, false, kUnbounded, [](const Params& p) {
+    // One slot of a RingBuffer is always empty.
+    RingBuffer<int> b(kCycle + 1);
+    bool read;
+    return cycle(p, [&](size_t i) { b.writeOne(i); }, [&] { return b.readOne(read); });
+  }});
+  w.push_back({"FixedRingBuffer", "cycle_1024", false, false, kUnbounded, [](const Params& p) {
+    FixedRingBuffer<int, kCycle> b;
+    bool read;
+    return cycle(p, [&](size_t i) { b.writeOne(i); }, [&] { return b.readOne(read); });
+  }});
+
+  w.push_back({"HashSet", "set", false, false, kUnbounded, [](const Params& p) {
+    HashSet<int> s(1);
+    return measure(p, p.size, [&](size_t i) { s.set(distinctKey(i)); });
+  }});
+  w.push_back({"HashSet", "contains", true, false, kUnbounded, [](const Params& p) {
+    HashSet<int> s(p.size);
+    for (size_t i = 0; i < p.size; ++i) {
+      s.set(distinctKey(i));
+    }
+    // Half of the lookups miss.
+    std::vector<uint32_t> keys = makeKeys(p.dist, 2 * p.size, p.size, 2);
+    uint64_t hits = 0;
+    Result r = measure(p, p.size, [&](size_t i) { hits += s.contains(distinctKey(keys[i])); });
+    g_sink = hits;
+    return r;
+  }});
+  w.push_back({"HashSet", "remove", false, false, kUnbounded, [](const Params& p) {
+    HashSet<int> s(p.size);
+    for (size_t i = 0; i < p.size; ++i) {
+      s.set(distinctKey(i));
+    }
+    return measure(p, p.size, [&](size_t i) { s.remove(distinctKey(i)); });
+  }});
+  w.push_back({"HashSet", "contains_miss", true, false, kUnbounded, containsMostlyMissing<HashSet<int>>});
+  w.push_back({"HashSet+CuckooFilter", "contains_miss", true, false, kUnbounded,
+               containsMostlyMissing<HashSet<int, NoHashStats, std::allocator<int>, CuckooFilter>>});
+  w.push_back({"ConcurrentHashSet", "insert_dedup", true, true, kUnbounded, insertDeduplicated<ConcurrentHashSet<int>>});
+  w.push_back({"MutexHashSet", "insert_dedup", true, true, kUnbounded, insertDeduplicated<MutexHashSet<int>>});
+
+  // HashTable grows on every collision, so its size is roughly quadratic in
+  // the number of elements.
+
+  w.push_back({"HashTable", "set", false, false, 1000, [](const Params& p) {
+    HashTable<int> t(1);
+    return measure(p, p.size, [&](size_t i) { t.set(distinctKey(i), i); });
+  }});
+  w.push_back({"HashTable", "contains", true, false, 1000, [](const Params& p) {
+    HashTable<int> t(p.size);
+    for (size_t i = 0; i < p.size; ++i) {
+      t.set(distinctKey(i), i);
+    }
+    std::vector<uint32_t> keys = makeKeys(p.dist, 2 * p.size, p.size, 3);
+    uint64_t hits = 0;
+    Result r = measure(p, p.size, [&](size_t i) { hits += t.contains(distinctKey(keys[i])); });
+    g_sink = hits;
+    return r;
+  }});
+  w.push_back({"HashTable", "remove", false, false, 1000, [](const Params& p) {
+    HashTable<int> t(p.size);
+    for (size_t i = 0; i < p.size; ++i) {
+      t.set(distinctKey(i), i);
+    }
+    return measure(p, p.size, [&](size_t i) { t.remove(distinctKey(i)); });
+  }});
+
+  w.push_back({"HashTable/Row", "find_64B", true, false, 1000, findPayloads<64, RowLayout>});
+  w.push_back({"HashTable/Columnar", "find_64B", true, false, 1000, findPayloads<64, ColumnarLayout>});
+  w.push_back({"HashTable/Row", "find_256B", true, false, 1000, findPayloads<256, RowLayout>});
+  w.push_back({"HashTable/Columnar", "find_256B", true, false, 1000, findPayloads<256, ColumnarLayout>});
+
+  // Point lookups which all hit, and range scans, for the ordered maps and
+  // HashTable which has to look every key of a range up.
+  w.push_back({"BTreeMap", "find", true, false, kUnbounded, [](const Params& p) {
+    BTreeMap<int, int> m;
+    for (size_t i = 0; i < p.size; ++i) {
+      m.insert(distinctKey(i), i);
+    }
+    std::vector<uint32_t> keys = makeKeys(p.dist, p.size, p.size, 7);
+    uint64_t sum = 0;
+    Result r = measure(p, p.size, [&](size_t i) { sum += *m.find(distinctKey(keys[i])); });
+    g_sink = sum;
+    return r;
+  }});
+  w.push_back({"std::map", "find", true, false, kUnbounded, [](const Params& p) {
+    std::map<int, int> m;
+    for (size_t i = 0; i < p.size; ++i) {
+      m.emplace(distinctKey(i), i);
+    }
+    std::vector<uint32_t> keys = makeKeys(p.dist, p.size, p.size, 7);
+    uint64_t sum = 0;
+    Result r = measure(p, p.size, [&](size_t i) { sum += m.find(distinctKey(keys[i]))->second; });
+    g_sink = sum;
+    return r;
+  }});
+  w.push_back({"HashTable", "find", true, false, 1000, [](const Params& p) {
+    HashTable<int> t(p.size);
+    for (size_t i = 0; i < p.size; ++i) {
+      t.set(distinctKey(i), i);
+    }
+    std::vector<uint32_t> keys = makeKeys(p.dist, p.size, p.size, 7);
+    uint64_t hits = 0;
+    Result r = measure(p, p.size, [&](size_t i) { hits += t.contains(distinctKey(keys[i])); });
+    g_sink = hits;
+    return r;
+  }});
+  w.push_back({"BTreeMap", "range_scan", true, false, kUnbounded, [](const Params& p) {
+    BTreeMap<int, int> m;
+    return rangeScans(p, [&](int k) { m.insert(k, k); }, [&](int lo, int hi) {
+      uint64_t sum = 0;
+      m.scan(lo, hi, [&](int, int v) { sum += v; });
+      return sum;
+    });
+  }});
+  w.push_back({"std::map", "range_scan", true, false, kUnbounded, [](const Params& p) {
+    std::map<int, int> m;
+    return rangeScans(p, [&](int k) { m.emplace(k, k); }, [&](int lo, int hi) {
+      uint64_t sum = 0;
+      for (auto it = m.lower_bound(lo); it != m.end() && it->first < hi; ++it) {
+        sum += it->second;
+      }
+      return sum;
+    });
+  }});
+  w.push_back({"HashTable", "range_scan", true, false, 1000, [](const Params& p) {
+    HashTable<int> t(p.size);
+    return rangeScans(p, [&](int k) { t.set(k, k); }, [&](int lo, int hi) {
+      uint64_t sum = 0;
+      for (int k = lo; k < hi; ++k) {
+        sum += t.contains(k);
+      }
+      return sum;
+    });
+  }});
+
+  w.push_back({"Queue", "push_pop", false, false, kUnbounded, [](const Params& p) {
+    Queue<int> q(1);
+    uint64_t sum = 0;
+    Result r = measure(p, 2 * p.size, [&](size_t i) {
+      if (i < p.size) {
+        q.push(i);
+      } else {
+        sum += q.pop();
+      }
+    });
+    g_sink = sum;
+    return r;
+  }});
+
+  w.push_back({"Queue", "cycle_1024", false, false, kUnbounded, [](const Params& p) {
+    Queue<int> q(kCycle);
+    return cycle(p, [&](size_t i) { q.push(i); }, [&] { return q.pop(); });
+  }});
+  w.push_back({"FixedQueue", "cycle_1024", false, false, kUnbounded, [](const Params& p) {
+    FixedQueue<int, kCycle> q;
+    return cycle(p, [&](size_t i) { q.push(i); }, [&] { return q.pop(); });
+  }});
+
+  w.push_back({"Stack", "push_pop", false, false, kUnbounded, [](const Params& p) {
+    Stack<int> s(1);
+    uint64_t sum = 0;
+    Result r = measure(p, 2 * p.size, [&](size_t i) {
+      if (i < p.size) {
+        s.push(i);
+      } else {
+        sum += s.pop();
+      }
+    });
+    g_sink = sum;
+    return r;
+  }});
+  w.push_back({"Stack", "cycle_1024", false, false, kUnbounded, [](const Params& p) {
+    Stack<int> s(kCycle);
+    return cycle(p, [&](size_t i) { s.push(i); }, [&] { return s.pop(); });
+  }});
+  w.push_back({"FixedStack", "cycle_1024", false, false, kUnbounded, [](const Params& p) {
+    FixedStack<int, kCycle> s;
+    return cycle(p, [&](size_t i) { s.push(i); }, [&] { return s.pop(); });
+  }});
+  w.push_back({"ConcurrentStack", "push_pop", false, true, kUnbounded, [](const Params& p) {
+    ConcurrentStack<int> s;
+    return measure(p, 2 * p.size, [&](size_t i) {
+      if (i % (2 * p.threads) < p.threads) {
+        s.push(i);
+      } else {
+        int out;
+        s.pop(out);
+      }
+    });
+  }});
+  w.push_back({"MutexStack", "push_pop", false, true, kUnbounded, [](const Params& p) {
+    MutexStack<int> s;
+    return measure(p, 2 * p.size, [&](size_t i) {
+      if (i % (2 * p.threads) < p.threads) {
+        s.push(i);
+      } else {
+        int out;
+        s.pop(out);
+      }
+    });
+  }});
+
+  w.push_back({"PriorityQueue", "push", true, false, kUnbounded, [](const Params& p) {
+    PriorityQueue<int> q(1);
+    std::vector<uint32_t> keys = makeKeys(p.dist, p.size, p.size, 4);
+    return measure(p, p.size, [&](size_t i) { q.push(keys[i], i); });
+  }});
+  w.push_back({"PriorityQueue", "pop", true, false, kUnbounded, [](const Params& p) {
+    PriorityQueue<int> q(p.size);
+    std::vector<uint32_t> keys = makeKeys(p.dist, p.size, p.size, 5);
+    for (size_t i = 0; i < p.size; ++i) {
+      q.push(keys[i], i);
+    }
+    uint64_t sum = 0;
+    Result r = measure(p, p.size, [&](size_t) { sum += q.pop(); });
+    g_sink = sum;
+    return r;
+  }});
+  w.push_back({"PriorityQueue/Row", "push_pop_64B", true, false, kUnbounded, pushPopPayloads<64, RowLayout>});
+  w.push_back({"PriorityQueue/Columnar", "push_pop_64B", true, false, kUnbounded, pushPopPayloads<64, ColumnarLayout>});
+  w.push_back({"PriorityQueue/Row", "push_pop_256B", true, false, kUnbounded, pushPopPayloads<256, RowLayout>});
+  w.push_back({"PriorityQueue/Columnar", "push_pop_256B", true, false, kUnbounded,
+               pushPopPayloads<256, ColumnarLayout>});
+  w.push_back({"ConcurrentPriorityQueue", "push_pop", true, true, kUnbounded, [](const Params& p) {
+    ConcurrentPriorityQueue<int> q(p.threads);
+    std::vector<uint32_t> keys = makeKeys(p.dist, p.size, p.size, 6);
+    return measure(p, 2 * p.size, [&](size_t i) {
+      if (i % (2 * p.threads) < p.threads) {
+        q.push(keys[i / 2], i);
+      } else {
+        int out;
+        q.pop(out);
+      }
+    });
+  }});
+
+  w.push_back({"SinglyLinkedList", "push_front", false, false, kUnbounded, [](const Params& p) {
+    SinglyLinkedList<int> l;
+    return measure(p, p.size, [&](size_t i) { l.insertBefore(l.head(), i); });
+  }});
+  w.push_back({"SinglyLinkedList", "pop_front", false, false, kUnbounded, [](const Params& p) {
+    SinglyLinkedList<int> l;
+    for (size_t i = 0; i < p.size; ++i) {
+      l.insertBefore(l.head(), i);
+    }
+    return measure(p, p.size, [&](size_t) { l.remove(l.head()); });
+  }});
+  w.push_back({"SinglyLinkedList", "traverse", false, false, kUnbounded, [](const Params& p) {
+    SinglyLinkedList<int> l;
+    for (size_t i = 0; i < p.size; ++i) {
+      l.insertBefore(l.head(), i);
+    }
+    const SinglyLinkedListNode<int>* curr = nullptr;
+    uint64_t sum = 0;
+    Result r = measure(p, p.size, [&](size_t) {
+      curr = curr ? curr->next() : l.head();
+      sum += curr->value();
+    });
+    g_sink = sum;
+    return r;
+  }});
+  w.push_back({"UnrolledSinglyLinkedList", "append", false, false, kUnbounded, [](const Params& p) {
+    UnrolledSinglyLinkedList<int> l;
+    return measure(p, p.size, [&](size_t i) { l.append(i); });
+  }});
+  w.push_back({"UnrolledSinglyLinkedList", "traverse", false, false, kUnbounded, [](const Params& p) {
+    UnrolledSinglyLinkedList<int> l;
+    for (size_t i = 0; i < p.size; ++i) {
+      l.append(i);
+    }
+    UnrolledSinglyLinkedList<int>::Cursor c = l.begin();
+    uint64_t sum = 0;
+    Result r = measure(p, p.size, [&](size_t) {
+      sum += c.value();
+      c.advance();
+    });
+    g_sink = sum;
+    return r;
+  }});
+  w.push_back({"DoublyLinkedList", "push_front", false, false, kUnbounded, [](const Params& p) {
+    DoublyLinkedList<int> l;
+    return measure(p, p.size, [&](size_t i) { l.insertBefore(l.head(), i); });
+  }});
+  w.push_back({"DoublyLinkedList", "pop_back", false, false, kUnbounded, [](const Params& p) {
+    DoublyLinkedList<int> l;
+    for (size_t i = 0; i < p.size; ++i) {
+      l.insertBefore(l.head(), i);
+    }
+    return measure(p, p.size, [&](size_t) { l.remove(l.tail()); });
+  }});
+  return w;
+}
+
+std::vector<std::string> splitList(const std::string& s) {
+  std::vector<std::string> out;
+  std::stringstream ss(s);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) {
+      out.push_back(item);
+    }
+  }
+  return out;
+}
+
+std::string jsonEscape(const std::string& s) {
+  std::string out;
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+    }
+    out += c;
+  }
+  return out;
+}
+
+void writeJson(std::ostream& o, const std::string& label, const std::vector<Result>& results) {
+  o << "{\n  \"label\": \"" << jsonEscape(label) << "\",\n"
+    << "  \"compiler\": \"" << jsonEscape(__VERSION__) << "\",\n"
+    << "  \"batch\": " << kBatch << ",\n"
+    << "  \"results\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    o << (i ? "," : "") << "\n    {"
+      << "\"container\": \"" << r.container << "\", "
+      << "\"workload\": \"" << r.workload << "\", "
+      << "\"size\": " << r.params.size << ", "
+      << "\"threads\": " << r.params.threads << ", "
+      << "\"distribution\": \"" << r.params.dist << "\", "
+      << "\"ops\": " << r.ops << ", "
+      << "\"ns_per_op\": " << r.nsPerOp << ", "
+      << "\"p50_ns\": " << r.p50 << ", "
+      << "\"p99_ns\": " << r.p99 << ", "
+      << "\"bytes_allocated\": " << r.bytesAllocated << ", "
+      << "\"allocations\": " << r.allocations << "}";
+  }
+  o << "\n  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+  std::string filter;
+  std::vector<size_t> sizes = {1000, 100000, 1000000};
+  std::vector<size_t> threadCounts = {1, 2, 4, 8};
+  std::vector<std::string> dists = {"uniform", "zipf", "sequential"};
+  std::string label = "unlabeled";
+  std::string jsonPath;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return 1;
+    }
+    std::string value = argv[++i];
+    if (arg == "--filter") {
+      filter = value;
+    } else if (arg == "--sizes") {
+      sizes.clear();
+      for (const std::string& s : splitList(value)) {
+        sizes.push_back(std::stoull(s));
+      }
+    } else if (arg == "--threads") {
+      threadCounts.clear();
+      for (const std::string& s : splitList(value)) {
+        threadCounts.push_back(std::stoull(s));
+      }
+    } else if (arg == "--dists") {
+      dists = splitList(value);
+    } else if (arg == "--label") {
+      label = value;
+    } else if (arg == "--json") {
+      jsonPath = value;
+    } else {
+      std::cerr << "Unknown flag " << arg << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<Result> results;
+  for (const Workload& w : workloads()) {
+    std::string name = w.container + "/" + w.name;
+    if (name.find(filter) == std::string::npos) {
+      continue;
+    }
+    for (size_t size : sizes) {
+      if (size > w.maxSize) {
+        continue;
+      }
+      for (size_t threads : w.threaded ? threadCounts : std::vector<size_t>{1}) {
+        for (const std::string& dist : w.usesKeys ? dists : std::vector<std::string>{"none"}) {
+          Params p{size, threads, dist};
+          Result r = w.run(p);
+          r.container = w.container;
+          r.workload = w.name;
+          results.push_back(r);
+          std::cout << name << " size=" << size << " threads=" << threads << " dist=" << dist
+                    << ": " << r.nsPerOp << " ns/op, p50=" << r.p50 << "ns, p99=" << r.p99
+                    << "ns, " << r.bytesAllocated << " bytes in " << r.allocations << " allocations"
+                    << std::endl;
+        }
+      }
+    }
+  }
+
+  if (!jsonPath.empty()) {
+    std::ofstream out(jsonPath);
+    writeJson(out, label, results);
+    if (!out) {
+      std::cerr << "Failed to write " << jsonPath << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
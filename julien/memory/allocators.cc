@@ -0,0 +1,198 @@
+// Build using:
+//   g++ -Wall -Werror --sanitize=address -g -o allocators allocators.cc && ./allocators
+// Benchmark random lookups on 4K vs 2M pages using:
+//   g++ -Wall -Werror -O2 -DNDEBUG -o allocators allocators.cc && ./allocators hugepages [MiB]
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "allocators.h"
+#include "huge_pages.h"
+#include "../wk2/vector.h"
+#include "../wk4/ring_buffer.h"
+#include "../wk5/hash_set.h"
+#include "../wk5/hash_table.h"
+#include "../wk6/priority_queue.h"
+#include "../wk6/queue.h"
+#include "../wk6/stack.h"
+
+// Every container accounted to one subsystem.
+void testCounting() {
+  AllocationStats stats;
+  {
+    BetterVector<int, CountingAllocator<int>> v(4, 0, CountingAllocator<int>(stats));
+    for (int i = 0; i < 100; ++i) {
+      v.append(i);
+    }
+    RingBuffer<int, CountingAllocator<int>> r(16, CountingAllocator<int>(stats));
+    r.writeOne(1);
+    HashSet<int, NoHashStats, CountingAllocator<int>> s(4, CountingAllocator<int>(stats));
+    for (int i = 1; i < 10; ++i) {
+      s.set(i);
+    }
+    HashTable<int, NoHashStats, CountingAllocator<int>> t(4, CountingAllocator<int>(stats));
+    t.set(1, 10);
+    t.set(2, 20);
+    PriorityQueue<int, 4, CountingAllocator<int>> pq(2, CountingAllocator<int>(stats));
+    for (int i = 0; i < 10; ++i) {
+      pq.push(i, i);
+    }
+    Stack<int, CountingAllocator<int>> st(1, CountingAllocator<int>(stats));
+    st.push(1);
+    Queue<int, CountingAllocator<int>> q(1, CountingAllocator<int>(stats));
+    q.push(1);
+    std::cout << "Counting while alive: " << stats << std::endl;
+    assert(stats.liveBytes() > 0);
+    assert(stats.peakBytes() >= stats.liveBytes());
+  }
+  std::cout << "Counting after teardown: " << stats << std::endl;
+  assert(stats.liveBytes() == 0);
+  assert(stats.allocations() == stats.deallocations());
+  size_t lifetimes = 0;
+  for (uint64_t n : stats.lifetimes()) {
+    lifetimes += n;
+  }
+  assert(lifetimes == stats.deallocations());
+}
+
+// A request builds its containers in an arena and drops them all at once.
+void testArena() {
+  MonotonicArena arena(256);
+  {
+    ArenaAllocator<int> alloc(arena);
+    Queue<int, ArenaAllocator<int>> q(1, alloc);
+    Stack<int, ArenaAllocator<int>> s(1, alloc);
+    BetterVector<int, ArenaAllocator<int>> v(0, 0, alloc);
+    for (int i = 0; i < 5000; ++i) {
+      q.push(i);
+      s.push(i);
+      v.append(i);
+    }
+    for (int i = 0; i < 5000; ++i) {
+      assert(q.pop() == i);
+      assert(s.pop() == 4999 - i);
+    }
+    assert(v[4999] == 4999);
+  }
+  std::cout << "Arena: used=" << arena.usedBytes() << "B reserved=" << arena.reservedBytes() << "B" << std::endl;
+  assert(arena.usedBytes() > 0 && arena.reservedBytes() >= arena.usedBytes());
+  arena.release();
+  assert(arena.reservedBytes() == 0);
+
+  // Counting on top of an arena.
+  AllocationStats stats;
+  ArenaAllocator<int> upstream(arena);
+  CountingAllocator<int, ArenaAllocator<int>> alloc(stats, upstream);
+  {
+    PriorityQueue<int, 4, CountingAllocator<int, ArenaAllocator<int>>> pq(1, alloc);
+    for (int i = 0; i < 100; ++i) {
+      pq.push(i, i);
+    }
+    assert(pq.pop() == 99);
+  }
+  assert(stats.liveBytes() == 0);
+  assert(arena.usedBytes() == stats.totalBytes());
+  std::cout << "Counting over arena: " << stats << std::endl;
+}
+
+// Big arrays on huge pages and NUMA policies, small ones on the heap.
+void testHugePages() {
+  for (auto pages : {HugePageOptions::Pages::kSmall, HugePageOptions::Pages::kTransparent,
+                     HugePageOptions::Pages::kExplicit}) {
+    for (auto numa : {HugePageOptions::Numa::kDefault, HugePageOptions::Numa::kInterleave,
+                      HugePageOptions::Numa::kBind}) {
+      HugePageOptions options;
+      options.pages = pages;
+      options.numa = numa;
+      HugePageAllocator<uint64_t> alloc(options);
+      HashTable<uint64_t, NoHashStats, HugePageAllocator<uint64_t>> t(1 << 20, alloc);
+      RingBuffer<uint64_t, HugePageAllocator<uint64_t>> r(1 << 18, alloc);
+      for (uint64_t i = 0; i < 100; ++i) {
+        t.set(i, i);
+        r.writeOne(i);
+      }
+      assert(t.contains(42));
+      bool read = false;
+      uint64_t first = r.readOne(read);
+      assert(read && first == 0);
+      (void)first;
+    }
+  }
+  std::cout << "Huge pages: " << HugePageFallbacks::hugeTlb() << " MAP_HUGETLB fallbacks, "
+            << HugePageFallbacks::mbind() << " mbind failures" << std::endl;
+
+  // Nodes past the 64 of a single mask word, or out of range altogether, only
+  // fail to bind.
+  size_t failures = HugePageFallbacks::mbind();
+  for (int node : {64, numa::kMaxNodes, -1}) {
+    HugePageOptions options;
+    options.numa = HugePageOptions::Numa::kBind;
+    options.node = node;
+    HugePageAllocator<uint64_t> alloc(options);
+    uint64_t* p = alloc.allocate(1 << 20);
+    p[0] = 1;
+    alloc.deallocate(p, 1 << 20);
+  }
+  std::cout << "Binding to nodes 64, " << numa::kMaxNodes << " and -1: "
+            << HugePageFallbacks::mbind() - failures << " mbind failures" << std::endl;
+  assert(HugePageFallbacks::mbind() - failures == 3);
+  (void)failures;
+}
+
+// Random lookups into a |mib| MiB array, whose cost is dominated by TLB
+// misses once it is much larger than the TLB reach of 4K pages.
+template<typename Allocator>
+double benchLookups(const char* name, size_t mib, const Allocator& alloc) {
+  size_t n = mib * 1024 * 1024 / sizeof(uint64_t);
+  BetterVector<uint64_t, Allocator> v(n, 0, alloc);
+  for (size_t i = 0; i < n; ++i) {
+    v[i] = i;
+  }
+
+  constexpr size_t kLookups = 20000000;
+  uint64_t x = 88172645463325252ull;
+  uint64_t sum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < kLookups; ++i) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    sum += v[x % n];
+  }
+  auto end = std::chrono::steady_clock::now();
+  double nanos = std::chrono::duration<double, std::nano>(end - start).count() / kLookups;
+  std::cout << name << ": " << nanos << " ns/lookup (" << 1e9 / nanos << " lookups/s, sum " << sum
+            << ")" << std::endl;
+  return nanos;
+}
+
+int benchHugePages(size_t mib) {
+  std::cout << "Random lookups in " << mib << " MiB" << std::endl;
+  HugePageOptions options;
+  options.pages = HugePageOptions::Pages::kSmall;
+  benchLookups("4K pages", mib, HugePageAllocator<uint64_t>(options));
+  options.pages = HugePageOptions::Pages::kTransparent;
+  benchLookups("2M transparent", mib, HugePageAllocator<uint64_t>(options));
+  options.pages = HugePageOptions::Pages::kExplicit;
+  benchLookups("2M hugetlb", mib, HugePageAllocator<uint64_t>(options));
+  options.numa = HugePageOptions::Numa::kInterleave;
+  benchLookups("2M hugetlb interleaved", mib, HugePageAllocator<uint64_t>(options));
+  benchLookups("std::allocator", mib, std::allocator<uint64_t>());
+  std::cout << HugePageFallbacks::hugeTlb() << " MAP_HUGETLB fallbacks, " << HugePageFallbacks::mbind()
+            << " mbind failures" << std::endl;
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "hugepages") {
+    return benchHugePages(argc > 2 ? std::stoull(argv[2]) : 1024);
+  }
+
+  testCounting();
+  testArena();
+  testHugePages();
+  return 0;
+}
@@ -0,0 +1,265 @@
+// CountingAllocator and MonotonicArena, see allocators.cc for a demo.
+//
+// The containers take a standard Allocator template parameter, std::allocator
+// by default, and get all their memory through newArray()/deleteArray() below.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+
+// Like new T[n] but through |alloc|. Trivial types are left uninitialized, as
+// they are by new T[n].
+template<typename Alloc>
+typename std::allocator_traits<Alloc>::pointer newArray(Alloc& alloc, size_t n) {
+  using Traits = std::allocator_traits<Alloc>;
+  using T = typename Traits::value_type;
+  auto p = Traits::allocate(alloc, n);
+  if constexpr (!std::is_trivially_default_constructible_v<T>) {
+    for (size_t i = 0; i < n; ++i) {
+      Traits::construct(alloc, std::addressof(p[i]));
+    }
+  }
+  return p;
+}
+
+// Like delete [] p for an array of |n| elements from newArray().
+template<typename Alloc>
+void deleteArray(Alloc& alloc, typename std::allocator_traits<Alloc>::pointer p, size_t n) {
+  using Traits = std::allocator_traits<Alloc>;
+  using T = typename Traits::value_type;
+  if (!p) {
+    return;
+  }
+  if constexpr (!std::is_trivially_destructible_v<T>) {
+    for (size_t i = n; i > 0; --i) {
+      Traits::destroy(alloc, std::addressof(p[i - 1]));
+    }
+  }
+  Traits::deallocate(alloc, p, n);
+}
+
+// The allocator |Alloc| rebound to U, for containers storing more than T.
+template<typename Alloc, typename U>
+using RebindAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<U>;
+
+// Counters for one subsystem, shared by all the CountingAllocators pointing to
+// it whatever their value type. Not thread safe.
+class AllocationStats {
+public:
+  // Lifetimes are bucketed by powers of ten: < 1us, < 10us, ..., >= 1s.
+  static constexpr size_t kLifetimeBuckets = 8;
+
+  AllocationStats() = default;
+  // The live allocations are keyed by address, copies would double count.
+  AllocationStats(const AllocationStats&) = delete;
+  void operator=(const AllocationStats&) = delete;
+
+  size_t allocations() const { return m_allocations; }
+  size_t deallocations() const { return m_deallocations; }
+  size_t liveBytes() const { return m_liveBytes; }
+  size_t peakBytes() const { return m_peakBytes; }
+  size_t totalBytes() const { return m_totalBytes; }
+  const std::array<uint64_t, kLifetimeBuckets>& lifetimes() const { return m_lifetimes; }
+
+  void recordAllocate(const void* p, size_t bytes) {
+    m_allocations++;
+    m_totalBytes += bytes;
+    m_liveBytes += bytes;
+    m_peakBytes = std::max(m_peakBytes, m_liveBytes);
+    m_born[p] = std::chrono::steady_clock::now();
+  }
+
+  void recordDeallocate(const void* p, size_t bytes) {
+    m_deallocations++;
+    assert(m_liveBytes >= bytes);
+    m_liveBytes -= bytes;
+    auto it = m_born.find(p);
+    assert(it != m_born.end());
+    auto elapsed = std::chrono::steady_clock::now() - it->second;
+    m_born.erase(it);
+    uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    size_t bucket = 0;
+    for (uint64_t limit = 1000; bucket + 1 < kLifetimeBuckets && nanos >= limit; limit *= 10) {
+      bucket++;
+    }
+    m_lifetimes[bucket]++;
+  }
+
+  void dump(std::ostream& o) const {
+    o << "allocations=" << m_allocations << " deallocations=" << m_deallocations
+      << " live=" << m_liveBytes << "B peak=" << m_peakBytes << "B total=" << m_totalBytes
+      << "B lifetimes=[";
+    for (size_t i = 0; i < kLifetimeBuckets; ++i) {
+      o << (i ? ", " : "") << m_lifetimes[i];
+    }
+    o << "]";
+  }
+
+private:
+  size_t m_allocations = 0;
+  size_t m_deallocations = 0;
+  size_t m_liveBytes = 0;
+  size_t m_peakBytes = 0;
+  size_t m_totalBytes = 0;
+  std::array<uint64_t, kLifetimeBuckets> m_lifetimes{};
+  std::unordered_map<const void*, std::chrono::steady_clock::time_point> m_born;
+};
+
+inline std::ostream& operator<<(std::ostream& o, const AllocationStats& s) {
+  s.dump(o);
+  return o;
+}
+
+// Forwards to |Upstream| and records every allocation in an AllocationStats.
+template<typename T, typename Upstream = std::allocator<T>>
+class CountingAllocator {
+  template<typename U, typename V> friend class CountingAllocator;
+
+public:
+  using value_type = T;
+
+  template<typename U>
+  struct rebind {
+    using other = CountingAllocator<U, RebindAlloc<Upstream, U>>;
+  };
+
+  explicit CountingAllocator(AllocationStats& stats, const Upstream& upstream = Upstream())
+    : m_stats(&stats), m_upstream(upstream) {}
+
+  template<typename U, typename V>
+  CountingAllocator(const CountingAllocator<U, V>& other)
+    : m_stats(other.m_stats), m_upstream(other.m_upstream) {}
+
+  T* allocate(size_t n) {
+    T* p = std::allocator_traits<Upstream>::allocate(m_upstream, n);
+    m_stats->recordAllocate(p, n * sizeof(T));
+    return p;
+  }
+
+  void deallocate(T* p, size_t n) {
+    m_stats->recordDeallocate(p, n * sizeof(T));
+    std::allocator_traits<Upstream>::deallocate(m_upstream, p, n);
+  }
+
+  AllocationStats& stats() const { return *m_stats; }
+
+  template<typename U, typename V>
+  bool operator==(const CountingAllocator<U, V>& other) const {
+    return m_stats == other.m_stats && m_upstream == other.m_upstream;
+  }
+  template<typename U, typename V>
+  bool operator!=(const CountingAllocator<U, V>& other) const { return !(*this == other); }
+
+private:
+  AllocationStats* m_stats;
+  Upstream m_upstream;
+};
+
+// Bump allocator for request scoped data: allocations are carved out of
+// chunks that are only returned, all at once, by release() or the destructor.
+// deallocate() is a no-op so containers can be torn down by dropping the arena
+// without walking them, as long as their elements don't need destructors.
+class MonotonicArena {
+  struct Chunk {
+    Chunk* next;
+    size_t size;
+  };
+
+public:
+  static constexpr size_t kInitialChunkSize = 4096;
+
+  explicit MonotonicArena(size_t initialChunkSize = kInitialChunkSize)
+    : m_nextChunkSize(std::max(initialChunkSize, sizeof(Chunk))) {}
+
+  ~MonotonicArena() {
+    release();
+  }
+
+  MonotonicArena(const MonotonicArena&) = delete;
+  void operator=(const MonotonicArena&) = delete;
+
+  void* allocate(size_t bytes, size_t alignment) {
+    uintptr_t p = (m_cursor + alignment - 1) & ~(alignment - 1);
+    if (!m_chunks || p + bytes > m_end) {
+      addChunk(bytes + alignment);
+      p = (m_cursor + alignment - 1) & ~(alignment - 1);
+    }
+    m_cursor = p + bytes;
+    m_usedBytes += bytes;
+    return reinterpret_cast<void*>(p);
+  }
+
+  // Frees every chunk. Whatever was allocated from the arena is gone.
+  void release() {
+    while (m_chunks) {
+      Chunk* next = m_chunks->next;
+      ::operator delete(m_chunks);
+      m_chunks = next;
+    }
+    m_cursor = m_end = 0;
+    m_usedBytes = m_reservedBytes = 0;
+  }
+
+  // Bytes handed out and bytes held in chunks since the last release().
+  size_t usedBytes() const { return m_usedBytes; }
+  size_t reservedBytes() const { return m_reservedBytes; }
+
+private:
+  // Chunks double in size so that a growing container needs O(log n) of them.
+  void addChunk(size_t minBytes) {
+    size_t size = std::max(m_nextChunkSize, minBytes + sizeof(Chunk));
+    m_nextChunkSize = 2 * size;
+    Chunk* c = static_cast<Chunk*>(::operator new(size));
+    c->next = m_chunks;
+    c->size = size;
+    m_chunks = c;
+    m_cursor = reinterpret_cast<uintptr_t>(c + 1);
+    m_end = reinterpret_cast<uintptr_t>(c) + size;
+    m_reservedBytes += size;
+  }
+
+  Chunk* m_chunks = nullptr;
+  uintptr_t m_cursor = 0;
+  uintptr_t m_end = 0;
+  size_t m_nextChunkSize;
+  size_t m_usedBytes = 0;
+  size_t m_reservedBytes = 0;
+};
+
+// Standard allocator view of a MonotonicArena.
+template<typename T>
+class ArenaAllocator {
+  template<typename U> friend class ArenaAllocator;
+
+public:
+  using value_type = T;
+
+  explicit ArenaAllocator(MonotonicArena& arena) : m_arena(&arena) {}
+
+  template<typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.m_arena) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T*, size_t) {}
+
+  MonotonicArena& arena() const { return *m_arena; }
+
+  template<typename U>
+  bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.m_arena; }
+  template<typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.m_arena; }
+
+private:
+  MonotonicArena* m_arena;
+};
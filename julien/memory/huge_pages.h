@@ -0,0 +1,179 @@
+// HugePageAllocator, see allocators.cc for a demo and benchmark. Linux only.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// mbind(2) is only wrapped by libnuma, call it directly. The policies are
+// part of the kernel ABI.
+namespace numa {
+constexpr int kMpolBind = 2;
+constexpr int kMpolInterleave = 3;
+// MAX_NUMNODES of common kernel configs, kernels built for fewer nodes reject
+// the higher ones.
+constexpr int kMaxNodes = 1024;
+
+// |nodemask| holds |words| 64 bit words, one bit per node.
+inline bool mbind(void* addr, size_t length, int mode, const uint64_t* nodemask, size_t words) {
+#ifdef SYS_mbind
+  // The kernel reads one bit less than maxnode.
+  return ::syscall(SYS_mbind, addr, length, mode, nodemask, words * 64 + 1, 0) == 0;
+#else
+  return false;
+#endif
+}
+}  // namespace numa
+
+// Where the pages of a large allocation come from.
+struct HugePageOptions {
+  enum class Pages {
+    // Regular 4K pages, transparent huge pages disabled on the range. This is
+    // the baseline for the benchmark.
+    kSmall,
+    // 2M aligned range advised with MADV_HUGEPAGE so that transparent huge
+    // pages back it whenever khugepaged or the fault handler can.
+    kTransparent,
+    // MAP_HUGETLB from the reserved pool (vm.nr_hugepages), falling back to
+    // kTransparent when the pool is exhausted.
+    kExplicit,
+  };
+  enum class Numa {
+    // First touch, the pages land on the node of the thread writing them.
+    kDefault,
+    // Pages spread round-robin over every node we may use.
+    kInterleave,
+    // Pages only on |node|, which has to be below numa::kMaxNodes.
+    kBind,
+  };
+
+  Pages pages = Pages::kTransparent;
+  Numa numa = Numa::kDefault;
+  int node = 0;
+
+  bool operator==(const HugePageOptions& o) const {
+    return pages == o.pages && numa == o.numa && node == o.node;
+  }
+};
+
+// Counts the cases where the allocator couldn't do what it was asked to, the
+// allocation itself still succeeded.
+struct HugePageFallbacks {
+  static std::atomic<size_t>& hugeTlb() { static std::atomic<size_t> n{0}; return n; }
+  static std::atomic<size_t>& mbind() { static std::atomic<size_t> n{0}; return n; }
+};
+
+// Standard allocator for the big arrays (HashTable buckets, BetterVector and
+// RingBuffer backing...): allocations of at least kMinBytes are mmap'ed
+// according to HugePageOptions, smaller ones such as HashTable entries go to
+// operator new as a mapping per allocation would waste most of a huge page.
+template<typename T>
+class HugePageAllocator {
+  template<typename U> friend class HugePageAllocator;
+
+public:
+  using value_type = T;
+  static constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+  static constexpr size_t kSmallPageSize = 4096;
+  static constexpr size_t kMinBytes = kHugePageSize / 2;
+
+  explicit HugePageAllocator(HugePageOptions options = HugePageOptions()) : m_options(options) {}
+
+  template<typename U>
+  HugePageAllocator(const HugePageAllocator<U>& other) : m_options(other.m_options) {}
+
+  T* allocate(size_t n) {
+    size_t bytes = n * sizeof(T);
+    if (bytes < kMinBytes) {
+      return std::allocator<T>().allocate(n);
+    }
+
+    size_t length = mappedLength(bytes);
+    void* p = MAP_FAILED;
+    if (m_options.pages == HugePageOptions::Pages::kExplicit) {
+      p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p == MAP_FAILED) {
+        HugePageFallbacks::hugeTlb()++;
+      }
+    }
+    if (p == MAP_FAILED) {
+      p = m_options.pages == HugePageOptions::Pages::kSmall ? ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                                                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+                                                            : mapAligned(length);
+      if (p == MAP_FAILED) {
+        throw std::bad_alloc();
+      }
+      ::madvise(p, length, m_options.pages == HugePageOptions::Pages::kSmall ? MADV_NOHUGEPAGE : MADV_HUGEPAGE);
+    }
+
+    // Nothing touched the range yet, so the policy applies to every page.
+    bool bound = true;
+    if (m_options.numa == HugePageOptions::Numa::kInterleave) {
+      // The kernel masks out the nodes we aren't allowed to use.
+      uint64_t all = ~uint64_t(0);
+      bound = numa::mbind(p, length, numa::kMpolInterleave, &all, 1);
+    } else if (m_options.numa == HugePageOptions::Numa::kBind) {
+      int node = m_options.node;
+      if (node < 0 || node >= numa::kMaxNodes) {
+        bound = false;
+      } else {
+        // Only as many words as |node| needs.
+        uint64_t mask[numa::kMaxNodes / 64] = {};
+        mask[node / 64] = uint64_t(1) << (node % 64);
+        bound = numa::mbind(p, length, numa::kMpolBind, mask, node / 64 + 1);
+      }
+    }
+    if (!bound) {
+      HugePageFallbacks::mbind()++;
+    }
+    return static_cast<T*>(p);
+  }
+
+  void deallocate(T* p, size_t n) {
+    size_t bytes = n * sizeof(T);
+    if (bytes < kMinBytes) {
+      std::allocator<T>().deallocate(p, n);
+      return;
+    }
+    ::munmap(p, mappedLength(bytes));
+  }
+
+  const HugePageOptions& options() const { return m_options; }
+
+  template<typename U>
+  bool operator==(const HugePageAllocator<U>& other) const { return m_options == other.m_options; }
+  template<typename U>
+  bool operator!=(const HugePageAllocator<U>& other) const { return !(*this == other); }
+
+private:
+  size_t mappedLength(size_t bytes) const {
+    size_t page = m_options.pages == HugePageOptions::Pages::kSmall ? kSmallPageSize : kHugePageSize;
+    return (bytes + page - 1) / page * page;
+  }
+
+  // Transparent huge pages need a 2M aligned range: over-map by a huge page
+  // and unmap what sticks out on both sides.
+  static void* mapAligned(size_t length) {
+    void* raw = ::mmap(nullptr, length + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+      return MAP_FAILED;
+    }
+    uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t aligned = (start + kHugePageSize - 1) & ~(kHugePageSize - 1);
+    if (aligned > start) {
+      ::munmap(raw, aligned - start);
+    }
+    size_t tail = start + length + kHugePageSize - (aligned + length);
+    if (tail > 0) {
+      ::munmap(reinterpret_cast<void*>(aligned + length), tail);
+    }
+    return reinterpret_cast<void*>(aligned);
+  }
+
+  HugePageOptions m_options;
+};
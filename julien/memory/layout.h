@@ -0,0 +1,15 @@
+// Element layouts for PriorityQueue and HashTable, see priority_queue.cc and
+// hash_table.cc for demos.
+#pragma once
+
+// Every element is stored whole, its priority or key next to its payload, so
+// that one access brings both. The default, best for small payloads.
+struct RowLayout {};
+
+// Priorities or keys get a dense array of their own while payloads live apart,
+// in a vector indexed by handle or slot. Sifts and rehashes move indices but
+// leave payloads in place, and probes only touch the dense array, at the cost
+// of one more access to read a payload. The payload vector still reallocates
+// as it grows, so references to payloads don't survive insertions. Best for
+// payloads of a cache line or more.
+struct ColumnarLayout {};
@@ -0,0 +1,243 @@
+// NaiveVector and BetterVector, see vector.cc for a demo.
+#pragma once
+
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <sys/types.h>
+
+#include "../memory/allocators.h"
+
+template<typename T, typename Allocator = std::allocator<T>>
+class NaiveVector {
+  public:
+    NaiveVector(size_t size, const T& t, const Allocator& alloc = Allocator())
+      : m_alloc(alloc) {
+      m_backing = newArray(m_alloc, size);
+      m_size = size;
+      for (size_t i = 0; i < size; ++i) {
+        m_backing[i] = t;
+      }
+    }
+
+    ~NaiveVector() {
+      deleteArray(m_alloc, m_backing, m_size);
+      m_backing = nullptr;
+      m_size = 0;
+    }
+
+    T& at(size_t i) const {
+      checkPos(i);
+
+      return m_backing[i];
+    }
+
+    T& operator[](size_t i) const {
+      return this->at(i);
+    }
+
+    // Use operator==(const T&).
+    // Returns -1 if not found.
+    size_t find(const T& val) const {
+      for (size_t i = 0; i < m_size; ++i) {
+        if (m_backing[i] == val) {
+          return i;
+        }
+      }
+      // TODO: I don't think this works great as size_t is unsigned.
+      return -1;
+    }
+
+    void append(T val) {
+      insert(m_size, val);
+    }
+
+    void insert(size_t pos, T val) {
+      assert(pos >= 0);
+      assert(pos <= m_size);
+
+      // TODO: Grow efficiently.
+      T* new_backing = newArray(m_alloc, m_size + 1);
+      for (size_t i = 0; i < pos; ++i) {
+        new_backing[i] = m_backing[i];
+      }
+      for (size_t i = pos; i < m_size; ++i) {
+        new_backing[i + 1] = m_backing[i];
+      }
+      new_backing[pos] = val;
+      deleteArray(m_alloc, m_backing, m_size);
+      m_size += 1;
+      m_backing = new_backing;
+    }
+
+    void remove(size_t pos) {
+      checkPos(pos);
+      // TODO: Reuse existing capacity.
+      T* new_backing = newArray(m_alloc, m_size - 1);
+      for (size_t i = 0; i < pos; ++i) {
+        new_backing[i] = m_backing[i];
+      }
+      for (size_t i = pos; i < m_size - 1; ++i) {
+        new_backing[i] = m_backing[i + 1];
+      }
+      deleteArray(m_alloc, m_backing, m_size);
+      m_size -= 1;
+      m_backing = new_backing;
+    }
+
+    size_t size() const { return m_size; }
+
+    // TODO: Support resizing.
+
+  private:
+    NaiveVector() = delete;
+    // TODO: Make noncopyable for now.
+    template<typename U, typename A>
+    NaiveVector(const NaiveVector<U, A>&) = delete;
+    template<typename U, typename A>
+    void operator=(const NaiveVector<U, A>&) = delete;
+
+    // TODO: Make container moveable.
+
+    inline void checkPos(size_t pos) const {
+      assert(pos >= 0);
+      assert(pos < m_size);
+    }
+    Allocator m_alloc;
+    T* m_backing;
+    size_t m_size;
+};
+
+template<typename T, typename A>
+std::ostream& operator<<(std::ostream& o, const NaiveVector<T, A>& v) {
+  o << "[";
+  for (size_t i = 0; i < v.size(); ++i) {
+    if (i > 0) {
+      o << ", ";
+    }
+    o << v[i];
+  }
+  o << "]";
+
+  return o;
+}
+
+template<typename T, typename Allocator = std::allocator<T>>
+class BetterVector {
+  public:
+    BetterVector(size_t size, const T& t, const Allocator& alloc = Allocator())
+      : m_alloc(alloc) {
+      m_capacity = 0;
+      m_size = 0;
+      m_backing = nullptr;
+      growIfNeeded(size);
+      m_size = size;
+      for (size_t i = 0; i < size; ++i) {
+        m_backing[i] = t;
+      }
+    }
+
+    ~BetterVector() {
+      deleteArray(m_alloc, m_backing, m_capacity);
+      m_backing = nullptr;
+      m_size = 0;
+    }
+
+    T& at(size_t i) const {
+      checkPos(i);
+
+      return m_backing[i];
+    }
+
+    T& operator[](size_t i) const {
+      return this->at(i);
+    }
+
+    // Use operator==(const T&).
+    // Returns -1 if not found.
+    size_t find(const T& val) const {
+      for (size_t i = 0; i < m_size; ++i) {
+        if (m_backing[i] == val) {
+          return i;
+        }
+      }
+      // TODO: I don't think this works great as size_t is unsigned.
+      return -1;
+    }
+
+    void append(T val) {
+      insert(m_size, val);
+    }
+
+    void insert(size_t pos, T val) {
+      assert(pos >= 0);
+      assert(pos <= m_size);
+
+      growIfNeeded(m_size + 1);
+      for (ssize_t i = m_size - 1; i >= (ssize_t)pos; --i) {
+        m_backing[i + 1] = m_backing[i];
+      }
+      m_backing[pos] = val;
+      m_size += 1;
+    }
+
+    void remove(size_t pos) {
+      checkPos(pos);
+      for (size_t i = pos; i < m_size - 1; ++i) {
+        m_backing[i] = m_backing[i + 1];
+      }
+      m_size -= 1;
+    }
+
+    size_t size() const { return m_size; }
+
+    void resize(size_t newCapacity) { growIfNeeded(newCapacity); }
+    // TODO: Add shrink to fit?
+
+  private:
+    BetterVector() = delete;
+    // TODO: Make noncopyable for now.
+    template<typename U, typename A>
+    BetterVector(const BetterVector<U, A>&) = delete;
+    template<typename U, typename A>
+    void operator=(const BetterVector<U, A>&) = delete;
+
+    // TODO: Make container moveable.
+
+    void growIfNeeded(size_t newCapacity) {
+      if (m_capacity < newCapacity) {
+        size_t capacity = 1.4 * newCapacity;
+        T* new_backing = newArray(m_alloc, capacity);
+        for (size_t i = 0; i < m_size; ++i) {
+          new_backing[i] = m_backing[i];
+        }
+        deleteArray(m_alloc, m_backing, m_capacity);
+        m_backing = new_backing;
+        m_capacity = capacity;
+      }
+    }
+
+    inline void checkPos(size_t pos) const {
+      assert(pos >= 0);
+      assert(pos < m_size);
+    }
+
+    Allocator m_alloc;
+    T* m_backing;
+    size_t m_size;
+    size_t m_capacity;
+};
+
+template<typename T, typename A>
+std::ostream& operator<<(std::ostream& o, const BetterVector<T, A>& v) {
+  o << "[";
+  for (size_t i = 0; i < v.size(); ++i) {
+    if (i > 0) {
+      o << ", ";
+    }
+    o << v[i];
+  }
+  o << "]";
+
+  return o;
+}
@@ -0,0 +1,437 @@
+// Rope, see rope.cc for a demo.
+#pragma once
+
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <string>
+
+#include "../memory/allocators.h"
+
+// Nodes, and the characters of every leaf, come from |Allocator| rebound to
+// what they are. Nodes don't own their children: the rope creates and destroys
+// them, as that needs the allocator. Use the Rope alias for std::allocator.
+template<typename Allocator = std::allocator<char>>
+class BasicRope {
+public:
+  using String = std::basic_string<char, std::char_traits<char>, RebindAlloc<Allocator, char>>;
+
+  enum RopeNodeType {
+    LeafNodeType = 0,
+    ConcatNodeType = 1,
+  };
+
+  class LeafNode;
+  class ConcatNode;
+
+  class RopeNode {
+  public:
+    RopeNode(RopeNodeType type, int prefixLength)
+      : m_type(type)
+      , m_prefixLength(prefixLength) {}
+
+    bool isLeaf() const { return m_type == LeafNodeType; }
+    bool isConcat() const { return m_type == ConcatNodeType; }
+
+    int prefixLength() const { return m_prefixLength; }
+
+    LeafNode* toLeafNode() {
+      assert(isLeaf());
+      return static_cast<LeafNode*>(this);
+    }
+
+    ConcatNode* toConcatNode() {
+      assert(isConcat());
+      return static_cast<ConcatNode*>(this);
+    }
+
+    const LeafNode* toLeafNode() const {
+      assert(isLeaf());
+      return static_cast<const LeafNode*>(this);
+    }
+
+    const ConcatNode* toConcatNode() const {
+      assert(isConcat());
+      return static_cast<const ConcatNode*>(this);
+    }
+
+  private:
+    RopeNodeType m_type;
+
+  protected:
+    // This is the prefix length, ie the length of all strings on the left branch.
+    int m_prefixLength;
+
+    friend class BasicRope;
+  };
+
+  class LeafNode : public RopeNode {
+  public:
+    LeafNode(String s)
+      : RopeNode(LeafNodeType, s.length())
+      , m_s(std::move(s)) {}
+
+    const String& s() const { return m_s; }
+
+    void concat(const std::string& s) {
+      m_s.append(s.data(), s.size());
+      this->m_prefixLength += s.length();
+    }
+
+  private:
+    String m_s;
+  };
+
+  class ConcatNode : public RopeNode {
+  public:
+    ConcatNode(RopeNode* left, RopeNode* right)
+      : RopeNode(ConcatNodeType, left->prefixLength())
+      , m_left(left)
+      , m_right(right) {
+    }
+
+    // Left is guaranteed to non-null.
+    RopeNode* left() const { return m_left; }
+    // Right can be null.
+    RopeNode* right() const { return m_right; }
+
+    RopeNode* releaseLeft() { RopeNode* left = m_left; m_left = nullptr; return left; }
+    RopeNode* releaseRight() { RopeNode* right = m_right; m_right = nullptr; return right; }
+
+  private:
+    RopeNode* m_left;
+    RopeNode* m_right;
+
+    friend class BasicRope;
+  };
+
+  explicit BasicRope(const Allocator& alloc = Allocator())
+    : m_leafAlloc(alloc), m_concatAlloc(alloc), m_root(newLeaf(std::string())) {}
+
+  ~BasicRope() {
+    destroy(m_root);
+  }
+
+  // TODO: Make noncopyable for now.
+  BasicRope(const BasicRope&) = delete;
+  void operator=(const BasicRope&) = delete;
+
+  RopeNode* root() const { return m_root; }
+
+  int length() const;
+
+  void append(const std::string& s);
+  void insert(int offset, const std::string& s);
+
+  void dumpTree(std::ostream&) const;
+
+private:
+  using LeafAllocator = RebindAlloc<Allocator, LeafNode>;
+  using ConcatAllocator = RebindAlloc<Allocator, ConcatNode>;
+  using LeafTraits = std::allocator_traits<LeafAllocator>;
+  using ConcatTraits = std::allocator_traits<ConcatAllocator>;
+
+  LeafNode* newLeaf(const char* s, size_t length) {
+    LeafNode* n = LeafTraits::allocate(m_leafAlloc, 1);
+    LeafTraits::construct(m_leafAlloc, n, String(s, length, m_leafAlloc));
+    return n;
+  }
+
+  LeafNode* newLeaf(const std::string& s) { return newLeaf(s.data(), s.size()); }
+
+  // The characters of |ln| before and from |offset|.
+  LeafNode* newPrefixLeaf(const LeafNode* ln, int offset) { return newLeaf(ln->s().data(), offset); }
+  LeafNode* newSuffixLeaf(const LeafNode* ln, int offset) {
+    return newLeaf(ln->s().data() + offset, ln->s().length() - offset);
+  }
+
+  ConcatNode* newConcat(RopeNode* left, RopeNode* right) {
+    ConcatNode* n = ConcatTraits::allocate(m_concatAlloc, 1);
+    ConcatTraits::construct(m_concatAlloc, n, left, right);
+    return n;
+  }
+
+  // Destroys |n| and everything below it.
+  void destroy(RopeNode* n) {
+    if (!n) {
+      return;
+    }
+    if (n->isLeaf()) {
+      LeafTraits::destroy(m_leafAlloc, n->toLeafNode());
+      LeafTraits::deallocate(m_leafAlloc, n->toLeafNode(), 1);
+      return;
+    }
+    ConcatNode* cn = n->toConcatNode();
+    destroy(cn->m_left);
+    destroy(cn->m_right);
+    ConcatTraits::destroy(m_concatAlloc, cn);
+    ConcatTraits::deallocate(m_concatAlloc, cn, 1);
+  }
+
+  // Replaces the left child of |n|, destroying the previous one unless it was
+  // released.
+  void setLeft(ConcatNode* n, RopeNode* left) {
+    // It's possible for left to be 0 when we released it above.
+    assert(!n->m_left || n->m_prefixLength == n->m_left->prefixLength());
+
+    destroy(n->m_left);
+    n->m_left = left;
+  }
+
+  void setRight(ConcatNode* n, RopeNode* right) {
+    // We should never set right to nullptr here.
+    assert(right);
+
+    destroy(n->m_right);
+    n->m_right = right;
+  }
+
+  int insertRecursive(ConcatNode* curr, int offset, const std::string& s);
+
+  LeafAllocator m_leafAlloc;
+  ConcatAllocator m_concatAlloc;
+  RopeNode* m_root;
+};
+
+using Rope = BasicRope<>;
+
+template<typename Allocator>
+int BasicRope<Allocator>::length() const {
+  RopeNode* curr = root();
+  int l = 0;
+  while (curr) {
+    l += curr->prefixLength();
+    // Check for terminal node.
+    if (curr->isLeaf()) {
+      break;
+    }
+
+    ConcatNode* cn = curr->toConcatNode();
+    curr = cn->right();
+  }
+  return l;
+}
+
+template<typename Allocator>
+int BasicRope<Allocator>::insertRecursive(ConcatNode* curr, int offset, const std::string& s) {
+  // Check that we're not walking past the insertion point.
+  if (offset <= curr->prefixLength()) {
+    RopeNode* next = curr->left();
+    if (next->isLeaf()) {
+      // Are we prepending?
+      if (offset == 0) {
+        int rightLength = curr->left()->prefixLength();
+        LeafNode* left = newLeaf(s);
+        setLeft(curr, newConcat(left, curr->releaseLeft()));
+        curr->m_prefixLength = s.length() + rightLength;
+        return s.length();
+      }
+
+      // Are we appending?
+      if (offset == curr->prefixLength()) {
+        int leftLength = curr->left()->prefixLength();
+        LeafNode* right = newLeaf(s);
+        setLeft(curr, newConcat(curr->releaseLeft(), right));
+        curr->m_prefixLength = leftLength + s.length();
+        return s.length();
+      }
+
+      // We are inserting in the middle of the string so we need to split it first.
+      LeafNode* ln = next->toLeafNode();
+      int length = ln->s().length();
+      LeafNode* pre = newPrefixLeaf(ln, offset);
+      LeafNode* post = newSuffixLeaf(ln, offset);
+      RopeNode* bottomConcat = newConcat(newLeaf(s), post);
+      setLeft(curr, newConcat(pre, bottomConcat));
+      curr->m_prefixLength = length + s.length();
+      return s.length();
+    }
+
+    int delta = insertRecursive(next->toConcatNode(), offset, s);
+    curr->m_prefixLength += delta;
+    return delta;
+  }
+
+  offset -= curr->prefixLength();
+  RopeNode* next = curr->right();
+  if (next->isLeaf()) {
+    LeafNode* ln = next->toLeafNode();
+
+    // Are we appending?
+    if (offset >= ln->prefixLength()) {
+      int leftLength = curr->left()->prefixLength();
+      LeafNode* right = newLeaf(s);
+      setRight(curr, newConcat(curr->releaseRight(), right));
+      curr->m_prefixLength = leftLength + s.length();
+      return s.length();
+    }
+
+    // Are we prepending?
+    if (offset == 0) {
+      int rightLength = curr->right()->prefixLength();
+      LeafNode* left = newLeaf(s);
+      setRight(curr, newConcat(left, curr->releaseRight()));
+      curr->m_prefixLength = s.length() + rightLength;
+      return s.length();
+    }
+
+    // We are inserting in the middle of the string so we need to split it first.
+    int length = ln->s().length();
+    LeafNode* pre = newPrefixLeaf(ln, offset);
+    LeafNode* post = newSuffixLeaf(ln, offset);
+    RopeNode* bottomConcat = newConcat(newLeaf(s), post);
+    setRight(curr, newConcat(pre, bottomConcat));
+    curr->m_prefixLength = length + s.length();
+    return s.length();
+  }
+
+  ConcatNode* concatNext = next->toConcatNode();
+  if (!concatNext->right()) {
+    setRight(concatNext, newLeaf(s));
+    return s.length();
+  }
+
+  insertRecursive(concatNext, offset, s);
+  //curr->m_prefixLength += delta;
+  return 0;
+}
+
+template<typename Allocator>
+void BasicRope<Allocator>::insert(int offset, const std::string& s) {
+  // TODO: validate offset.
+  if (m_root->isLeaf()) {
+    LeafNode* ln = m_root->toLeafNode();
+    if (ln->prefixLength()) {
+      ln->concat(s);
+      return;
+    }
+
+    // Are we appending?
+    if (offset >= ln->prefixLength()) {
+      m_root = newConcat(m_root, newLeaf(s));
+      return;
+    }
+
+    // Are we prepending?
+    if (offset == 0) {
+      m_root = newConcat(newLeaf(s), m_root);
+      return;
+    }
+
+    // We are inserting in the middle of the string so we need to split it first.
+    LeafNode* pre = newPrefixLeaf(ln, offset);
+    LeafNode* post = newSuffixLeaf(ln, offset);
+    RopeNode* bottomConcat = newConcat(newLeaf(s), post);
+    RopeNode* newRoot = newConcat(pre, bottomConcat);
+    destroy(m_root);
+    m_root = newRoot;
+    return;
+   }
+
+  insertRecursive(m_root->toConcatNode(), offset, s);
+}
+
+template<typename Allocator>
+void BasicRope<Allocator>::dumpTree(std::ostream& o) const {
+  struct RopeNodeInfo {
+    const RopeNode* n;
+    int level;
+    bool isRight;
+  };
+
+  std::queue<RopeNodeInfo> q;
+  q.push(RopeNodeInfo{m_root, 0, false});
+  int lastLevel = 0;
+  while (!q.empty()) {
+    RopeNodeInfo i = q.front();
+    q.pop();
+    int level = i.level;
+    if (level != lastLevel) {
+      o << std::endl;
+      lastLevel = level;
+    } else {
+      o << "  ";
+    }
+    if (i.n->isLeaf()) {
+      const LeafNode* ln = i.n->toLeafNode();
+      if (level > 0) {
+        if (i.isRight) {
+          o << "R";
+        } else {
+          o << "L";
+        }
+      }
+      o << "l\"" << ln->s() << "\" (p=" << ln->prefixLength() << ")";
+    } else {
+      if (level > 0) {
+        if (i.isRight) {
+          o << "R";
+        } else {
+          o << "L";
+        }
+      }
+      const ConcatNode* cn = i.n->toConcatNode();
+      if (cn->left()) {
+        q.push(RopeNodeInfo{cn->left(), level + 1, false});
+      }
+      if (cn->right()) {
+        q.push(RopeNodeInfo{cn->right(), level + 1, true});
+      }
+      o << "c (p=" << cn->prefixLength() << ")";
+    }
+  }
+}
+
+template<typename Allocator>
+void BasicRope<Allocator>::append(const std::string& s) {
+  if (m_root->isLeaf()) {
+    LeafNode* ln = m_root->toLeafNode();
+    // TODO: Append short strings too?
+    if (!ln->prefixLength()) {
+      ln->concat(s);
+      return;
+    }
+
+    m_root = newConcat(m_root, newLeaf(s));
+    return;
+  }
+
+  // Find insertion point.
+  ConcatNode* curr = m_root->toConcatNode();
+  while (true) {
+    RopeNode* next = curr->right();
+    if (next->isLeaf()) {
+      LeafNode* right = newLeaf(s);
+      setRight(curr, newConcat(curr->releaseRight(), right));
+      return;
+    }
+    ConcatNode* concatNext = next->toConcatNode();
+    if (!concatNext->right()) {
+      setRight(concatNext, newLeaf(s));
+      return;
+    }
+
+    curr = concatNext;
+  }
+  // Not reached.
+}
+
+template<typename Allocator>
+void dfs(std::ostream& o, const typename BasicRope<Allocator>::RopeNode* n) {
+  if (n->isLeaf()) {
+    o << n->toLeafNode()->s();
+  } else {
+    const auto* cn = n->toConcatNode();
+    dfs<Allocator>(o, cn->left());
+    dfs<Allocator>(o, cn->right());
+  }
+}
+
+template<typename Allocator>
+std::ostream& operator<<(std::ostream& o, const BasicRope<Allocator>& r) {
+  o << "\"";
+  dfs<Allocator>(o, r.root());
+  o << "\"";
+  return o;
+}
@@ -1,201 +1,151 @@
 // Build using:
-//   g++ -Wall -Werror --sanitize=address -g -o doubly_linked_list doubly_linked_list.cc && ./doubly_linked_list
+//   g++ -Wall -Werror --sanitize=address -g -pthread -o doubly_linked_list doubly_linked_list.cc && ./doubly_linked_list
+// Benchmark using:
+//   g++ -Wall -Werror -O2 -DNDEBUG -pthread -o doubly_linked_list doubly_linked_list.cc && ./doubly_linked_list churn [ops]
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../memory/allocators.h"
+#include "doubly_linked_list.h"
+
+size_t peakRssKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
 
-// Doubly linked list implementation.
-
-// TODO: Templatize payload.
-class DoublyLinkedListNode {
-public:
-  DoublyLinkedListNode(int value) : m_value(value), m_prev(nullptr), m_next(nullptr) {}
-
-  // Make non-copiable for now.
-  DoublyLinkedListNode(const DoublyLinkedListNode&) = delete;
-  void operator=(const DoublyLinkedListNode&) = delete;
-
-  const DoublyLinkedListNode* next() const { return m_next.get(); }
-  DoublyLinkedListNode* next() { return m_next.get(); }
-
-  const DoublyLinkedListNode* prev() const { return m_prev; }
-  DoublyLinkedListNode* prev() { return m_prev; }
-
-  int value() const { return m_value; }
-
-  // insert takes ownership of the passed-in DoublyLinkedListNode.
-  void insertAfter(DoublyLinkedListNode* n) {
-    n->m_next.reset(m_next.release());
-    m_next.reset(n);
-    n->m_prev = this;
+// 50/50 insert/remove at the head of a list primed with |live| elements.
+template<typename Allocator>
+void churn(const char* name, size_t ops, size_t live) {
+  DoublyLinkedList<int, Allocator> l;
+  for (size_t i = 0; i < live; ++i) {
+    l.insertBefore(l.head(), i);
   }
-
-  void setPrev(DoublyLinkedListNode* prev) { m_prev = prev; }
-  void setNext(DoublyLinkedListNode* next) { m_next.reset(next); }
-  DoublyLinkedListNode* releaseNext() { return m_next.release(); }
-
-private:
-  int m_value;
-  // TODO: We could use shared_ptr here.
-  DoublyLinkedListNode* m_prev;
-  std::unique_ptr<DoublyLinkedListNode> m_next;
-};
-
-class DoublyLinkedList {
-public:
-  DoublyLinkedList() : m_head(nullptr), m_tail(nullptr) {}
-
-  // Make non-copiable for now.
-  DoublyLinkedList(const DoublyLinkedList&) = delete;
-  void operator=(const DoublyLinkedList&) = delete;
-
-  const DoublyLinkedListNode* head() const { return m_head.get(); }
-  DoublyLinkedListNode* head() { return m_head.get(); }
-
-  const DoublyLinkedListNode* tail() const { return m_tail; }
-  DoublyLinkedListNode* tail() { return m_tail; }
-
-  void append(DoublyLinkedListNode* n) {
-    if (!m_head) {
-      m_head.reset(n);
-      m_tail = n;
+  std::mt19937 rng(42);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < ops; ++i) {
+    if (!l.head() || (rng() & 1)) {
+      l.insertBefore(l.head(), i);
     } else {
-      DoublyLinkedListNode* curr = m_head.get();
-      assert(m_head);
-      while (true) {
-        DoublyLinkedListNode* next = curr->next();
-        if (!next) {
-          break;
-        }
-        curr = next;
-      }
-      curr->insertAfter(n);
-      if (curr == m_tail) {
-        m_tail = n;
-      }
+      l.remove(l.head());
     }
   }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "  " << name << ": " << (ops / seconds / 1e6) << " M allocs+frees/s"
+            << ", peak RSS=" << peakRssKb() << " KiB" << std::endl;
+}
 
-  // TODO: Ownership is not clear here. We should allow multiple ownership.
-  // Right now we deallocate |n|.
-  void remove(DoublyLinkedListNode* n) {
-    if (!m_head) {
-      // We should never hit this as we don't have any pointer to remove.
-      assert(false);
-      return;
-    }
-
-    if (head() == n) {
-      DoublyLinkedListNode* next = m_head->releaseNext();
-      next->setPrev(nullptr);
-      m_head.reset(next);
-    } else if (m_tail == n) {
-      DoublyLinkedListNode* prev = m_tail->prev();
-      prev->setNext(nullptr);
-      m_tail = prev;
-    } else {
-      DoublyLinkedListNode* prev = m_head.get();
-      DoublyLinkedListNode* curr = m_head->next();
-      while (curr) {
-        if (curr == n) {
-          DoublyLinkedListNode* next = curr->releaseNext();
-          prev->setNext(next);
-          next->setPrev(prev);
-          return;
-        }
-        prev = curr;
-        curr = curr->next();
+// A producer thread allocates nodes that a consumer thread frees, handed over
+// in batches with at most kInFlight batches queued. Pools that keep freed
+// nodes on the freeing thread grow without bound here.
+template<typename Allocator>
+void handoff(const char* name, size_t ops) {
+  using NodeAllocator = RebindAlloc<Allocator, DoublyLinkedListNode<int>>;
+  using NodeTraits = std::allocator_traits<NodeAllocator>;
+  using Batch = std::vector<DoublyLinkedListNode<int>*>;
+  constexpr size_t kBatch = 256;
+  constexpr size_t kInFlight = 64;
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<Batch> queue;
+  auto start = std::chrono::steady_clock::now();
+  std::thread consumer([&] {
+    NodeAllocator alloc;
+    for (size_t freed = 0; freed < ops;) {
+      Batch batch;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return !queue.empty(); });
+        batch = std::move(queue.front());
+        queue.pop_front();
       }
-      delete n;
-    }
-  }
-
-  void insertBefore(DoublyLinkedListNode* before, DoublyLinkedListNode* newNode) {
-    // This is a safety as the logic will delete whatever comes after...
-    assert(!newNode->next());
-
-    if (head() == before) {
-      if (head() == m_tail) {
-        m_tail = newNode;
+      changed.notify_all();
+      for (DoublyLinkedListNode<int>* n : batch) {
+        NodeTraits::destroy(alloc, n);
+        NodeTraits::deallocate(alloc, n, 1);
       }
-      m_head.release();
-      newNode->setNext(before);
-      before->setPrev(newNode);
-      m_head.reset(newNode);
-      return;
+      freed += batch.size();
     }
-
-    if (before == m_tail) {
-      m_tail->setNext(newNode);
-      newNode->setPrev(m_tail);
-      m_tail = newNode;
-      return;
+  });
+  NodeAllocator alloc;
+  for (size_t produced = 0; produced < ops;) {
+    Batch batch;
+    for (; batch.size() < kBatch && produced < ops; ++produced) {
+      DoublyLinkedListNode<int>* n = NodeTraits::allocate(alloc, 1);
+      NodeTraits::construct(alloc, n, int(produced));
+      batch.push_back(n);
     }
-
-    DoublyLinkedListNode* prev = head();
-    DoublyLinkedListNode* curr = prev->next();
-    while (curr) {
-      if (curr == before) {
-        DoublyLinkedListNode* next = prev->releaseNext();
-        prev->setNext(newNode);
-        newNode->setNext(next);
-        newNode->setPrev(prev);
-        return;
-      }
-      prev = curr;
-      curr = curr->next();
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [&] { return queue.size() < kInFlight; });
+      queue.push_back(std::move(batch));
     }
-    // Probably a bug if we didn't find |before|.
-    assert(false);
+    changed.notify_all();
   }
+  consumer.join();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "  " << name << ": " << (ops / seconds / 1e6) << " M allocs+frees/s"
+            << ", peak RSS=" << peakRssKb() << " KiB" << std::endl;
+}
 
-private:
-  std::unique_ptr<DoublyLinkedListNode> m_head;
-  DoublyLinkedListNode* m_tail;
-};
-
-std::ostream& operator<<(std::ostream& o, const DoublyLinkedList& l) {
-  const DoublyLinkedListNode* head = l.head();
-  o << std::endl;
-  o << "  fwd{";
-  const DoublyLinkedListNode* curr = head;
-  while (curr) {
-    if (curr != head) {
-      o << " -> ";
+// Each allocator runs in its own process so that peak RSS isn't shared.
+int benchChurn(size_t ops) {
+  const size_t live = 1000000;
+  for (int variant = 0; variant < 4; ++variant) {
+    if (variant == 0) {
+      std::cout << "Churn: " << ops << " ops over " << live << " live nodes" << std::endl;
+    } else if (variant == 2) {
+      std::cout << "Producer/consumer: " << ops << " nodes allocated and freed on different threads" << std::endl;
     }
-    o << curr->value(); 
-    curr = curr->next();
-  }
-  o << "}" << std::endl;
-
-  o << "  backwd{";
-  curr = l.tail();
-  while (curr) {
-    if (curr != l.tail()) {
-      o << " -> ";
+    pid_t pid = fork();
+    if (pid == 0) {
+      if (variant == 0) {
+        churn<std::allocator<int>>("std::allocator", ops, live);
+      } else if (variant == 1) {
+        churn<NodePoolAllocator<int>>("NodePoolAllocator", ops, live);
+      } else if (variant == 2) {
+        handoff<std::allocator<int>>("std::allocator", ops);
+      } else {
+        handoff<NodePoolAllocator<int>>("NodePoolAllocator", ops);
+      }
+      std::cout.flush();
+      _exit(0);
     }
-    o << curr->value(); 
-    curr = curr->prev();
+    waitpid(pid, nullptr, 0);
   }
-  o << "}" << std::endl;
-#ifndef NDEBUG
-  o << " [head=" << l.head() << ", " << l.tail() << "]";
-#endif
-  return o;
+  return 0;
 }
 
-int main() {
-  DoublyLinkedList l;
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "churn") {
+    return benchChurn(argc > 2 ? std::stoull(argv[2]) : 20000000);
+  }
+
+  DoublyLinkedList<int> l;
   std::cout << "Empty linked list: " << l << std::endl;
-  DoublyLinkedListNode* first = new DoublyLinkedListNode(10);
-  l.append(first);
+  DoublyLinkedListNode<int>* first = l.append(10);
   std::cout << "After adding 10 to list: " << l << std::endl;
-  DoublyLinkedListNode* second = new DoublyLinkedListNode(50);
-  l.append(second);
+  DoublyLinkedListNode<int>* second = l.append(50);
   std::cout << "After adding 50 to list: " << l << std::endl;
-  l.insertBefore(second, new DoublyLinkedListNode(25));
+  l.insertBefore(second, 25);
   std::cout << "After inserting 25 to list: " << l << std::endl;
-  l.insertBefore(first, new DoublyLinkedListNode(5));
+  l.insertBefore(first, 5);
   std::cout << "After inserting 5 to list: " << l << std::endl;
   l.remove(first);
   first = nullptr;
@@ -206,5 +156,23 @@ int main() {
   l.remove(l.head());
   std::cout << "After removing head to list: " << l << std::endl;
 
+  // Every node goes through the list's allocator, and back.
+  AllocationStats stats;
+  {
+    DoublyLinkedList<int, CountingAllocator<int>> counted{CountingAllocator<int>(stats)};
+    for (int i = 0; i < 100; ++i) {
+      counted.insertBefore(counted.head(), i);
+    }
+    counted.remove(counted.tail());
+    std::cout << "Counted list of 99 elements: " << stats << std::endl;
+    assert(stats.allocations() == 100 && stats.liveBytes() == 99 * sizeof(DoublyLinkedListNode<int>));
+  }
+  assert(stats.liveBytes() == 0);
+
+  // Destroyed at exit, after this thread's pool cache was flushed, so its nodes
+  // go straight back to the shared pool.
+  static DoublyLinkedList<int> leftover;
+  leftover.append(1);
+
   return 0;
 }
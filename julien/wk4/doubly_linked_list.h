@@ -0,0 +1,174 @@
+// DoublyLinkedList, see doubly_linked_list.cc for a demo and benchmarks.
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+
+#include "../memory/allocators.h"
+#include "node_pool.h"
+
+// Doubly linked list implementation.
+
+template<typename T, typename Allocator = NodePoolAllocator<T>>
+class DoublyLinkedList;
+
+template<typename T>
+class DoublyLinkedListNode {
+public:
+  DoublyLinkedListNode(T value) : m_value(value), m_prev(nullptr), m_next(nullptr) {}
+
+  // Make non-copiable for now.
+  DoublyLinkedListNode(const DoublyLinkedListNode&) = delete;
+  void operator=(const DoublyLinkedListNode&) = delete;
+
+  const DoublyLinkedListNode* next() const { return m_next; }
+  DoublyLinkedListNode* next() { return m_next; }
+
+  const DoublyLinkedListNode* prev() const { return m_prev; }
+  DoublyLinkedListNode* prev() { return m_prev; }
+
+  const T& value() const { return m_value; }
+
+private:
+  template<typename, typename> friend class DoublyLinkedList;
+
+  T m_value;
+  DoublyLinkedListNode* m_prev;
+  DoublyLinkedListNode* m_next;
+};
+
+// The list owns its nodes: they are created from values and destroyed by the
+// list through |Allocator|, rebound to the node type. The default allocator
+// hands them out of a thread-local NodePool.
+template<typename T, typename Allocator>
+class DoublyLinkedList {
+  using Node = DoublyLinkedListNode<T>;
+  using NodeAllocator = RebindAlloc<Allocator, Node>;
+  using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+public:
+  explicit DoublyLinkedList(const Allocator& alloc = Allocator())
+    : m_alloc(alloc), m_head(nullptr), m_tail(nullptr) {}
+
+  ~DoublyLinkedList() {
+    // Iterative so that long lists don't overflow the stack.
+    Node* curr = m_head;
+    while (curr) {
+      Node* next = curr->m_next;
+      destroyNode(curr);
+      curr = next;
+    }
+  }
+
+  // Make non-copiable for now.
+  DoublyLinkedList(const DoublyLinkedList&) = delete;
+  void operator=(const DoublyLinkedList&) = delete;
+
+  const Node* head() const { return m_head; }
+  Node* head() { return m_head; }
+
+  const Node* tail() const { return m_tail; }
+  Node* tail() { return m_tail; }
+
+  Node* append(T value) {
+    Node* n = newNode(std::move(value));
+    n->m_prev = m_tail;
+    if (m_tail) {
+      m_tail->m_next = n;
+    } else {
+      m_head = n;
+    }
+    m_tail = n;
+    return n;
+  }
+
+  // |before| may be head(), including a null head() to start an empty list.
+  Node* insertBefore(Node* before, T value) {
+    if (!before) {
+      assert(!m_head);
+      return append(std::move(value));
+    }
+    Node* n = newNode(std::move(value));
+    n->m_prev = before->m_prev;
+    n->m_next = before;
+    if (before->m_prev) {
+      before->m_prev->m_next = n;
+    } else {
+      m_head = n;
+    }
+    before->m_prev = n;
+    return n;
+  }
+
+  // Unlinks and destroys |n|.
+  void remove(Node* n) {
+    if (!m_head) {
+      // We should never hit this as we don't have any pointer to remove.
+      assert(false);
+      return;
+    }
+
+    if (n->m_prev) {
+      n->m_prev->m_next = n->m_next;
+    } else {
+      assert(m_head == n);
+      m_head = n->m_next;
+    }
+    if (n->m_next) {
+      n->m_next->m_prev = n->m_prev;
+    } else {
+      assert(m_tail == n);
+      m_tail = n->m_prev;
+    }
+    destroyNode(n);
+  }
+
+private:
+  Node* newNode(T&& value) {
+    Node* n = NodeTraits::allocate(m_alloc, 1);
+    NodeTraits::construct(m_alloc, n, std::move(value));
+    return n;
+  }
+
+  void destroyNode(Node* n) {
+    NodeTraits::destroy(m_alloc, n);
+    NodeTraits::deallocate(m_alloc, n, 1);
+  }
+
+  NodeAllocator m_alloc;
+  Node* m_head;
+  Node* m_tail;
+};
+
+template<typename T, typename Allocator>
+std::ostream& operator<<(std::ostream& o, const DoublyLinkedList<T, Allocator>& l) {
+  const DoublyLinkedListNode<T>* head = l.head();
+  o << std::endl;
+  o << "  fwd{";
+  const DoublyLinkedListNode<T>* curr = head;
+  while (curr) {
+    if (curr != head) {
+      o << " -> ";
+    }
+    o << curr->value(); 
+    curr = curr->next();
+  }
+  o << "}" << std::endl;
+
+  o << "  backwd{";
+  curr = l.tail();
+  while (curr) {
+    if (curr != l.tail()) {
+      o << " -> ";
+    }
+    o << curr->value(); 
+    curr = curr->prev();
+  }
+  o << "}" << std::endl;
+#ifndef NDEBUG
+  o << " [head=" << l.head() << ", " << l.tail() << "]";
+#endif
+  return o;
+}
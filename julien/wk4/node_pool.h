@@ -0,0 +1,265 @@
+// Fixed size block pools used by the linked lists.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+
+// Pool of fixed size blocks carved out of 64KiB slabs so that node churn
+// doesn't hit malloc.
+//
+// Each thread allocates from and frees to a small cache of its own, without
+// locking. Caches trade blocks with a shared depot in batches: a cache holding
+// more than two batches gives one back, so a thread freeing what another one
+// allocated doesn't hoard blocks, and an exiting thread gives all of its
+// blocks back. The depot sorts returned blocks by slab, which it finds by
+// aligning slabs to their size, and frees a slab once all of its blocks are
+// back, keeping one spare.
+template<size_t kBlockSize>
+class NodePool {
+  static constexpr size_t kSlabSize = 64 * 1024;
+  static constexpr size_t kAlignment = alignof(std::max_align_t);
+  static constexpr size_t kStride =
+    (std::max(kBlockSize, sizeof(void*)) + kAlignment - 1) / kAlignment * kAlignment;
+
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  // Header at the start of every slab, only touched under the depot lock.
+  struct Slab {
+    // Blocks of this slab held by the depot.
+    FreeBlock* free;
+    size_t freeCount;
+    // Depot list of slabs with free blocks.
+    Slab* prev;
+    Slab* next;
+  };
+
+  static constexpr size_t kFirstBlock = (sizeof(Slab) + kAlignment - 1) / kAlignment * kAlignment;
+  static constexpr size_t kBlocksPerSlab = (kSlabSize - kFirstBlock) / kStride;
+  static_assert(kBlocksPerSlab > 0, "Block doesn't fit in a slab");
+  static constexpr size_t kBatch = std::max<size_t>(1, kBlocksPerSlab / 8);
+
+  class Depot {
+  public:
+    // Moves up to |count| blocks to |out|, allocating a slab if there are none.
+    // Returns how many it moved.
+    size_t take(FreeBlock*& out, size_t count) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_slabs) {
+        link(newSlab());
+      }
+      size_t taken = 0;
+      while (taken < count && m_slabs) {
+        Slab* slab = m_slabs;
+        if (slab->freeCount == kBlocksPerSlab) {
+          m_emptySlabs--;
+        }
+        while (taken < count && slab->free) {
+          FreeBlock* b = slab->free;
+          slab->free = b->next;
+          slab->freeCount--;
+          b->next = out;
+          out = b;
+          taken++;
+        }
+        if (!slab->free) {
+          unlink(slab);
+        }
+      }
+      return taken;
+    }
+
+    // Takes back a chain of blocks from any slabs.
+    void give(FreeBlock* chain) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      while (chain) {
+        FreeBlock* b = chain;
+        chain = b->next;
+        Slab* slab = slabOf(b);
+        if (!slab->free) {
+          link(slab);
+        }
+        b->next = slab->free;
+        slab->free = b;
+        if (++slab->freeCount == kBlocksPerSlab && ++m_emptySlabs > 1) {
+          unlink(slab);
+          ::operator delete(slab, std::align_val_t(kSlabSize));
+          m_emptySlabs--;
+        }
+      }
+    }
+
+  private:
+    static Slab* newSlab() {
+      void* memory = ::operator new(kSlabSize, std::align_val_t(kSlabSize));
+      Slab* slab = new (memory) Slab{nullptr, 0, nullptr, nullptr};
+      // Push in reverse so that blocks are handed out in address order.
+      for (size_t i = kBlocksPerSlab; i > 0; --i) {
+        FreeBlock* b = reinterpret_cast<FreeBlock*>(static_cast<char*>(memory) + kFirstBlock + (i - 1) * kStride);
+        b->next = slab->free;
+        slab->free = b;
+      }
+      slab->freeCount = kBlocksPerSlab;
+      return slab;
+    }
+
+    static Slab* slabOf(FreeBlock* b) {
+      return reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(b) & ~uintptr_t(kSlabSize - 1));
+    }
+
+    void link(Slab* slab) {
+      slab->prev = nullptr;
+      slab->next = m_slabs;
+      if (m_slabs) {
+        m_slabs->prev = slab;
+      }
+      m_slabs = slab;
+      if (slab->freeCount == kBlocksPerSlab) {
+        m_emptySlabs++;
+      }
+    }
+
+    void unlink(Slab* slab) {
+      if (slab->prev) {
+        slab->prev->next = slab->next;
+      } else {
+        m_slabs = slab->next;
+      }
+      if (slab->next) {
+        slab->next->prev = slab->prev;
+      }
+    }
+
+    std::mutex m_mutex;
+    Slab* m_slabs = nullptr;
+    // Slabs of m_slabs with all of their blocks free.
+    size_t m_emptySlabs = 0;
+  };
+
+  // Trivially destructible so that it outlives the thread's other
+  // thread_locals: nodes of lists with static or thread storage duration may
+  // be freed after the Flusher ran, and then go straight to the depot.
+  struct Cache {
+    FreeBlock* free;
+    size_t count;
+    bool registered;
+    bool flushed;
+  };
+
+  struct Flusher {
+    ~Flusher() {
+      Cache& c = cache();
+      depot().give(c.free);
+      c.free = nullptr;
+      c.count = 0;
+      c.flushed = true;
+    }
+  };
+
+public:
+  static void* allocate() {
+    Cache& c = cache();
+    if (!c.free) {
+      if (c.flushed) {
+        FreeBlock* b = nullptr;
+        depot().take(b, 1);
+        return b;
+      }
+      registerFlush(c);
+      c.count += depot().take(c.free, kBatch);
+    }
+    FreeBlock* b = c.free;
+    c.free = b->next;
+    c.count--;
+    return b;
+  }
+
+  static void deallocate(void* p) {
+    Cache& c = cache();
+    FreeBlock* b = static_cast<FreeBlock*>(p);
+    if (c.flushed) {
+      b->next = nullptr;
+      depot().give(b);
+      return;
+    }
+    if (!c.registered) {
+      registerFlush(c);
+    }
+    b->next = c.free;
+    c.free = b;
+    if (++c.count > 2 * kBatch) {
+      giveBatch(c);
+    }
+  }
+
+private:
+  static Cache& cache() {
+    thread_local Cache c{nullptr, 0, false, false};
+    return c;
+  }
+
+  static void registerFlush(Cache& c) {
+    thread_local Flusher flusher;
+    (void)flusher;
+    c.registered = true;
+  }
+
+  // Intentionally leaked: blocks may still be freed while static objects are
+  // destroyed at exit.
+  static Depot& depot() {
+    static Depot* d = new Depot;
+    return *d;
+  }
+
+  static void giveBatch(Cache& c) {
+    FreeBlock* chain = c.free;
+    FreeBlock* last = chain;
+    for (size_t i = 1; i < kBatch; ++i) {
+      last = last->next;
+    }
+    c.free = last->next;
+    last->next = nullptr;
+    c.count -= kBatch;
+    depot().give(chain);
+  }
+};
+
+// Standard allocator handing single objects out of the NodePool of their size,
+// the default for the linked lists. Arrays go to operator new. Stateless, so
+// any instance frees what another one allocated, on any thread.
+template<typename T>
+class NodePoolAllocator {
+  static_assert(alignof(T) <= alignof(std::max_align_t), "NodePool blocks aren't aligned enough");
+
+public:
+  using value_type = T;
+
+  NodePoolAllocator() = default;
+  template<typename U>
+  NodePoolAllocator(const NodePoolAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    if (n == 1) {
+      return static_cast<T*>(NodePool<sizeof(T)>::allocate());
+    }
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) {
+    if (n == 1) {
+      NodePool<sizeof(T)>::deallocate(p);
+      return;
+    }
+    ::operator delete(p);
+  }
+
+  template<typename U>
+  bool operator==(const NodePoolAllocator<U>&) const { return true; }
+  template<typename U>
+  bool operator!=(const NodePoolAllocator<U>&) const { return false; }
+};
@@ -4,89 +4,32 @@
 #include <iostream>
 #include <vector>
 
-template<typename T>
-class RingBuffer {
-public:
-  // Note: Only size-1 element can be stored in the buffer.
-  RingBuffer(size_t size)
-    : m_buf(new T[size])
-    , m_size(size)
-    , m_readIdx(0)
-    , m_writeIdx(0) {}
-
-  ~RingBuffer() {
-    delete [] m_buf;
-  }
-
-  // TODO: We could allow resizing, should we?
-  size_t size() const { return m_size; }
-  size_t length() const { return m_size; }
-
-  // TODO: This is logically const, make it so?
-  T readOne(bool& read) {
-    if (m_readIdx == m_writeIdx) {
-      read = false;
-      return T{};
+#include "ring_buffer.h"
+
+// Evaluated by the compiler: sum of what a 5 slot ring holds after 7 writes
+// interleaved with 2 reads, then a bulk write of which 2 elements fit.
+constexpr int fixedRingBufferSum() {
+  FixedRingBuffer<int, 5> b;
+  bool read = false;
+  int sum = 0;
+  for (int i = 1; i <= 7; ++i) {
+    if (!b.writeOne(i)) {
+      b.readOne(read);
+      b.writeOne(i);
     }
-    read =  true;
-    T res = m_buf[m_readIdx];
-    m_readIdx = (m_readIdx + 1) % m_size;
-    return res;
   }
-
-  // TODO: We should allow a reference/move here instead of doing a copy.
-  bool writeOne(T data) {
-    size_t nextWriteIdx = (m_writeIdx + 1) % m_size;
-    if (nextWriteIdx == m_readIdx) {
-      return false;
-    }
-    m_buf[m_writeIdx] = data;
-    m_writeIdx = nextWriteIdx;
-    return true;
-  }
-
-  size_t write(const std::vector<T>& v) {
-    size_t vIdx = 0;
-    while (vIdx < v.size()) {
-      size_t nextWriteIdx = (m_writeIdx + 1) % m_size;
-      if (nextWriteIdx == m_readIdx) {
-        // Prevent overflow.
-        return vIdx;
-      }
-      m_buf[m_writeIdx] = v[vIdx];
-      vIdx++;
-      m_writeIdx = nextWriteIdx;
-    }
-    return vIdx;
+  b.readOne(read);
+  b.readOne(read);
+  const int more[] = {10, 20, 30};
+  if (b.write(more, 3) != 2) {
+    return -1;
   }
-
-  void dump(std::ostream& o) const {
-    o << "[";
-    for (size_t idx = m_readIdx; idx != m_writeIdx; idx = (idx + 1) % m_size) {
-      if (idx != m_readIdx) {
-        o << ", ";
-      }
-      o << m_buf[idx];
-    }
-    o << "] (readIdx=";
-    o << m_readIdx;
-    o << ", writeIdx=";
-    o << m_writeIdx;
-    o << ")";
+  while (!b.empty()) {
+    sum += b.readOne(read);
   }
-
-private:
-  T* m_buf;
-  size_t m_size;
-  size_t m_readIdx;
-  size_t m_writeIdx;
-};
-
-template <typename U>
-std::ostream& operator<<(std::ostream& o, const RingBuffer<U>& b) {
-  b.dump(o);
-  return o;
+  return sum;
 }
+static_assert(fixedRingBufferSum() == 5 + 6 + 7 + 10 + 20, "FixedRingBuffer must drop the oldest reads");
 
 int main() {
   RingBuffer<int> b(5);
@@ -105,5 +48,14 @@ int main() {
   written = b.writeOne(1);
   std::cout << "Ringbuffer after trying to append to full ringbuffer: " << b << "(written=" << written << ")" << std::endl;
 
+  // All 5 slots of a FixedRingBuffer are usable.
+  FixedRingBuffer<int, 5> f;
+  const int values[] = {2, 3, 4, 5, 6, 7};
+  elemWritten = f.write(values, 6);
+  std::cout << "FixedRingBuffer after appending multiple: " << f << "(elemWritten=" << elemWritten << ")" << std::endl;
+  f.readOne(read);
+  written = f.writeOne(7);
+  std::cout << "FixedRingBuffer after reading 1 and appending 7: " << f << "(written=" << written << ")" << std::endl;
+
   return 0;
 }
@@ -0,0 +1,175 @@
+// RingBuffer and FixedRingBuffer, see ring_buffer.cc for a demo.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "../memory/allocators.h"
+
+template<typename T, typename Allocator = std::allocator<T>>
+class RingBuffer {
+public:
+  // Note: Only size-1 element can be stored in the buffer.
+  RingBuffer(size_t size, const Allocator& alloc = Allocator())
+    : m_alloc(alloc)
+    , m_buf(newArray(m_alloc, size))
+    , m_size(size)
+    , m_readIdx(0)
+    , m_writeIdx(0) {}
+
+  ~RingBuffer() {
+    deleteArray(m_alloc, m_buf, m_size);
+  }
+
+  // TODO: We could allow resizing, should we?
+  size_t size() const { return m_size; }
+  size_t length() const { return m_size; }
+
+  // TODO: This is logically const, make it so?
+  T readOne(bool& read) {
+    if (m_readIdx == m_writeIdx) {
+      read = false;
+      return T{};
+    }
+    read =  true;
+    T res = m_buf[m_readIdx];
+    m_readIdx = (m_readIdx + 1) % m_size;
+    return res;
+  }
+
+  // TODO: We should allow a reference/move here instead of doing a copy.
+  bool writeOne(T data) {
+    size_t nextWriteIdx = (m_writeIdx + 1) % m_size;
+    if (nextWriteIdx == m_readIdx) {
+      return false;
+    }
+    m_buf[m_writeIdx] = data;
+    m_writeIdx = nextWriteIdx;
+    return true;
+  }
+
+  size_t write(const std::vector<T>& v) {
+    size_t vIdx = 0;
+    while (vIdx < v.size()) {
+      size_t nextWriteIdx = (m_writeIdx + 1) % m_size;
+      if (nextWriteIdx == m_readIdx) {
+        // Prevent overflow.
+        return vIdx;
+      }
+      m_buf[m_writeIdx] = v[vIdx];
+      vIdx++;
+      m_writeIdx = nextWriteIdx;
+    }
+    return vIdx;
+  }
+
+  void dump(std::ostream& o) const {
+    o << "[";
+    for (size_t idx = m_readIdx; idx != m_writeIdx; idx = (idx + 1) % m_size) {
+      if (idx != m_readIdx) {
+        o << ", ";
+      }
+      o << m_buf[idx];
+    }
+    o << "] (readIdx=";
+    o << m_readIdx;
+    o << ", writeIdx=";
+    o << m_writeIdx;
+    o << ")";
+  }
+
+private:
+  Allocator m_alloc;
+  T* m_buf;
+  size_t m_size;
+  size_t m_readIdx;
+  size_t m_writeIdx;
+};
+
+template <typename U, typename A>
+std::ostream& operator<<(std::ostream& o, const RingBuffer<U, A>& b) {
+  b.dump(o);
+  return o;
+}
+
+// RingBuffer with a compile time capacity: the elements live inline, nothing
+// is allocated and everything but dump() is constexpr.
+//
+// The read and write counters run freely and are only reduced modulo N when
+// indexing, which is a mask for a power of two N (and a multiplication
+// otherwise, never a division). Unlike RingBuffer all N slots are usable.
+template<typename T, size_t N>
+class FixedRingBuffer {
+  static_assert(N > 0, "FixedRingBuffer needs room for at least 1 element");
+
+public:
+  constexpr FixedRingBuffer() : m_buf{}, m_read(0), m_written(0) {}
+
+  static constexpr size_t size() { return N; }
+  constexpr size_t length() const { return m_written - m_read; }
+  constexpr bool empty() const { return m_read == m_written; }
+  constexpr bool full() const { return m_written - m_read == N; }
+
+  constexpr T readOne(bool& read) {
+    if (empty()) {
+      read = false;
+      return T{};
+    }
+    read = true;
+    return m_buf[slot(m_read++)];
+  }
+
+  constexpr bool writeOne(T data) {
+    if (full()) {
+      return false;
+    }
+    m_buf[slot(m_written++)] = data;
+    return true;
+  }
+
+  // Writes as many of the |count| elements at |data| as fit, and returns how
+  // many it wrote.
+  constexpr size_t write(const T* data, size_t count) {
+    count = std::min(count, N - length());
+    for (size_t i = 0; i < count; ++i) {
+      m_buf[slot(m_written++)] = data[i];
+    }
+    return count;
+  }
+
+  void dump(std::ostream& o) const {
+    o << "[";
+    for (size_t i = m_read; i != m_written; ++i) {
+      if (i != m_read) {
+        o << ", ";
+      }
+      o << m_buf[slot(i)];
+    }
+    o << "] (read=" << m_read << ", written=" << m_written << ")";
+  }
+
+private:
+  static constexpr size_t slot(size_t counter) {
+    if constexpr ((N & (N - 1)) == 0) {
+      return counter & (N - 1);
+    } else {
+      return counter % N;
+    }
+  }
+
+  std::array<T, N> m_buf;
+  // Elements ever read and written. 64 bit counters don't wrap in practice.
+  size_t m_read;
+  size_t m_written;
+};
+
+template <typename U, size_t N>
+std::ostream& operator<<(std::ostream& o, const FixedRingBuffer<U, N>& b) {
+  b.dump(o);
+  return o;
+}
@@ -1,153 +1,163 @@
 // Build using:
 //   g++ -Wall -Werror --sanitize=address -g -o singly_linked_list singly_linked_list.cc && ./singly_linked_list
+// Benchmark using:
+//   g++ -Wall -Werror -O2 -DNDEBUG -o singly_linked_list singly_linked_list.cc && ./singly_linked_list bench [size]
+//   ./singly_linked_list churn [ops]
 #include <cassert>
+#include <chrono>
+#include <cstddef>
 #include <iostream>
 #include <memory>
+#include <random>
+#include <string>
+#include <vector>
 
-// Singly linked list implementation.
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
-// TODO: Templatize payload.
-class SinglyLinkedListNode {
-public:
-  SinglyLinkedListNode(int value) : m_value(value), m_next(nullptr) {}
+#include "../memory/allocators.h"
+#include "singly_linked_list.h"
 
-  // Make non-copiable for now.
-  SinglyLinkedListNode(const SinglyLinkedListNode&) = delete;
-  void operator=(const SinglyLinkedListNode&) = delete;
-
-  const SinglyLinkedListNode* next() const { return m_next.get(); }
-  SinglyLinkedListNode* next() { return m_next.get(); }
-
-  int value() const { return m_value; }
-
-  // insert takes ownership of the passed-in SinglyLinkedListNode.
-  void insert(SinglyLinkedListNode* n) {
-    n->m_next.reset(m_next.release());
-    m_next.reset(n);
-  }
-
-  void setNext(SinglyLinkedListNode* next) { m_next.reset(next); }
-  SinglyLinkedListNode* releaseNext() { return m_next.release(); }
-
-private:
-  int m_value;
-  std::unique_ptr<SinglyLinkedListNode> m_next;
-};
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
 
-class SinglyLinkedList {
-public:
-  SinglyLinkedList() : m_head(nullptr) {}
+void reportTiming(const char* name, const char* op, double seconds, size_t ops) {
+  std::cout << "  " << name << " " << op << ": " << seconds * 1e3 << " ms ("
+            << seconds * 1e9 / ops << " ns/elem)" << std::endl;
+}
 
-  // Make non-copiable for now.
-  SinglyLinkedList(const SinglyLinkedList&) = delete;
-  void operator=(const SinglyLinkedList&) = delete;
+// Builds, traverses, inserts after every 8th element then tears down a list of
+// |size| elements with both implementations.
+int bench(size_t size) {
+  std::cout << "List of " << size << " elements" << std::endl;
+  long long sum = 0;
+  {
+    const char* name = "SinglyLinkedList";
+    auto start = std::chrono::steady_clock::now();
+    SinglyLinkedList<int>* l = new SinglyLinkedList<int>;
+    SinglyLinkedListNode<int>* tail = l->append(0);
+    for (size_t i = 1; i < size; ++i) {
+      tail = l->insertAfter(tail, i);
+    }
+    reportTiming(name, "build", secondsSince(start), size);
 
-  const SinglyLinkedListNode* head() const { return m_head.get(); }
-  SinglyLinkedListNode* head() { return m_head.get(); }
+    start = std::chrono::steady_clock::now();
+    for (const SinglyLinkedListNode<int>* n = l->head(); n; n = n->next()) {
+      sum += n->value();
+    }
+    reportTiming(name, "traversal", secondsSince(start), size);
 
-  void append(SinglyLinkedListNode* n) {
-    if (!m_head) {
-      m_head.reset(n);
-    } else {
-      SinglyLinkedListNode* curr = m_head.get();
-      assert(m_head);
-      while (true) {
-        SinglyLinkedListNode* next = curr->next();
-        if (!next) {
-          break;
-        }
-        curr = next;
+    start = std::chrono::steady_clock::now();
+    size_t i = 0;
+    for (SinglyLinkedListNode<int>* n = l->head(); n; n = n->next()) {
+      if (++i % 8 == 0) {
+        n = l->insertAfter(n, -1);
       }
-      curr->insert(n);
     }
+    reportTiming(name, "insert after cursor", secondsSince(start), size / 8);
+
+    start = std::chrono::steady_clock::now();
+    delete l;
+    reportTiming(name, "teardown", secondsSince(start), size + size / 8);
   }
+  {
+    const char* name = "UnrolledSinglyLinkedList";
+    auto start = std::chrono::steady_clock::now();
+    UnrolledSinglyLinkedList<int>* l = new UnrolledSinglyLinkedList<int>;
+    for (size_t i = 0; i < size; ++i) {
+      l->append(i);
+    }
+    reportTiming(name, "build", secondsSince(start), size);
 
-  // TODO: Ownership is not clear here. We should allow multiple ownership.
-  // Right now we deallocate |n|.
-  void remove(SinglyLinkedListNode* n) {
-    if (!m_head) {
-      // We should never hit this as we don't have any pointer to remove.
-      assert(false);
-      return;
+    start = std::chrono::steady_clock::now();
+    for (auto c = l->begin(); c.valid(); c.advance()) {
+      sum -= c.value();
     }
+    reportTiming(name, "traversal", secondsSince(start), size);
 
-    if (head() == n) {
-      SinglyLinkedListNode* next = m_head->releaseNext();
-      m_head.reset(next);
-    } else {
-      SinglyLinkedListNode* prev = m_head.get();
-      SinglyLinkedListNode* curr = m_head->next();
-      while (curr) {
-        if (curr == n) {
-          SinglyLinkedListNode* next = curr->releaseNext();
-          prev->setNext(next);
-          return;
-        }
-        prev = curr;
-        curr = curr->next();
+    start = std::chrono::steady_clock::now();
+    size_t i = 0;
+    for (auto c = l->begin(); c.valid(); c.advance()) {
+      if (++i % 8 == 0) {
+        c = l->insertAfter(c, -1);
       }
-      delete n;
     }
+    reportTiming(name, "insert after cursor", secondsSince(start), size / 8);
+
+    start = std::chrono::steady_clock::now();
+    delete l;
+    reportTiming(name, "teardown", secondsSince(start), size + size / 8);
   }
+  // Both traversals must have seen the same values.
+  return sum == 0 ? 0 : 1;
+}
 
-  void insertBefore(SinglyLinkedListNode* before, SinglyLinkedListNode* newNode) {
-    // This is a safety as the logic will delete whatever comes after...
-    assert(!newNode->next());
+size_t peakRssKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
 
-    if (head() == before) {
-      m_head.release();
-      newNode->setNext(before);
-      m_head.reset(newNode);
-      return;
+// 50/50 insert/remove at the head of a list primed with |live| elements.
+template<typename Allocator>
+void churn(const char* name, size_t ops, size_t live) {
+  SinglyLinkedList<int, Allocator> l;
+  for (size_t i = 0; i < live; ++i) {
+    l.insertBefore(l.head(), i);
+  }
+  std::mt19937 rng(42);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < ops; ++i) {
+    if (!l.head() || (rng() & 1)) {
+      l.insertBefore(l.head(), i);
+    } else {
+      l.remove(l.head());
     }
+  }
+  double seconds = secondsSince(start);
+  std::cout << "  " << name << ": " << (ops / seconds / 1e6) << " M allocs+frees/s"
+            << ", peak RSS=" << peakRssKb() << " KiB" << std::endl;
+}
 
-    SinglyLinkedListNode* prev = head();
-    SinglyLinkedListNode* curr = prev->next();
-    while (curr) {
-      if (curr == before) {
-        SinglyLinkedListNode* next = prev->releaseNext();
-        prev->setNext(newNode);
-        newNode->setNext(next);
-        return;
+// Each allocator runs in its own process so that peak RSS isn't shared.
+int benchChurn(size_t ops) {
+  const size_t live = 1000000;
+  std::cout << "Churn: " << ops << " ops over " << live << " live nodes" << std::endl;
+  for (int variant = 0; variant < 2; ++variant) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      if (variant == 0) {
+        churn<std::allocator<int>>("std::allocator", ops, live);
+      } else {
+        churn<NodePoolAllocator<int>>("NodePoolAllocator", ops, live);
       }
-      prev = curr;
-      curr = curr->next();
+      std::cout.flush();
+      _exit(0);
     }
-    // Probably a bug if we didn't find |before|.
-    assert(false);
+    waitpid(pid, nullptr, 0);
   }
+  return 0;
+}
 
-private:
-  std::unique_ptr<SinglyLinkedListNode> m_head;
-};
-
-std::ostream& operator<<(std::ostream& o, const SinglyLinkedList& l) {
-  const SinglyLinkedListNode* head = l.head();
-  o << "{";
-  const SinglyLinkedListNode* curr = head;
-  while (curr) {
-    if (curr != head) {
-      o << " -> ";
-    }
-    o << curr->value(); 
-    curr = curr->next();
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "bench") {
+    return bench(argc > 2 ? std::stoull(argv[2]) : 10000000);
+  }
+  if (argc > 1 && std::string(argv[1]) == "churn") {
+    return benchChurn(argc > 2 ? std::stoull(argv[2]) : 20000000);
   }
-  o << "}";
-  return o;
-}
 
-int main() {
-  SinglyLinkedList l;
+  SinglyLinkedList<int> l;
   std::cout << "Empty linked list: " << l << std::endl;
-  SinglyLinkedListNode* first = new SinglyLinkedListNode(10);
-  l.append(first);
+  SinglyLinkedListNode<int>* first = l.append(10);
   std::cout << "After adding 10 to list: " << l << std::endl;
-  SinglyLinkedListNode* second = new SinglyLinkedListNode(50);
-  l.append(second);
+  SinglyLinkedListNode<int>* second = l.append(50);
   std::cout << "After adding 50 to list: " << l << std::endl;
-  l.insertBefore(second, new SinglyLinkedListNode(25));
+  l.insertBefore(second, 25);
   std::cout << "After inserting 25 to list: " << l << std::endl;
-  l.insertBefore(first, new SinglyLinkedListNode(5));
+  l.insertBefore(first, 5);
   std::cout << "After inserting 5 to list: " << l << std::endl;
   l.remove(first);
   first = nullptr;
@@ -158,5 +168,52 @@ int main() {
   l.remove(l.head());
   std::cout << "After removing head to list: " << l << std::endl;
 
+  UnrolledSinglyLinkedList<int> u;
+  std::cout << "Empty unrolled list: " << u << std::endl;
+  for (int i = 0; i < 20; ++i) {
+    u.append(i);
+  }
+  std::cout << "After appending 0..19 to unrolled list: " << u << std::endl;
+  UnrolledSinglyLinkedList<int>::Cursor c = u.begin();
+  c.advance();
+  c = u.insertAfter(c, 100);
+  std::cout << "After inserting 100 after 1: " << u << std::endl;
+  u.remove(c);
+  std::cout << "After removing 100: " << u << std::endl;
+  u.prepend(-1);
+  std::cout << "After prepending -1: " << u << ", size: " << u.size() << std::endl;
+
+  // Values that own memory are moved around, not copied bytewise.
+  UnrolledSinglyLinkedList<std::string> strings;
+  for (int i = 0; i < 10; ++i) {
+    strings.append(std::string(i + 1, 'a' + i) + " long enough not to fit inline");
+  }
+  auto sc = strings.begin();
+  sc.advance();
+  strings.insertAfter(sc, "inserted");
+  strings.prepend("first");
+  strings.remove(strings.begin());
+  std::string joined;
+  for (auto c = strings.begin(); c.valid(); c.advance()) {
+    joined += c.value().substr(0, 2);
+  }
+  std::cout << "Unrolled list of strings: " << joined << ", size: " << strings.size() << std::endl;
+  assert(joined == "a bbinccddeeffgghhiijj" && strings.size() == 11);
+
+  // Every node goes through the list's allocator, and back.
+  AllocationStats stats;
+  {
+    SinglyLinkedList<int, CountingAllocator<int>> counted{CountingAllocator<int>(stats)};
+    UnrolledSinglyLinkedList<int, CountingAllocator<int>> unrolled{CountingAllocator<int>(stats)};
+    for (int i = 0; i < 100; ++i) {
+      counted.insertBefore(counted.head(), i);
+      unrolled.append(i);
+    }
+    counted.remove(counted.head());
+    std::cout << "Counted lists of 99 and 100 elements: " << stats << std::endl;
+    assert(stats.allocations() == 100 + (100 + 12) / 13);
+  }
+  assert(stats.liveBytes() == 0);
+
   return 0;
 }
@@ -0,0 +1,388 @@
+// SinglyLinkedList and UnrolledSinglyLinkedList, see singly_linked_list.cc for a
+// demo and benchmarks.
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+
+#include "../memory/allocators.h"
+#include "node_pool.h"
+
+// Singly linked list implementation.
+
+template<typename T, typename Allocator = NodePoolAllocator<T>>
+class SinglyLinkedList;
+
+template<typename T>
+class SinglyLinkedListNode {
+public:
+  SinglyLinkedListNode(T value) : m_value(value), m_next(nullptr) {}
+
+  // Make non-copiable for now.
+  SinglyLinkedListNode(const SinglyLinkedListNode&) = delete;
+  void operator=(const SinglyLinkedListNode&) = delete;
+
+  const SinglyLinkedListNode* next() const { return m_next; }
+  SinglyLinkedListNode* next() { return m_next; }
+
+  const T& value() const { return m_value; }
+
+private:
+  template<typename, typename> friend class SinglyLinkedList;
+
+  T m_value;
+  SinglyLinkedListNode* m_next;
+};
+
+// The list owns its nodes: they are created from values and destroyed by the
+// list through |Allocator|, rebound to the node type. The default allocator
+// hands them out of a thread-local NodePool.
+template<typename T, typename Allocator>
+class SinglyLinkedList {
+  using Node = SinglyLinkedListNode<T>;
+  using NodeAllocator = RebindAlloc<Allocator, Node>;
+  using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+public:
+  explicit SinglyLinkedList(const Allocator& alloc = Allocator()) : m_alloc(alloc), m_head(nullptr) {}
+
+  ~SinglyLinkedList() {
+    // Iterative so that long lists don't overflow the stack.
+    Node* curr = m_head;
+    while (curr) {
+      Node* next = curr->m_next;
+      destroyNode(curr);
+      curr = next;
+    }
+  }
+
+  // Make non-copiable for now.
+  SinglyLinkedList(const SinglyLinkedList&) = delete;
+  void operator=(const SinglyLinkedList&) = delete;
+
+  const Node* head() const { return m_head; }
+  Node* head() { return m_head; }
+
+  Node* append(T value) {
+    Node* n = newNode(std::move(value));
+    if (!m_head) {
+      m_head = n;
+    } else {
+      Node* curr = m_head;
+      while (curr->m_next) {
+        curr = curr->m_next;
+      }
+      curr->m_next = n;
+    }
+    return n;
+  }
+
+  // O(1), unlike insertBefore() which has to find the previous node.
+  Node* insertAfter(Node* after, T value) {
+    Node* n = newNode(std::move(value));
+    n->m_next = after->m_next;
+    after->m_next = n;
+    return n;
+  }
+
+  // |before| may be head(), including a null head() to start an empty list.
+  Node* insertBefore(Node* before, T value) {
+    if (m_head == before) {
+      Node* n = newNode(std::move(value));
+      n->m_next = m_head;
+      m_head = n;
+      return n;
+    }
+
+    Node* prev = m_head;
+    while (prev && prev->m_next != before) {
+      prev = prev->m_next;
+    }
+    // Probably a bug if we didn't find |before|.
+    assert(prev);
+    if (!prev) {
+      return nullptr;
+    }
+    return insertAfter(prev, std::move(value));
+  }
+
+  // Unlinks and destroys |n|.
+  void remove(Node* n) {
+    if (!m_head) {
+      // We should never hit this as we don't have any pointer to remove.
+      assert(false);
+      return;
+    }
+
+    if (m_head == n) {
+      m_head = n->m_next;
+      destroyNode(n);
+      return;
+    }
+
+    Node* prev = m_head;
+    while (prev->m_next && prev->m_next != n) {
+      prev = prev->m_next;
+    }
+    // |n| belongs to another list.
+    assert(prev->m_next == n);
+    if (prev->m_next == n) {
+      prev->m_next = n->m_next;
+      destroyNode(n);
+    }
+  }
+
+private:
+  Node* newNode(T&& value) {
+    Node* n = NodeTraits::allocate(m_alloc, 1);
+    NodeTraits::construct(m_alloc, n, std::move(value));
+    return n;
+  }
+
+  void destroyNode(Node* n) {
+    NodeTraits::destroy(m_alloc, n);
+    NodeTraits::deallocate(m_alloc, n, 1);
+  }
+
+  NodeAllocator m_alloc;
+  Node* m_head;
+};
+
+template<typename T, typename Allocator>
+std::ostream& operator<<(std::ostream& o, const SinglyLinkedList<T, Allocator>& l) {
+  const SinglyLinkedListNode<T>* head = l.head();
+  o << "{";
+  const SinglyLinkedListNode<T>* curr = head;
+  while (curr) {
+    if (curr != head) {
+      o << " -> ";
+    }
+    o << curr->value(); 
+    curr = curr->next();
+  }
+  o << "}";
+  return o;
+}
+
+// Unrolled singly linked list: every node packs up to kNodeCapacity values in
+// a cache line so traversals touch one line per kNodeCapacity elements instead
+// of one per element. Values too big for that get nodes of 2, spanning as many
+// lines as needed, as splitting a node has to leave room in both halves. T
+// must be default constructible: nodes hold kNodeCapacity of them. Nodes come from |Allocator| rebound to the node
+// type, which has to honor its cache line alignment.
+template<typename T, typename Allocator = std::allocator<T>>
+class UnrolledSinglyLinkedList {
+  static constexpr size_t kCacheLineSize = 64;
+  static constexpr size_t kHeaderSize = (sizeof(void*) + sizeof(int) + alignof(T) - 1) / alignof(T) * alignof(T);
+  static constexpr int kNodeCapacity =
+    kHeaderSize + 2 * sizeof(T) <= kCacheLineSize ? (kCacheLineSize - kHeaderSize) / sizeof(T) : 2;
+
+  struct alignas(kCacheLineSize) Node {
+    Node* next;
+    int count;
+    T values[kNodeCapacity];
+  };
+  static_assert(sizeof(Node) == kCacheLineSize || kNodeCapacity == 2, "Node should fill exactly one cache line");
+
+  using NodeAllocator = RebindAlloc<Allocator, Node>;
+  using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+public:
+  // Points at one element of the list. Cursors are invalidated by any insertion
+  // or removal in the same node.
+  class Cursor {
+  public:
+    Cursor() : m_node(nullptr), m_idx(0) {}
+
+    bool valid() const { return m_node != nullptr; }
+    const T& value() const { assert(valid()); return m_node->values[m_idx]; }
+
+    void advance() {
+      assert(valid());
+      if (++m_idx < m_node->count) {
+        return;
+      }
+      m_node = m_node->next;
+      m_idx = 0;
+      skipEmpty();
+    }
+
+    bool operator==(const Cursor& o) const { return m_node == o.m_node && m_idx == o.m_idx; }
+    bool operator!=(const Cursor& o) const { return !(*this == o); }
+
+  private:
+    Cursor(Node* node, int idx) : m_node(node), m_idx(idx) { skipEmpty(); }
+
+    void skipEmpty() {
+      while (m_node && m_node->count == 0) {
+        m_node = m_node->next;
+      }
+    }
+
+    Node* m_node;
+    int m_idx;
+
+    friend class UnrolledSinglyLinkedList;
+  };
+
+  explicit UnrolledSinglyLinkedList(const Allocator& alloc = Allocator())
+    : m_alloc(alloc), m_head(nullptr), m_tail(nullptr), m_size(0) {}
+
+  ~UnrolledSinglyLinkedList() {
+    // Iterative so that long lists don't overflow the stack.
+    Node* curr = m_head;
+    while (curr) {
+      Node* next = curr->next;
+      destroyNode(curr);
+      curr = next;
+    }
+  }
+
+  // Make non-copiable for now.
+  UnrolledSinglyLinkedList(const UnrolledSinglyLinkedList&) = delete;
+  void operator=(const UnrolledSinglyLinkedList&) = delete;
+
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+
+  Cursor begin() const { return Cursor(m_head, 0); }
+
+  // O(1): the tail node is always at hand.
+  Cursor append(T value) {
+    if (!m_tail || m_tail->count == kNodeCapacity) {
+      Node* n = newNode();
+      if (m_tail) {
+        m_tail->next = n;
+      } else {
+        m_head = n;
+      }
+      m_tail = n;
+    }
+    m_tail->values[m_tail->count++] = std::move(value);
+    m_size++;
+    return Cursor(m_tail, m_tail->count - 1);
+  }
+
+  Cursor prepend(T value) {
+    if (!m_head || m_head->count == kNodeCapacity) {
+      Node* n = newNode();
+      n->next = m_head;
+      m_head = n;
+      if (!m_tail) {
+        m_tail = n;
+      }
+    }
+    shiftRight(m_head, 0);
+    m_head->values[0] = std::move(value);
+    m_size++;
+    return Cursor(m_head, 0);
+  }
+
+  // Inserts |value| right after |c| and returns a cursor to it. This is O(1)
+  // as we move at most kNodeCapacity values, splitting the node if full.
+  Cursor insertAfter(Cursor c, T value) {
+    assert(c.valid());
+    Node* n = c.m_node;
+    int idx = c.m_idx + 1;
+    if (n->count == kNodeCapacity) {
+      Node* split = splitNode(n);
+      if (idx > n->count) {
+        idx -= n->count;
+        n = split;
+      }
+    }
+    shiftRight(n, idx);
+    n->values[idx] = std::move(value);
+    m_size++;
+    return Cursor(n, idx);
+  }
+
+  // Removes the element at |c|. Returns a cursor to the next element.
+  Cursor remove(Cursor c) {
+    assert(c.valid());
+    Node* n = c.m_node;
+    std::move(&n->values[c.m_idx + 1], &n->values[n->count], &n->values[c.m_idx]);
+    // Releases whatever the last value owns.
+    n->values[--n->count] = T{};
+    m_size--;
+    // Merge the next node in whenever both fit in one, so that removals don't
+    // leave a trail of nearly empty nodes behind.
+    Node* next = n->next;
+    if (next && n->count + next->count <= kNodeCapacity) {
+      std::move(next->values, next->values + next->count, &n->values[n->count]);
+      n->count += next->count;
+      n->next = next->next;
+      if (m_tail == next) {
+        m_tail = n;
+      }
+      destroyNode(next);
+    }
+    // An empty node without a successor can only be left if it's the tail, in
+    // which case Cursor skips it.
+    if (c.m_idx < n->count) {
+      return Cursor(n, c.m_idx);
+    }
+    return Cursor(n->next, 0);
+  }
+
+  void dump(std::ostream& o) const {
+    o << "{";
+    for (Cursor c = begin(); c.valid(); c.advance()) {
+      if (c != begin()) {
+        o << " -> ";
+      }
+      o << c.value();
+    }
+    o << "}";
+  }
+
+private:
+  Node* newNode() {
+    Node* n = NodeTraits::allocate(m_alloc, 1);
+    NodeTraits::construct(m_alloc, n);
+    n->next = nullptr;
+    n->count = 0;
+    return n;
+  }
+
+  void destroyNode(Node* n) {
+    NodeTraits::destroy(m_alloc, n);
+    NodeTraits::deallocate(m_alloc, n, 1);
+  }
+
+  static void shiftRight(Node* n, int idx) {
+    assert(n->count < kNodeCapacity);
+    std::move_backward(&n->values[idx], &n->values[n->count], &n->values[n->count + 1]);
+    n->count++;
+  }
+
+  // Moves the upper half of |n| to a new node linked after it.
+  Node* splitNode(Node* n) {
+    Node* split = newNode();
+    int half = n->count / 2;
+    split->count = n->count - half;
+    std::move(&n->values[half], &n->values[n->count], split->values);
+    std::fill(&n->values[half], &n->values[n->count], T{});
+    n->count = half;
+    split->next = n->next;
+    n->next = split;
+    if (m_tail == n) {
+      m_tail = split;
+    }
+    return split;
+  }
+
+  NodeAllocator m_alloc;
+  Node* m_head;
+  Node* m_tail;
+  size_t m_size;
+};
+
+template<typename T, typename Allocator>
+std::ostream& operator<<(std::ostream& o, const UnrolledSinglyLinkedList<T, Allocator>& l) {
+  l.dump(o);
+  return o;
+}
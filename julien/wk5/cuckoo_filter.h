@@ -0,0 +1,153 @@
+// CuckooFilter, the optional prefilter of HashSet, see hash_set.cc for a demo.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Filter policy that lets every lookup through to the buckets.
+struct NoHashFilter {
+  explicit NoHashFilter(size_t) {}
+
+  bool insert(uint64_t) { return true; }
+  bool mayContain(uint64_t) const { return true; }
+  bool erase(uint64_t) { return true; }
+  size_t capacity() const { return 0; }
+  size_t bytes() const { return 0; }
+};
+
+// Approximate membership over 64 bit hashes: mayContain() is never wrong for
+// an inserted hash and wrong for about 8 in 2^16 others. Unlike a Bloom filter
+// it supports erase(), as long as only inserted hashes are erased.
+//
+// Every hash is reduced to a 16 bit fingerprint stored in one of two buckets
+// of 4 slots, the second bucket being derivable from the first and the
+// fingerprint alone so that fingerprints can be kicked between them. A bucket
+// is a single 64 bit word which is searched with SWAR instead of a loop, so a
+// lookup is two loads from an array of about 2 bytes per element, small
+// enough to stay in cache when the set itself doesn't.
+class CuckooFilter {
+  static constexpr size_t kSlots = 4;
+  static constexpr double kMaxLoad = 0.9;
+  static constexpr int kMaxKicks = 500;
+  static constexpr uint64_t kLaneLow = 0x0001000100010001ull;
+  static constexpr uint64_t kLaneHigh = 0x8000800080008000ull;
+
+public:
+  explicit CuckooFilter(size_t capacity) : m_size(0), m_kickState(0x2545f4914f6cdd1dull) {
+    size_t buckets = 1;
+    while (buckets * kSlots * kMaxLoad < capacity) {
+      buckets *= 2;
+    }
+    m_buckets.assign(buckets, 0);
+    m_mask = buckets - 1;
+  }
+
+  // Returns false when the filter is too full to take |hash|. It must then be
+  // rebuilt bigger as one of its fingerprints may have been dropped.
+  bool insert(uint64_t hash) {
+    uint16_t fp = fingerprint(hash);
+    size_t idx = index(hash);
+    if (put(idx, fp) || put(altIndex(idx, fp), fp)) {
+      m_size++;
+      return true;
+    }
+
+    // Both buckets are full, evict random fingerprints to their other bucket.
+    if (m_kickState & 1) {
+      idx = altIndex(idx, fp);
+    }
+    for (int kick = 0; kick < kMaxKicks; ++kick) {
+      m_kickState ^= m_kickState << 13;
+      m_kickState ^= m_kickState >> 7;
+      m_kickState ^= m_kickState << 17;
+      size_t lane = m_kickState % kSlots;
+      uint16_t evicted = slot(idx, lane);
+      setSlot(idx, lane, fp);
+      fp = evicted;
+      idx = altIndex(idx, fp);
+      if (put(idx, fp)) {
+        m_size++;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool mayContain(uint64_t hash) const {
+    uint16_t fp = fingerprint(hash);
+    size_t idx = index(hash);
+    // Both buckets are tested without branching in between, a miss has to
+    // look at both anyway.
+    return hasLane(m_buckets[idx], fp) | hasLane(m_buckets[altIndex(idx, fp)], fp);
+  }
+
+  bool erase(uint64_t hash) {
+    uint16_t fp = fingerprint(hash);
+    size_t idx = index(hash);
+    for (size_t b : {idx, altIndex(idx, fp)}) {
+      int lane = findLane(m_buckets[b], fp);
+      if (lane >= 0) {
+        setSlot(b, lane, 0);
+        m_size--;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  size_t size() const { return m_size; }
+  size_t capacity() const { return m_buckets.size() * kSlots; }
+  size_t bytes() const { return m_buckets.size() * sizeof(uint64_t); }
+
+private:
+  // The fingerprint and the index come from disjoint bits of a remix of the
+  // hash, the containers already use its low bits for their own buckets. 0
+  // marks an empty slot.
+  static uint64_t remix(uint64_t hash) { return hash * 0x9e3779b97f4a7c15ull; }
+
+  static uint16_t fingerprint(uint64_t hash) {
+    uint16_t fp = remix(hash) >> 48;
+    return fp ? fp : 1;
+  }
+
+  size_t index(uint64_t hash) const { return (remix(hash) >> 16) & m_mask; }
+
+  // An involution, so that either bucket leads to the other.
+  size_t altIndex(size_t idx, uint16_t fp) const { return (idx ^ (fp * 0x5bd1e995ull)) & m_mask; }
+
+  // Lowest 16 bit lane of |word| equal to |fp|, or -1. The classic zero lane
+  // test may flag lanes above a real match because of the borrow, but never
+  // below one.
+  static int findLane(uint64_t word, uint16_t fp) {
+    uint64_t x = word ^ (fp * kLaneLow);
+    uint64_t zeros = (x - kLaneLow) & ~x & kLaneHigh;
+    return zeros ? __builtin_ctzll(zeros) / 16 : -1;
+  }
+
+  static bool hasLane(uint64_t word, uint16_t fp) {
+    uint64_t x = word ^ (fp * kLaneLow);
+    return (x - kLaneLow) & ~x & kLaneHigh;
+  }
+
+  bool put(size_t idx, uint16_t fp) {
+    int lane = findLane(m_buckets[idx], 0);
+    if (lane < 0) {
+      return false;
+    }
+    setSlot(idx, lane, fp);
+    return true;
+  }
+
+  uint16_t slot(size_t idx, size_t lane) const { return m_buckets[idx] >> (16 * lane); }
+
+  void setSlot(size_t idx, size_t lane, uint16_t fp) {
+    uint64_t shift = 16 * lane;
+    m_buckets[idx] = (m_buckets[idx] & ~(uint64_t(0xffff) << shift)) | (uint64_t(fp) << shift);
+  }
+
+  std::vector<uint64_t> m_buckets;
+  size_t m_mask;
+  size_t m_size;
+  uint64_t m_kickState;
+};
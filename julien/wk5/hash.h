@@ -0,0 +1,17 @@
+// Hash mixing shared by the hash containers.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// fasthash assumes a 64 bit integer for its bit shifting so we automatically promote our arg.
+inline size_t mix_fasthash(uint64_t h) {
+    h ^= h >> 23;
+    h *= 0x2127599bf4325c37ULL;
+    h ^= h >> 47;
+    // Truncate the 64 bits to 32 bits if size_t is 32 bits.
+    if (sizeof(size_t) == 4) {
+      h = (h - (h >> 32)) & ((1LL>>32) - 1);
+    }
+    return h;
+}
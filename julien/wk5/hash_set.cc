@@ -1,123 +1,138 @@
 // Build using:
-//   g++ -Wall -Werror --sanitize=address -g -o hash_set hash_set.cc && ./hash_set
+//   g++ -Wall -Werror --sanitize=address -g -pthread -o hash_set hash_set.cc && ./hash_set
+// Benchmark memory and speed on sequential, random and adversarial keys using:
+//   g++ -Wall -Werror -O2 -DNDEBUG -pthread -o hash_set hash_set.cc && ./hash_set memory [count]
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <iostream>
 #include <numeric>
+#include <random>
+#include <string>
+#include <thread>
 #include <vector>
 
-// fasthash assumes a 64 bit integer for its bit shifting so we automatically promote our arg.
-inline size_t mix_fasthash(uint64_t h) {
-    h ^= h >> 23;
-    h *= 0x2127599bf4325c37ULL;
-    h ^= h >> 47;
-    // Truncate the 64 bits to 32 bits if size_t is 32 bits.
-    if (sizeof(size_t) == 4) {
-      h = (h - (h >> 32)) & ((1LL>>32) - 1);
-    }
-    return h;
-}
-
-template<typename T>
-class HashSet {
-  // TODO: This won't work for strings.
-  static constexpr T kEmptyBucket = std::numeric_limits<T>::min();
-  static constexpr double kInitialLoadFactor = 0.8;
-  static constexpr int kGrowthMultiplier = 2;
-
-public:
-  HashSet(size_t min_size)
-    : m_size(std::ceil(min_size / kInitialLoadFactor)) {
-      m_buckets = new T[m_size];
-      for (int i = 0; i < m_size; ++i) {
-        m_buckets[i] = kEmptyBucket;
-      }
-    }
+#include "../memory/allocators.h"
+#include "hash_set.h"
 
-  ~HashSet() {
-    delete [] m_buckets;
+// Inverse of mix_fasthash, to pick keys by their hash.
+uint64_t unmix_fasthash(uint64_t h) {
+  h ^= h >> 47;
+  uint64_t inverse = 0x2127599bf4325c37ULL;
+  for (int i = 0; i < 5; ++i) {
+    inverse *= 2 - 0x2127599bf4325c37ULL * inverse;
   }
+  h *= inverse;
+  return h ^ (h >> 23) ^ (h >> 46);
+}
 
-  void set(T value) {
-    assert(value != kEmptyBucket);
-
-    size_t key = mix_fasthash(value);
-    while (m_buckets[key % m_size] != kEmptyBucket) {
-      grow();
-    }
-    m_buckets[key % m_size] = value;
+// |count| keys of each kind. Adversarial keys have hashes equal in their low
+// 24 bits: the direct-mapped HashSet this one replaced had to grow to more
+// than 2^24 buckets to tell any two of them apart.
+std::vector<std::pair<std::string, std::vector<int64_t>>> keySets(size_t count) {
+  std::mt19937_64 rng(11);
+  std::vector<int64_t> sequential, random, adversarial;
+  for (size_t i = 0; i < count; ++i) {
+    sequential.push_back(i + 1);
+    random.push_back(rng() >> 1);
+    adversarial.push_back(unmix_fasthash((rng() << 24) | 0xc0ffee));
   }
+  return {{"sequential", sequential}, {"random", random}, {"adversarial", adversarial}};
+}
 
-  bool contains(T value) const {
-    assert(value != kEmptyBucket);
+using CountedSet = HashSet<int64_t, HashStats, CountingAllocator<int64_t>>;
 
-    size_t key = mix_fasthash(value);
-    T t = m_buckets[key % m_size];
-    return t != kEmptyBucket && t == value;
-  }
-
-  void remove(T value) {
-    assert(value != kEmptyBucket);
+// Memory is whatever the allocator has live, against the values it holds.
+double bytesPerPayload(const AllocationStats& stats, const CountedSet& s) {
+  return double(stats.liveBytes()) / (s.size() * sizeof(int64_t));
+}
 
-    size_t key = mix_fasthash(value);
-    key %= m_size;
-    // TODO: Do defensive programming and do a bucket rather than assert?
-    assert(m_buckets[key] == value);
-    m_buckets[key] = kEmptyBucket;
+void testBoundedMemory() {
+  for (const auto& [name, keys] : keySets(20000)) {
+    AllocationStats stats;
+    CountedSet s(1, CountingAllocator<int64_t>(stats));
+    for (int64_t k : keys) {
+      s.set(k);
+      assert(bytesPerPayload(stats, s) <= 2 || s.capacity() == 16);
+    }
+    for (int64_t k : keys) {
+      assert(s.contains(k));
+      (void)k;
+    }
+    s.set(keys[0]);
+    assert(s.size() == keys.size());
+    // Every other key, and each of them twice.
+    for (size_t i = 0; i < keys.size(); i += 2) {
+      s.remove(keys[i]);
+      s.remove(keys[i]);
+      assert(bytesPerPayload(stats, s) <= 2 || s.capacity() == 16);
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+      assert(s.contains(keys[i]) == (i % 2 == 1));
+    }
+    size_t buckets = s.capacity();
+    for (size_t i = 1; i < keys.size(); i += 2) {
+      s.remove(keys[i]);
+      assert(bytesPerPayload(stats, s) <= 2 || s.capacity() == 16);
+    }
+    HashStatsSnapshot snapshot = s.stats();
+    std::cout << "HashSet of " << keys.size() << " " << name << " keys: " << buckets << " buckets after removing half, "
+              << s.capacity() << " once empty, max displacement " << snapshot.maxDisplacement << ", "
+              << snapshot.grows << " rehashes" << std::endl;
+    assert(s.size() == 0 && s.capacity() == 16);
+    (void)buckets;
   }
+}
 
-  void dump(std::ostream& o) const {
-    o << "[";
-    bool addComma = false;
-    for (int i = 0; i < m_size; ++i) {
-      if (m_buckets[i] != kEmptyBucket) {
-        if (addComma) {
-          o << ", ";
-        }
-        o << m_buckets[i];
-        addComma = true;
+int benchMemory(size_t count) {
+  std::cout << "Inserting, looking up then removing " << count << " keys" << std::endl;
+  for (const auto& [name, keys] : keySets(count)) {
+    AllocationStats stats;
+    CountedSet s(1, CountingAllocator<int64_t>(stats));
+    double worst = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t k : keys) {
+      s.set(k);
+      // Once the set is past its minimum size.
+      if (s.size() >= 16) {
+        worst = std::max(worst, bytesPerPayload(stats, s));
       }
     }
-    o << "]";
-  }
-
-private:
-  void grow() {
-    int new_size = kGrowthMultiplier * m_size;
-    T* new_buckets = new T[new_size];
-    for (int i = 0; i < new_size; ++i) {
-      new_buckets[i] = kEmptyBucket;
+    auto inserted = std::chrono::steady_clock::now();
+    size_t hits = 0;
+    for (int64_t k : keys) {
+      hits += s.contains(k);
     }
-
-    for (int i = 0; i < m_size; ++i) {
-      T value = m_buckets[i];
-      if (value == kEmptyBucket) {
-        continue;
+    auto end = std::chrono::steady_clock::now();
+    HashStatsSnapshot snapshot = s.stats();
+    double loaded = bytesPerPayload(stats, s);
+    double worstRemoving = 0;
+    auto removing = std::chrono::steady_clock::now();
+    for (int64_t k : keys) {
+      s.remove(k);
+      if (s.size() >= 16) {
+        worstRemoving = std::max(worstRemoving, bytesPerPayload(stats, s));
       }
-      size_t key = mix_fasthash(value);
-      key %= new_size;
-      // TODO: Handle collisions during growth (probably through recursion).
-      assert(new_buckets[key] == kEmptyBucket);
-      new_buckets[key] = value;
     }
-
-    delete [] m_buckets;
-    m_buckets = new_buckets;
-    m_size = new_size;
+    auto removed = std::chrono::steady_clock::now();
+    std::cout << "  " << name << ": " << std::chrono::duration<double, std::nano>(inserted - start).count() / count
+              << " ns/set, " << std::chrono::duration<double, std::nano>(end - inserted).count() / count
+              << " ns/contains, " << std::chrono::duration<double, std::nano>(removed - removing).count() / count
+              << " ns/remove, " << double(snapshot.probeSum) / snapshot.lookups << " probes/lookup, "
+              << "memory " << loaded << "x the payload (worst " << worst << "x inserting, " << worstRemoving
+              << "x removing, peak " << double(stats.peakBytes()) / (count * sizeof(int64_t))
+              << "x while rehashing), " << hits << " hits" << std::endl;
   }
-
-  T* m_buckets;
-  int m_size;
-};
-
-template <typename U>
-std::ostream& operator<<(std::ostream& o, const HashSet<U>& b) {
-  b.dump(o);
-  return o;
+  return 0;
 }
 
-int main() {
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "memory") {
+    return benchMemory(argc > 2 ? std::stoull(argv[2]) : 1000000);
+  }
+
   HashSet<int> b(1);
   std::cout << "Empty HashSet: " << b << std::endl;
   b.set(5);
@@ -137,5 +152,81 @@ int main() {
   std::cout << "HashSet contains 10? " << b.contains(10) << std::endl;
   std::cout << "HashSet contains 15? " << b.contains(15) << std::endl;
 
+  HashSet<int, HashStats> s(1);
+  for (int i = 1; i <= 16; ++i) {
+    s.set(i);
+  }
+  for (int i = 1; i <= 32; ++i) {
+    s.contains(i);
+  }
+  s.remove(16);
+  HashStatsSnapshot snapshot = s.stats();
+  assert(snapshot.elements == 16 - 1);
+  assert(snapshot.lookups == 32);
+  std::cout << "Stats after 16 sets, 32 lookups and 1 remove: " << snapshot.elements << " elements in "
+            << snapshot.buckets << " buckets after " << snapshot.grows << " grows" << std::endl;
+  writePrometheus(std::cout, "julien_hash_set", "demo", snapshot);
+
+  static_assert(sizeof(HashSet<int>) == sizeof(HashSet<int, NoHashStats>), "stats are opt-in");
+
+  // Starts with a filter for 1 element so that it has to be rebuilt.
+  HashSet<int, HashStats, std::allocator<int>, CuckooFilter> f(1);
+  for (int i = 1; i <= 500; ++i) {
+    f.set(i * 7);
+  }
+  for (int i = 1; i <= 500; i += 2) {
+    f.remove(i * 7);
+  }
+  size_t present = 0;
+  for (int i = 1; i <= 3500; ++i) {
+    bool expected = i % 7 == 0 && (i / 7) % 2 == 0;
+    assert(f.contains(i) == expected);
+    present += expected;
+  }
+  HashStatsSnapshot filtered = f.stats();
+  // Lookups stopped by the filter probe no bucket, the others a couple each.
+  size_t bucketProbes = filtered.probeSum;
+  std::cout << "Filtered HashSet: " << present << " of 3500 present, " << bucketProbes
+            << " buckets probed by 3500 lookups, filter of " << f.filter().capacity() << " slots in "
+            << f.filter().bytes() << " bytes" << std::endl;
+  assert(f.filter().size() == present);
+  assert(bucketProbes >= present && bucketProbes < 2 * present);
+
+  ConcurrentHashSet<int> c(1);
+  c.insert(5);
+  bool again = c.insert(5);
+  std::cout << "ConcurrentHashSet after inserting 5 twice: " << c << " (second insert added=" << again
+            << ")" << std::endl;
+
+  // Threads insert overlapping ranges into a set sized for 1 element, so that
+  // every grow is migrated while inserts go on. Each value must be reported
+  // added by exactly one thread.
+  constexpr int kThreads = 8;
+  constexpr int kPerThread = 20000;
+  ConcurrentHashSet<int> dedup(1);
+  std::atomic<int> added{0};
+  std::vector<std::thread> workers;
+  for (int t = 0; t < kThreads; ++t) {
+    workers.emplace_back([&, t] {
+      for (int i = 0; i < kPerThread; ++i) {
+        added += dedup.insert(1 + t * kPerThread / 2 + i);
+      }
+    });
+  }
+  for (std::thread& w : workers) {
+    w.join();
+  }
+  int distinct = (kThreads + 1) * kPerThread / 2;
+  for (int i = 1; i <= distinct; ++i) {
+    assert(dedup.contains(i));
+  }
+  assert(!dedup.contains(distinct + 1));
+  std::cout << "ConcurrentHashSet after " << kThreads << " threads inserted " << kThreads * kPerThread
+            << " ids: " << added << " added, size " << dedup.size() << ", " << dedup.capacity()
+            << " buckets (expected " << distinct << " distinct)" << std::endl;
+  assert(added == distinct && dedup.size() == size_t(distinct));
+
+  testBoundedMemory();
+
   return 0;
 }
@@ -0,0 +1,544 @@
+// HashSet, ConcurrentHashSet and MutexHashSet, see hash_set.cc for a demo.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../memory/allocators.h"
+#include "cuckoo_filter.h"
+#include "hash.h"
+#include "hash_stats.h"
+
+// Stats is NoHashStats or HashStats, see hash_stats.h. Filter is NoHashFilter
+// or CuckooFilter, see cuckoo_filter.h: with the latter, lookups of absent
+// values mostly return without touching the buckets.
+//
+// Open addressing with linear probing. remove() shifts the rest of the cluster
+// back instead of leaving a tombstone, so probes only ever cross live values
+// and the load factor alone bounds their length. The table is rehashed to
+// kRehashLoadFactor once over kMaxLoadFactor or under kMinLoadFactor, both
+// ways, so that a few sets and removes around a threshold don't rehash every
+// time: it takes 1.25 to 2 buckets per value, and never less than kMinBuckets.
+template<typename T, typename Stats = NoHashStats, typename Allocator = std::allocator<T>,
+         typename Filter = NoHashFilter>
+class HashSet : private Stats {
+  // TODO: This won't work for strings.
+  static constexpr T kEmptyBucket = std::numeric_limits<T>::min();
+  static constexpr double kMaxLoadFactor = 0.8;
+  static constexpr double kMinLoadFactor = 0.5;
+  static constexpr double kRehashLoadFactor = 0.65;
+  static constexpr size_t kMinBuckets = 16;
+
+public:
+  HashSet(size_t min_size, const Allocator& alloc = Allocator())
+    : m_alloc(alloc), m_size(std::max<size_t>(kMinBuckets, std::ceil(min_size / kMaxLoadFactor))), m_count(0),
+      m_filter(min_size) {
+      m_buckets = newBuckets(m_size);
+    }
+
+  ~HashSet() {
+    deleteArray(m_alloc, m_buckets, m_size);
+  }
+
+  void set(T value) {
+    assert(value != kEmptyBucket);
+
+    size_t key = mix_fasthash(value);
+    size_t i = home(key);
+    for (; m_buckets[i] != kEmptyBucket; i = next(i)) {
+      if (m_buckets[i] == value) {
+        return;
+      }
+    }
+    if (m_count + 1 > kMaxLoadFactor * m_size) {
+      rehash(std::ceil((m_count + 1) / kRehashLoadFactor));
+      place(value, key);
+    } else {
+      m_buckets[i] = value;
+      this->recordDisplacement(distance(home(key), i));
+    }
+    m_count++;
+    this->recordInsert();
+    if (!m_filter.insert(key)) {
+      rebuildFilter();
+    }
+  }
+
+  bool contains(T value) const {
+    assert(value != kEmptyBucket);
+
+    size_t key = mix_fasthash(value);
+    if (!m_filter.mayContain(key)) {
+      this->recordProbe(0);
+      return false;
+    }
+    size_t probes = 1;
+    for (size_t i = home(key); m_buckets[i] != kEmptyBucket; i = next(i), ++probes) {
+      if (m_buckets[i] == value) {
+        this->recordProbe(probes);
+        return true;
+      }
+    }
+    this->recordProbe(probes);
+    return false;
+  }
+
+  // Does nothing if |value| isn't there.
+  void remove(T value) {
+    assert(value != kEmptyBucket);
+
+    size_t key = mix_fasthash(value);
+    size_t hole = home(key);
+    for (; m_buckets[hole] != value; hole = next(hole)) {
+      if (m_buckets[hole] == kEmptyBucket) {
+        return;
+      }
+    }
+
+    // Every value further in the cluster whose home isn't after the hole
+    // moves into it, leaving a hole of its own.
+    for (size_t i = next(hole); m_buckets[i] != kEmptyBucket; i = next(i)) {
+      if (distance(home(mix_fasthash(m_buckets[i])), i) >= distance(hole, i)) {
+        m_buckets[hole] = m_buckets[i];
+        hole = i;
+      }
+    }
+    m_buckets[hole] = kEmptyBucket;
+    m_count--;
+    this->recordRemove();
+    m_filter.erase(key);
+
+    if (m_count < kMinLoadFactor * m_size && m_size > kMinBuckets) {
+      rehash(std::max<size_t>(kMinBuckets, std::ceil(m_count / kRehashLoadFactor)));
+    }
+  }
+
+  size_t size() const { return m_count; }
+  size_t capacity() const { return m_size; }
+
+  HashStatsSnapshot stats() const {
+    return this->snapshot(m_size);
+  }
+
+  void dump(std::ostream& o) const {
+    o << "[";
+    bool addComma = false;
+    for (size_t i = 0; i < m_size; ++i) {
+      if (m_buckets[i] != kEmptyBucket) {
+        if (addComma) {
+          o << ", ";
+        }
+        o << m_buckets[i];
+        addComma = true;
+      }
+    }
+    o << "]";
+  }
+
+  const Filter& filter() const { return m_filter; }
+
+private:
+  // Maps the hash to [0, m_size) with a multiplication by its high bits
+  // rather than a division, which leaves m_size free of being a power of two.
+  size_t home(size_t key) const { return (unsigned __int128)key * m_size >> 64; }
+  size_t next(size_t i) const { return i + 1 == m_size ? 0 : i + 1; }
+  // Buckets from |from| forward to |to|, wrapping around.
+  size_t distance(size_t from, size_t to) const { return to >= from ? to - from : to + m_size - from; }
+
+  T* newBuckets(size_t size) {
+    T* buckets = newArray(m_alloc, size);
+    for (size_t i = 0; i < size; ++i) {
+      buckets[i] = kEmptyBucket;
+    }
+    return buckets;
+  }
+
+  // Puts |value|, known to be absent, in the first empty bucket from its home.
+  void place(T value, size_t key) {
+    size_t i = home(key);
+    while (m_buckets[i] != kEmptyBucket) {
+      i = next(i);
+    }
+    m_buckets[i] = value;
+    this->recordDisplacement(distance(home(key), i));
+  }
+
+  // The filter is keyed by hash, not bucket, so it survives rehash(). It only
+  // needs rebuilding, from the buckets, when it overflows.
+  void rebuildFilter() {
+    size_t capacity = m_filter.capacity();
+    bool full;
+    do {
+      capacity *= 2;
+      m_filter = Filter(capacity);
+      full = false;
+      for (size_t i = 0; i < m_size && !full; ++i) {
+        if (m_buckets[i] != kEmptyBucket) {
+          full = !m_filter.insert(mix_fasthash(m_buckets[i]));
+        }
+      }
+    } while (full);
+  }
+
+  // Grows or shrinks to |new_size| buckets.
+  void rehash(size_t new_size) {
+    GrowTimer<Stats> timer(*this);
+    T* old_buckets = m_buckets;
+    size_t old_size = m_size;
+    m_buckets = newBuckets(new_size);
+    m_size = new_size;
+    for (size_t i = 0; i < old_size; ++i) {
+      if (old_buckets[i] != kEmptyBucket) {
+        place(old_buckets[i], mix_fasthash(old_buckets[i]));
+      }
+    }
+    deleteArray(m_alloc, old_buckets, old_size);
+  }
+
+  Allocator m_alloc;
+  T* m_buckets;
+  size_t m_size;
+  size_t m_count;
+  Filter m_filter;
+};
+
+template <typename U, typename S, typename A, typename F>
+std::ostream& operator<<(std::ostream& o, const HashSet<U, S, A, F>& b) {
+  b.dump(o);
+  return o;
+}
+
+// Insert-only set of integers safe to use from any number of threads, e.g. to
+// deduplicate ids. Neither insert() nor contains() takes a lock: buckets are
+// atomics, open addressed with linear probing, and an insert claims an empty
+// bucket with a CAS.
+//
+// Growing links a table twice as big after the last one, after which every
+// insert first helps migrating a chunk of buckets to it. Migration freezes
+// empty buckets of the old table by CASing them to kMovedBucket, so a bucket
+// is either claimed by an insert, which the migration then copies, or frozen,
+// which sends the insert to the next table. An insert only moves on to the
+// next table after freezing the first empty bucket of its probe sequence, so
+// a value is never added to both. Whoever completes the last chunk of a table
+// unlinks it, and a table may grow again before its own migration is over.
+//
+// Like ConcurrentStack, retired tables are only freed with the set as a stale
+// reader may still be probing them: memory is at most twice the live table.
+// The two smallest values of T are reserved.
+template<typename T>
+class ConcurrentHashSet {
+  static constexpr T kEmptyBucket = std::numeric_limits<T>::min();
+  static constexpr T kMovedBucket = T(kEmptyBucket + 1);
+  static constexpr double kMaxLoadFactor = 0.5;
+  static constexpr size_t kChunk = 1024;
+  static constexpr size_t kStripes = 16;
+  // The size is only summed every kCountPeriod inserts per stripe, or on
+  // every insert while the table is small.
+  static constexpr size_t kCountPeriod = 64;
+
+  enum class Claim { kAdded, kPresent, kMoved, kFull };
+
+  struct alignas(64) Stripe {
+    std::atomic<size_t> count{0};
+  };
+
+  struct Table {
+    explicit Table(size_t capacity)
+      : buckets(new std::atomic<T>[capacity]), mask(capacity - 1), chunks((capacity + kChunk - 1) / kChunk) {
+      for (size_t i = 0; i < capacity; ++i) {
+        buckets[i].store(kEmptyBucket, std::memory_order_relaxed);
+      }
+    }
+
+    size_t capacity() const { return mask + 1; }
+    bool migrated() const { return chunksDone.load(std::memory_order_acquire) == chunks; }
+
+    // Claims the first empty bucket of the probe sequence of |value| unless
+    // the value is found first.
+    Claim claim(T value, size_t hash) {
+      for (size_t i = 0; i < capacity(); ++i) {
+        std::atomic<T>& bucket = buckets[(hash + i) & mask];
+        T t = bucket.load(std::memory_order_acquire);
+        if (t == kEmptyBucket &&
+            bucket.compare_exchange_strong(t, value, std::memory_order_acq_rel, std::memory_order_acquire)) {
+          return Claim::kAdded;
+        }
+        // Either taken all along or by the CAS we just lost.
+        if (t == value) {
+          return Claim::kPresent;
+        }
+        if (t == kMovedBucket) {
+          return Claim::kMoved;
+        }
+      }
+      return Claim::kFull;
+    }
+
+    // Returns true if |value| is in the table. Otherwise freezes the first
+    // empty bucket of its probe sequence so that it never gets added here.
+    //
+    // A value sits before any frozen bucket of its probe sequence: buckets
+    // are only frozen while empty and never become empty again.
+    bool findOrFreeze(T value, size_t hash) {
+      for (size_t i = 0; i < capacity(); ++i) {
+        std::atomic<T>& bucket = buckets[(hash + i) & mask];
+        T t = bucket.load(std::memory_order_acquire);
+        if (t == kEmptyBucket &&
+            bucket.compare_exchange_strong(t, kMovedBucket, std::memory_order_acq_rel, std::memory_order_acquire)) {
+          return false;
+        }
+        if (t == value) {
+          return true;
+        }
+        if (t == kMovedBucket) {
+          return false;
+        }
+      }
+      return false;
+    }
+
+    bool find(T value, size_t hash) const {
+      for (size_t i = 0; i < capacity(); ++i) {
+        T t = buckets[(hash + i) & mask].load(std::memory_order_acquire);
+        if (t == value) {
+          return true;
+        }
+        if (t == kEmptyBucket || t == kMovedBucket) {
+          return false;
+        }
+      }
+      return false;
+    }
+
+    std::unique_ptr<std::atomic<T>[]> buckets;
+    size_t mask;
+    size_t chunks;
+    std::atomic<Table*> next{nullptr};
+    std::atomic<bool> growing{false};
+    // Next chunk to migrate and number of chunks migrated.
+    alignas(64) std::atomic<size_t> cursor{0};
+    alignas(64) std::atomic<size_t> chunksDone{0};
+  };
+
+public:
+  ConcurrentHashSet(size_t min_size) {
+    size_t capacity = 16;
+    while (capacity * kMaxLoadFactor < min_size) {
+      capacity *= 2;
+    }
+    m_first = new Table(capacity);
+    m_table.store(m_first);
+  }
+
+  ~ConcurrentHashSet() {
+    for (Table* t = m_first; t;) {
+      Table* next = t->next.load();
+      delete t;
+      t = next;
+    }
+  }
+
+  // Make non-copiable for now.
+  ConcurrentHashSet(const ConcurrentHashSet&) = delete;
+  void operator=(const ConcurrentHashSet&) = delete;
+
+  // Returns false if |value| was already there, exactly one of concurrent
+  // inserts of the same value returns true.
+  bool insert(T value) {
+    assert(value != kEmptyBucket && value != kMovedBucket);
+
+    Table* t = m_table.load(std::memory_order_acquire);
+    if (!insertInto(t, value, mix_fasthash(value), /*help*/ true)) {
+      return false;
+    }
+    size_t n = m_stripes[stripe()].count.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (n % kCountPeriod == 0 || t->capacity() <= kStripes * kCountPeriod / kMaxLoadFactor) {
+      if (size() > t->capacity() * kMaxLoadFactor) {
+        grow(t);
+      }
+    }
+    return true;
+  }
+
+  bool contains(T value) const {
+    assert(value != kEmptyBucket && value != kMovedBucket);
+
+    size_t hash = mix_fasthash(value);
+    for (Table* t = m_table.load(std::memory_order_acquire); t; t = t->next.load(std::memory_order_acquire)) {
+      if (t->find(value, hash)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Exact once inserts are over.
+  size_t size() const {
+    size_t n = 0;
+    for (const Stripe& s : m_stripes) {
+      n += s.count.load(std::memory_order_relaxed);
+    }
+    return n;
+  }
+
+  // Of the table new values go to.
+  size_t capacity() const { return last(m_table.load(std::memory_order_acquire))->capacity(); }
+
+  // Not thread safe.
+  void dump(std::ostream& o) const {
+    o << "[";
+    bool addComma = false;
+    for (Table* t = m_table.load(); t; t = t->next.load()) {
+      for (size_t i = 0; i < t->capacity(); ++i) {
+        T value = t->buckets[i].load();
+        if (value == kEmptyBucket || value == kMovedBucket || copied(t, value)) {
+          continue;
+        }
+        if (addComma) {
+          o << ", ";
+        }
+        o << value;
+        addComma = true;
+      }
+    }
+    o << "]";
+  }
+
+private:
+  static size_t stripe() {
+    thread_local size_t slot = std::hash<std::thread::id>{}(std::this_thread::get_id()) % kStripes;
+    return slot;
+  }
+
+  // Whether a migration already copied |value| out of |t|.
+  static bool copied(const Table* t, T value) {
+    for (t = t->next.load(); t; t = t->next.load()) {
+      if (t->find(value, mix_fasthash(value))) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static Table* last(Table* t) {
+    while (Table* next = t->next.load(std::memory_order_acquire)) {
+      t = next;
+    }
+    return t;
+  }
+
+  // Returns false if |value| was already in |t| or a table after it. |t| is
+  // updated to the table it went to. Migrations copy through here too, with
+  // |help| unset so that copying a chunk doesn't start another one.
+  bool insertInto(Table*& t, T value, size_t hash, bool help) {
+    for (;;) {
+      if (Table* next = t->next.load(std::memory_order_acquire)) {
+        if (help) {
+          migrateChunk(t, next);
+        }
+        if (t->findOrFreeze(value, hash)) {
+          return false;
+        }
+        t = next;
+        continue;
+      }
+      switch (t->claim(value, hash)) {
+        case Claim::kAdded:
+          return true;
+        case Claim::kPresent:
+          return false;
+        case Claim::kFull:
+          grow(t);
+          break;
+        case Claim::kMoved:
+          // |t| started migrating under our feet.
+          break;
+      }
+    }
+  }
+
+  // Links a table after |t| unless another thread did or is about to. Inserts
+  // go on in |t| meanwhile.
+  void grow(Table* t) {
+    if (t->next.load(std::memory_order_acquire) || t->growing.exchange(true, std::memory_order_acq_rel)) {
+      return;
+    }
+    t->next.store(new Table(2 * t->capacity()), std::memory_order_release);
+  }
+
+  // Copies a chunk of |t| no thread claimed yet, if any, to |next|.
+  void migrateChunk(Table* t, Table* next) {
+    size_t chunk = t->cursor.fetch_add(1, std::memory_order_relaxed);
+    if (chunk >= t->chunks) {
+      return;
+    }
+    size_t end = std::min(t->capacity(), (chunk + 1) * kChunk);
+    for (size_t i = chunk * kChunk; i < end; ++i) {
+      T value = t->buckets[i].load(std::memory_order_acquire);
+      while (value == kEmptyBucket &&
+             !t->buckets[i].compare_exchange_weak(value, kMovedBucket, std::memory_order_acq_rel,
+                                                 std::memory_order_acquire)) {
+      }
+      if (value != kEmptyBucket && value != kMovedBucket) {
+        Table* to = next;
+        insertInto(to, value, mix_fasthash(value), /*help*/ false);
+      }
+    }
+    if (t->chunksDone.fetch_add(1, std::memory_order_acq_rel) + 1 < t->chunks) {
+      return;
+    }
+    // Tables may finish migrating out of order, unlink every migrated one.
+    Table* head = m_table.load(std::memory_order_acquire);
+    while (head->migrated()) {
+      if (m_table.compare_exchange_strong(head, head->next.load(std::memory_order_acquire),
+                                          std::memory_order_acq_rel)) {
+        head = m_table.load(std::memory_order_acquire);
+      }
+    }
+  }
+
+  std::atomic<Table*> m_table;
+  Table* m_first;
+  Stripe m_stripes[kStripes];
+};
+
+template <typename U>
+std::ostream& operator<<(std::ostream& o, const ConcurrentHashSet<U>& b) {
+  b.dump(o);
+  return o;
+}
+
+// HashSet guarded by a mutex, this is the baseline for the benchmark.
+template<typename T>
+class MutexHashSet {
+public:
+  MutexHashSet(size_t min_size) : m_set(min_size) {}
+
+  bool insert(T value) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_set.contains(value)) {
+      return false;
+    }
+    m_set.set(value);
+    return true;
+  }
+
+  bool contains(T value) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_set.contains(value);
+  }
+
+private:
+  std::mutex m_mutex;
+  HashSet<T> m_set;
+};
@@ -0,0 +1,161 @@
+// Opt-in instrumentation for the hash containers.
+//
+// HashSet and HashTable take a Stats policy, NoHashStats by default. Its hooks
+// are empty and, as the containers inherit from it, it takes no space either,
+// so a table without stats compiles to exactly the same code as before. Pass
+// HashStats to record probe lengths, displacement, growth and time spent
+// growing; snapshot() and writePrometheus() read them back.
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+struct HashStatsSnapshot {
+  // Probe lengths are bucketed by powers of two: bucket i counts lookups
+  // which probed at most 2^i buckets (and more than 2^(i-1)), the last bucket
+  // everything longer.
+  static constexpr size_t kProbeBuckets = 8;
+
+  uint64_t lookups = 0;
+  std::array<uint64_t, kProbeBuckets> probeHistogram{};
+  uint64_t probeSum = 0;
+  size_t maxDisplacement = 0;
+  size_t elements = 0;
+  size_t buckets = 0;
+  double loadFactor = 0;
+  uint64_t grows = 0;
+  uint64_t growNanos = 0;
+};
+
+// Policy that records nothing.
+struct NoHashStats {
+  static constexpr bool kEnabled = false;
+
+  void recordProbe(size_t) const {}
+  void recordDisplacement(size_t) const {}
+  void recordInsert() {}
+  void recordRemove() {}
+  void recordGrow(uint64_t) {}
+
+  HashStatsSnapshot snapshot(size_t buckets) const {
+    HashStatsSnapshot s;
+    s.buckets = buckets;
+    return s;
+  }
+};
+
+// Policy that keeps counters inline in the table. Lookups are const on the
+// tables, hence the mutable counters.
+class HashStats {
+public:
+  static constexpr bool kEnabled = true;
+
+  void recordProbe(size_t probes) const {
+    ++m_lookups;
+    m_probeSum += probes;
+    size_t bucket = 0;
+    while (bucket + 1 < HashStatsSnapshot::kProbeBuckets && (size_t(1) << bucket) < probes) {
+      ++bucket;
+    }
+    ++m_probeHistogram[bucket];
+  }
+
+  void recordDisplacement(size_t displacement) const {
+    if (displacement > m_maxDisplacement) {
+      m_maxDisplacement = displacement;
+    }
+  }
+
+  void recordInsert() { ++m_elements; }
+  void recordRemove() { --m_elements; }
+
+  void recordGrow(uint64_t nanos) {
+    ++m_grows;
+    m_growNanos += nanos;
+  }
+
+  HashStatsSnapshot snapshot(size_t buckets) const {
+    HashStatsSnapshot s;
+    s.lookups = m_lookups;
+    s.probeHistogram = m_probeHistogram;
+    s.probeSum = m_probeSum;
+    s.maxDisplacement = m_maxDisplacement;
+    s.elements = m_elements;
+    s.buckets = buckets;
+    s.loadFactor = buckets ? double(m_elements) / buckets : 0;
+    s.grows = m_grows;
+    s.growNanos = m_growNanos;
+    return s;
+  }
+
+private:
+  mutable uint64_t m_lookups = 0;
+  mutable std::array<uint64_t, HashStatsSnapshot::kProbeBuckets> m_probeHistogram{};
+  mutable uint64_t m_probeSum = 0;
+  mutable size_t m_maxDisplacement = 0;
+  size_t m_elements = 0;
+  uint64_t m_grows = 0;
+  uint64_t m_growNanos = 0;
+};
+
+// Times a grow() for |Stats|, reading the clock only when stats are enabled.
+template<typename Stats>
+class GrowTimer {
+public:
+  explicit GrowTimer(Stats& stats) : m_stats(stats) {
+    if constexpr (Stats::kEnabled) {
+      m_start = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~GrowTimer() {
+    if constexpr (Stats::kEnabled) {
+      auto elapsed = std::chrono::steady_clock::now() - m_start;
+      m_stats.recordGrow(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+  }
+
+private:
+  Stats& m_stats;
+  std::chrono::steady_clock::time_point m_start;
+};
+
+// Writes |s| in the Prometheus text exposition format, every metric named
+// |prefix|_* and labelled with table="|table|".
+inline void writePrometheus(std::ostream& o, const std::string& prefix, const std::string& table,
+                            const HashStatsSnapshot& s) {
+  std::string label = "table=\"" + table + "\"";
+  auto gauge = [&](const char* name, const char* help, auto value) {
+    o << "# HELP " << prefix << "_" << name << " " << help << "\n"
+      << "# TYPE " << prefix << "_" << name << " gauge\n"
+      << prefix << "_" << name << "{" << label << "} " << value << "\n";
+  };
+  auto counter = [&](const char* name, const char* help, auto value) {
+    o << "# HELP " << prefix << "_" << name << " " << help << "\n"
+      << "# TYPE " << prefix << "_" << name << " counter\n"
+      << prefix << "_" << name << "{" << label << "} " << value << "\n";
+  };
+
+  o << "# HELP " << prefix << "_probe_length Buckets probed per lookup.\n"
+    << "# TYPE " << prefix << "_probe_length histogram\n";
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i + 1 < s.probeHistogram.size(); ++i) {
+    cumulative += s.probeHistogram[i];
+    o << prefix << "_probe_length_bucket{" << label << ",le=\"" << (size_t(1) << i) << "\"} " << cumulative << "\n";
+  }
+  cumulative += s.probeHistogram.back();
+  o << prefix << "_probe_length_bucket{" << label << ",le=\"+Inf\"} " << cumulative << "\n"
+    << prefix << "_probe_length_sum{" << label << "} " << s.probeSum << "\n"
+    << prefix << "_probe_length_count{" << label << "} " << s.lookups << "\n";
+
+  gauge("max_displacement", "Largest distance between an element and its home bucket.", s.maxDisplacement);
+  gauge("elements", "Elements stored.", s.elements);
+  gauge("buckets", "Buckets allocated.", s.buckets);
+  gauge("load_factor", "Elements per bucket.", s.loadFactor);
+  counter("grows_total", "Rehashes, to grow or shrink.", s.grows);
+  counter("grow_seconds_total", "Time spent rehashing.", s.growNanos / 1e9);
+}
@@ -5,122 +5,49 @@
 #include <cstdint>
 #include <iostream>
 #include <numeric>
+#include <random>
+#include <string>
 #include <vector>
 
-// fasthash assumes a 64 bit integer for its bit shifting so we automatically promote our arg.
-inline size_t mix_fasthash(uint64_t h) {
-    h ^= h >> 23;
-    h *= 0x2127599bf4325c37ULL;
-    h ^= h >> 47;
-    // Truncate the 64 bits to 32 bits if size_t is 32 bits.
-    if (sizeof(size_t) == 4) {
-      h = (h - (h >> 32)) & ((1LL>>32) - 1);
-    }
-    return h;
-}
-
-template<typename T>
-class HashTable {
-  static constexpr double kInitialLoadFactor = 0.8;
-  static constexpr int kGrowthMultiplier = 2;
-
-  struct Entry {
-    size_t key;
-    T val;
-  };
-public:
-  HashTable(size_t min_size)
-    : m_size(std::ceil(min_size / kInitialLoadFactor)) {
-      m_buckets = new Entry*[m_size];
-      for (size_t i = 0; i < m_size; ++i) {
-        m_buckets[i] = nullptr;
+#include "hash_table.h"
+
+// Runs the same random operations on both layouts, with payloads that own
+// memory, and checks they agree at every step.
+void testColumnar(size_t ops, uint64_t seed) {
+  HashTable<std::string, HashStats, std::allocator<std::string>, RowLayout> row(1);
+  HashTable<std::string, HashStats, std::allocator<std::string>, ColumnarLayout> columnar(1);
+  std::mt19937_64 rng(seed);
+  for (size_t i = 0; i < ops; ++i) {
+    size_t k = rng() % 2000;
+    switch (rng() % 3) {
+      case 0: {
+        std::string v(rng() % 40, 'a' + i % 26);
+        row.set(k, v);
+        columnar.set(k, v);
+        break;
       }
-    }
-
-  ~HashTable() {
-    for (size_t i = 0; i < m_size; ++i) {
-      if (m_buckets[i]) {
-        delete m_buckets[i];
+      case 1:
+        row.remove(k);
+        columnar.remove(k);
+        break;
+      default: {
+        std::string* a = row.find(k);
+        std::string* b = columnar.find(k);
+        assert((a == nullptr) == (b == nullptr) && (!a || *a == *b));
+        (void)a;
+        (void)b;
+        break;
       }
     }
-
-    delete [] m_buckets;
-  }
-
-  void set(size_t k, T value) {
-    size_t key = mix_fasthash(k);
-    while (m_buckets[key % m_size] != nullptr) {
-      grow();
-    }
-    m_buckets[key % m_size] = new Entry{k, value};
-  }
-
-  bool contains(size_t k) const {
-    size_t key = mix_fasthash(k);
-    key %= m_size;
-    Entry* e = m_buckets[key % m_size];
-    return e && e->key == k;
-  }
-
-  void remove(size_t k) {
-    size_t key = mix_fasthash(k);
-    key %= m_size;
-    if (m_buckets[key] && m_buckets[key]->key == k) {
-      delete m_buckets[key];
-      m_buckets[key] = nullptr;
-    }
+    assert(row.contains(k) == columnar.contains(k));
   }
-
-  void dump(std::ostream& o) const {
-    o << "[";
-    bool addComma = false;
-    for (size_t i = 0; i < m_size; ++i) {
-      Entry* e = m_buckets[i];
-      if (e) {
-        if (addComma) {
-          o << ", ";
-        }
-        o << e->key << ": " << e->val;
-        addComma = true;
-      }
-    }
-    o << "]";
-  }
-
-private:
-  void grow() {
-    size_t new_size = kGrowthMultiplier * m_size;
-    Entry** new_buckets = new Entry*[new_size];
-    for (size_t i = 0; i < new_size; ++i) {
-      new_buckets[i] = nullptr;
-    }
-
-    for (size_t i = 0; i < m_size; ++i) {
-      Entry* e = m_buckets[i];
-      if (e == nullptr) {
-        continue;
-      }
-      size_t key = mix_fasthash(e->key);
-      key %= new_size;
-      // TODO: Handle collisions during growth (probably through recursion).
-      assert(new_buckets[key] == nullptr);
-      new_buckets[key] = e;
-    }
-
-    delete [] m_buckets;
-    m_buckets = new_buckets;
-    m_size = new_size;
-  }
-
-  // TODO: Use std::unique_ptr.
-  Entry** m_buckets;
-  size_t m_size;
-};
-
-template <typename U>
-std::ostream& operator<<(std::ostream& o, const HashTable<U>& b) {
-  b.dump(o);
-  return o;
+  HashStatsSnapshot a = row.stats();
+  HashStatsSnapshot b = columnar.stats();
+  assert(a.elements == b.elements && a.buckets == b.buckets);
+  assert(!columnar.contains(decltype(columnar)::kEmptyKey));
+  std::cout << "Columnar HashTable matches the row layout after " << ops << " ops: " << b.elements
+            << " elements in " << b.buckets << " buckets" << std::endl;
+  (void)a;
 }
 
 int main() {
@@ -143,5 +70,31 @@ int main() {
   std::cout << "HashSet contains 10? " << b.contains(10) << std::endl;
   std::cout << "HashSet contains 15? " << b.contains(15) << std::endl;
 
+  HashTable<int, HashStats> s(1);
+  for (int i = 1; i <= 16; ++i) {
+    s.set(i, i * 10);
+  }
+  for (int i = 1; i <= 32; ++i) {
+    s.contains(i);
+  }
+  s.remove(16);
+  HashStatsSnapshot snapshot = s.stats();
+  assert(snapshot.elements == 16 - 1);
+  assert(snapshot.lookups == 32);
+  std::cout << "Stats after 16 sets, 32 lookups and 1 remove: " << snapshot.elements << " elements in "
+            << snapshot.buckets << " buckets after " << snapshot.grows << " grows" << std::endl;
+  writePrometheus(std::cout, "julien_hash_table", "demo", snapshot);
+
+  static_assert(sizeof(HashTable<int>) == sizeof(HashTable<int, NoHashStats>), "stats are opt-in");
+
+  // Setting a key again overwrites its value.
+  HashTable<int, NoHashStats, std::allocator<int>, ColumnarLayout> c(1);
+  c.set(5, 1);
+  c.set(5, 2);
+  std::cout << "Columnar HashTable after setting 5 twice: " << c << std::endl;
+  assert(*c.find(5) == 2 && !c.find(6));
+
+  testColumnar(100000, 3);
+
   return 0;
 }
@@ -0,0 +1,289 @@
+// HashTable, see hash_table.cc for a demo.
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "../memory/allocators.h"
+#include "../memory/layout.h"
+#include "hash.h"
+#include "hash_stats.h"
+
+// Stats is NoHashStats or HashStats, see hash_stats.h. Layout is RowLayout or
+// ColumnarLayout, see layout.h and the specialization below.
+template<typename T, typename Stats = NoHashStats, typename Allocator = std::allocator<T>, typename Layout = RowLayout>
+class HashTable : private Stats {
+  static_assert(std::is_same_v<Layout, RowLayout>, "Unknown layout");
+  static constexpr double kInitialLoadFactor = 0.8;
+  static constexpr int kGrowthMultiplier = 2;
+
+  struct Entry {
+    size_t key;
+    T val;
+  };
+  using EntryAllocator = RebindAlloc<Allocator, Entry>;
+  using BucketAllocator = RebindAlloc<Allocator, Entry*>;
+public:
+  HashTable(size_t min_size, const Allocator& alloc = Allocator())
+    : m_entryAlloc(alloc), m_bucketAlloc(alloc), m_size(std::ceil(min_size / kInitialLoadFactor)) {
+      m_buckets = newArray(m_bucketAlloc, m_size);
+      for (size_t i = 0; i < m_size; ++i) {
+        m_buckets[i] = nullptr;
+      }
+    }
+
+  ~HashTable() {
+    for (size_t i = 0; i < m_size; ++i) {
+      if (m_buckets[i]) {
+        deleteArray(m_entryAlloc, m_buckets[i], 1);
+      }
+    }
+
+    deleteArray(m_bucketAlloc, m_buckets, m_size);
+  }
+
+  void set(size_t k, T value) {
+    size_t key = mix_fasthash(k);
+    while (m_buckets[key % m_size] != nullptr && m_buckets[key % m_size]->key != k) {
+      grow();
+    }
+    if (Entry* e = m_buckets[key % m_size]) {
+      e->val = std::move(value);
+      return;
+    }
+    Entry* e = newArray(m_entryAlloc, 1);
+    *e = Entry{k, value};
+    m_buckets[key % m_size] = e;
+    this->recordInsert();
+  }
+
+  bool contains(size_t k) const {
+    size_t key = mix_fasthash(k);
+    key %= m_size;
+    Entry* e = m_buckets[key % m_size];
+    // Direct-mapped, every lookup probes exactly one bucket.
+    this->recordProbe(1);
+    return e && e->key == k;
+  }
+
+  // The value of |k|, or nullptr. Entries are allocated one by one, so the
+  // pointer stays valid until |k| is removed.
+  T* find(size_t k) {
+    Entry* e = m_buckets[mix_fasthash(k) % m_size];
+    this->recordProbe(1);
+    return e && e->key == k ? &e->val : nullptr;
+  }
+
+  void remove(size_t k) {
+    size_t key = mix_fasthash(k);
+    key %= m_size;
+    if (m_buckets[key] && m_buckets[key]->key == k) {
+      deleteArray(m_entryAlloc, m_buckets[key], 1);
+      m_buckets[key] = nullptr;
+      this->recordRemove();
+    }
+  }
+
+  HashStatsSnapshot stats() const {
+    return this->snapshot(m_size);
+  }
+
+  void dump(std::ostream& o) const {
+    o << "[";
+    bool addComma = false;
+    for (size_t i = 0; i < m_size; ++i) {
+      Entry* e = m_buckets[i];
+      if (e) {
+        if (addComma) {
+          o << ", ";
+        }
+        o << e->key << ": " << e->val;
+        addComma = true;
+      }
+    }
+    o << "]";
+  }
+
+private:
+  void grow() {
+    GrowTimer<Stats> timer(*this);
+    size_t new_size = kGrowthMultiplier * m_size;
+    Entry** new_buckets = newArray(m_bucketAlloc, new_size);
+    for (size_t i = 0; i < new_size; ++i) {
+      new_buckets[i] = nullptr;
+    }
+
+    for (size_t i = 0; i < m_size; ++i) {
+      Entry* e = m_buckets[i];
+      if (e == nullptr) {
+        continue;
+      }
+      size_t key = mix_fasthash(e->key);
+      key %= new_size;
+      // Doubling splits every bucket in two, so nothing collides.
+      assert(new_buckets[key] == nullptr);
+      new_buckets[key] = e;
+    }
+
+    deleteArray(m_bucketAlloc, m_buckets, m_size);
+    m_buckets = new_buckets;
+    m_size = new_size;
+  }
+
+  EntryAllocator m_entryAlloc;
+  BucketAllocator m_bucketAlloc;
+  Entry** m_buckets;
+  size_t m_size;
+};
+
+// Keys get a dense array of their own, so that contains() reads a single word
+// per lookup instead of following a pointer to the whole entry. A parallel
+// array maps each bucket to a slot of the payload slab, so growing moves keys
+// and slot indices rather than payloads. The slab is a vector though, and
+// reallocates when set() adds a key past its capacity. The largest key marks
+// empty buckets and cannot be stored.
+template<typename T, typename Stats, typename Allocator>
+class HashTable<T, Stats, Allocator, ColumnarLayout> : private Stats {
+  static constexpr double kInitialLoadFactor = 0.8;
+  static constexpr int kGrowthMultiplier = 2;
+
+  using KeyAllocator = RebindAlloc<Allocator, size_t>;
+  using SlotAllocator = RebindAlloc<Allocator, uint32_t>;
+public:
+  static constexpr size_t kEmptyKey = std::numeric_limits<size_t>::max();
+
+  HashTable(size_t min_size, const Allocator& alloc = Allocator())
+    : m_keyAlloc(alloc), m_slotAlloc(alloc), m_size(std::ceil(min_size / kInitialLoadFactor))
+    , m_payloads(alloc), m_freeSlots(alloc) {
+      m_keys = newArray(m_keyAlloc, m_size);
+      m_slots = newArray(m_slotAlloc, m_size);
+      std::fill(m_keys, m_keys + m_size, kEmptyKey);
+    }
+
+  ~HashTable() {
+    deleteArray(m_keyAlloc, m_keys, m_size);
+    deleteArray(m_slotAlloc, m_slots, m_size);
+  }
+
+  void set(size_t k, T value) {
+    assert(k != kEmptyKey);
+    size_t key = mix_fasthash(k);
+    while (m_keys[key % m_size] != kEmptyKey && m_keys[key % m_size] != k) {
+      grow();
+    }
+    size_t i = key % m_size;
+    if (m_keys[i] == k) {
+      m_payloads[m_slots[i]] = std::move(value);
+      return;
+    }
+    m_keys[i] = k;
+    m_slots[i] = acquireSlot(std::move(value));
+    this->recordInsert();
+  }
+
+  bool contains(size_t k) const {
+    this->recordProbe(1);
+    return k != kEmptyKey && m_keys[mix_fasthash(k) % m_size] == k;
+  }
+
+  // The value of |k|, or nullptr. Only a hit reads the payload slab. Unlike
+  // with the row layout, the pointer is invalidated by any set() of a new key,
+  // which may reallocate the slab, and by remove(k), which frees its slot.
+  T* find(size_t k) {
+    size_t i = mix_fasthash(k) % m_size;
+    this->recordProbe(1);
+    return k != kEmptyKey && m_keys[i] == k ? &m_payloads[m_slots[i]] : nullptr;
+  }
+
+  void remove(size_t k) {
+    size_t i = mix_fasthash(k) % m_size;
+    if (k != kEmptyKey && m_keys[i] == k) {
+      // Releases whatever the payload owns before the slot is reused.
+      m_payloads[m_slots[i]] = T{};
+      m_freeSlots.push_back(m_slots[i]);
+      m_keys[i] = kEmptyKey;
+      this->recordRemove();
+    }
+  }
+
+  HashStatsSnapshot stats() const {
+    return this->snapshot(m_size);
+  }
+
+  void dump(std::ostream& o) const {
+    o << "[";
+    bool addComma = false;
+    for (size_t i = 0; i < m_size; ++i) {
+      if (m_keys[i] != kEmptyKey) {
+        if (addComma) {
+          o << ", ";
+        }
+        o << m_keys[i] << ": " << m_payloads[m_slots[i]];
+        addComma = true;
+      }
+    }
+    o << "]";
+  }
+
+private:
+  uint32_t acquireSlot(T&& value) {
+    if (m_freeSlots.empty()) {
+      assert(m_payloads.size() < std::numeric_limits<uint32_t>::max());
+      m_payloads.push_back(std::move(value));
+      return m_payloads.size() - 1;
+    }
+    uint32_t slot = m_freeSlots.back();
+    m_freeSlots.pop_back();
+    m_payloads[slot] = std::move(value);
+    return slot;
+  }
+
+  void grow() {
+    GrowTimer<Stats> timer(*this);
+    size_t new_size = kGrowthMultiplier * m_size;
+    size_t* new_keys = newArray(m_keyAlloc, new_size);
+    uint32_t* new_slots = newArray(m_slotAlloc, new_size);
+    std::fill(new_keys, new_keys + new_size, kEmptyKey);
+
+    for (size_t i = 0; i < m_size; ++i) {
+      if (m_keys[i] == kEmptyKey) {
+        continue;
+      }
+      size_t key = mix_fasthash(m_keys[i]) % new_size;
+      // Doubling splits every bucket in two, so nothing collides.
+      assert(new_keys[key] == kEmptyKey);
+      new_keys[key] = m_keys[i];
+      new_slots[key] = m_slots[i];
+    }
+
+    deleteArray(m_keyAlloc, m_keys, m_size);
+    deleteArray(m_slotAlloc, m_slots, m_size);
+    m_keys = new_keys;
+    m_slots = new_slots;
+    m_size = new_size;
+  }
+
+  KeyAllocator m_keyAlloc;
+  SlotAllocator m_slotAlloc;
+  // Bucket -> key, or kEmptyKey.
+  size_t* m_keys;
+  // Bucket -> slot in m_payloads, parallel to m_keys. Direct mapping leaves
+  // most buckets empty, so slots are kept narrow.
+  uint32_t* m_slots;
+  size_t m_size;
+  std::vector<T, RebindAlloc<Allocator, T>> m_payloads;
+  std::vector<uint32_t, SlotAllocator> m_freeSlots;
+};
+
+template <typename U, typename S, typename A, typename L>
+std::ostream& operator<<(std::ostream& o, const HashTable<U, S, A, L>& b) {
+  b.dump(o);
+  return o;
+}
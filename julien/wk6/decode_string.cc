@@ -1,9 +1,57 @@
 // Build using:
-//   g++ -Wall -Werror --sanitize=address -g -o decode_string decode_string.cc && ./decode_string
+//   g++ -Wall -Werror --sanitize=address -g -pthread -o decode_string decode_string.cc && ./decode_string
+// Benchmark using:
+//   g++ -Wall -Werror -O2 -DNDEBUG -pthread -o decode_string decode_string.cc && ./decode_string [bench|view] [repeat]
+//   ./decode_string corpus [rounds]
+//   ./decode_string batch [inputs]
+//   ./decode_string tokens [bytes]
+// Add -mavx2 to classify 64 bytes with two AVX2 registers instead of four
+// SSE2 ones.
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
 #include <vector>
 
+// Counts every allocation so that benchmarks can report allocations per call.
+// Kept out of line, otherwise GCC sees free() paired with operator new.
+static std::atomic<size_t> g_allocations{0};
+
+__attribute__((noinline)) void* operator new(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+  std::free(p);
+}
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
 // TODO: Use the STL variant instead of reimplementing them.
 static bool isDigit(char c) {
     return c >= '0' && c <= '9';
@@ -12,6 +60,16 @@ static bool isEnglish(char c) {
     return c >= 'a' && c <= 'z';
 }
 
+// Decoded lengths saturate at this value instead of overflowing.
+static constexpr uint64_t kMaxLength = std::numeric_limits<uint64_t>::max();
+
+static uint64_t saturatingAdd(uint64_t a, uint64_t b) {
+    return a > kMaxLength - b ? kMaxLength : a + b;
+}
+static uint64_t saturatingMul(uint64_t a, uint64_t b) {
+    return b != 0 && a > kMaxLength / b ? kMaxLength : a * b;
+}
+
 // Node is either a string or an int depending on |isRepeat|.
 struct Node {
   bool isRepeat;
@@ -46,8 +104,8 @@ public:
     }
 
     assert(m_backing[lastIdx].isRepeat);
-    std::string res = repeatStr;
-    for (int i = 1; i < m_backing[lastIdx].repeat; ++i) {
+    std::string res;
+    for (int i = 0; i < m_backing[lastIdx].repeat; ++i) {
       res += repeatStr;
     }
     // Overwrite the lastIdx and clear follow-up repeat.
@@ -180,6 +238,898 @@ public:
     }
 };
 
+// Compact repeat tree parsed once from a decodeString input.
+//
+// Nodes are stored in pre-order in a flat array: node 0 is an implicit root
+// repeating the whole input once, the children of a repeat node start right
+// after it and the next sibling of node i is at nodes[i].end. Literals point
+// back into the input instead of copying it.
+class RepeatTree {
+public:
+  struct TreeNode {
+    bool isRepeat;
+    uint64_t repeat;
+    // Literal slice of the input.
+    uint32_t begin;
+    uint32_t length;
+    // One past the last node of this subtree.
+    uint32_t end;
+    // Decoded length of a single repetition of the body (repeat nodes only).
+    uint64_t bodyLength;
+    // Decoded length of the whole node.
+    uint64_t totalLength;
+  };
+
+  // Lengths saturate at this value instead of overflowing.
+  static constexpr uint64_t kMaxLength = ::kMaxLength;
+
+  explicit RepeatTree(std::string_view s) : m_input(s) {
+    m_nodes.push_back(TreeNode{true, 1, 0, 0, 0, 0, 0});
+    std::vector<uint32_t> open{0};
+    size_t idx = 0;
+    while (idx < s.size()) {
+      if (isDigit(s[idx])) {
+        uint64_t repeat = 0;
+        while (isDigit(s[idx])) {
+          repeat = repeat * 10 + (s[idx] - '0');
+          ++idx;
+        }
+        assert(s[idx] == '[');
+        ++idx;
+        open.push_back(m_nodes.size());
+        m_nodes.push_back(TreeNode{true, repeat, 0, 0, 0, 0, 0});
+        continue;
+      }
+      if (isEnglish(s[idx])) {
+        size_t endIdx = idx + 1;
+        while (endIdx < s.size() && isEnglish(s[endIdx])) {
+          ++endIdx;
+        }
+        uint32_t n = m_nodes.size();
+        m_nodes.push_back(TreeNode{false, 0, uint32_t(idx), uint32_t(endIdx - idx), n + 1, 0, endIdx - idx});
+        idx = endIdx;
+        continue;
+      }
+      assert(s[idx] == ']');
+      ++idx;
+      close(open.back());
+      open.pop_back();
+    }
+    assert(open.size() == 1);
+    close(0);
+  }
+
+  const TreeNode& node(uint32_t i) const { return m_nodes[i]; }
+  size_t size() const { return m_nodes.size(); }
+  std::string_view input() const { return m_input; }
+  std::string_view literal(const TreeNode& n) const { return m_input.substr(n.begin, n.length); }
+
+  // Decoded length without expanding anything.
+  uint64_t decodedLength() const { return m_nodes[0].totalLength; }
+
+  // Appends one repetition of the body of repeat node |i|. Recurses at most
+  // the nesting depth, only use it on small bodies.
+  void expandBody(uint32_t i, std::string& out) const {
+    for (uint32_t c = i + 1; c < m_nodes[i].end; c = m_nodes[c].end) {
+      const TreeNode& child = m_nodes[c];
+      // Empty bodies can still nest huge repeats, don't walk them.
+      if (child.totalLength == 0) {
+        continue;
+      }
+      if (!child.isRepeat) {
+        out.append(literal(child));
+        continue;
+      }
+      for (uint64_t r = 0; r < child.repeat; ++r) {
+        expandBody(c, out);
+      }
+    }
+  }
+
+private:
+  void close(uint32_t i) {
+    TreeNode& n = m_nodes[i];
+    n.end = m_nodes.size();
+    uint64_t body = 0;
+    for (uint32_t c = i + 1; c < n.end; c = m_nodes[c].end) {
+      body = saturatingAdd(body, m_nodes[c].totalLength);
+    }
+    n.bodyLength = body;
+    n.totalLength = saturatingMul(n.repeat, body);
+  }
+
+  std::string_view m_input;
+  std::vector<TreeNode> m_nodes;
+};
+
+// Pull-style decoder walking a RepeatTree with an explicit stack, so memory is
+// O(depth) whatever the size of the expansion. read() can be called with any
+// buffer size and resumes where the previous call stopped.
+//
+// Repeats whose body decodes to at most kPatternBytes are expanded once into
+// a pattern buffer holding as many whole repetitions as fit, which is then
+// copied out in large blocks instead of walking the body for every repeat.
+class StreamingDecoder {
+  static constexpr uint64_t kPatternBytes = 4096;
+
+  struct Frame {
+    uint32_t node;
+    // Repetitions left, including the current one.
+    uint64_t remaining;
+    // Next child to visit.
+    uint32_t child;
+  };
+
+public:
+  explicit StreamingDecoder(const RepeatTree& tree)
+    : m_tree(tree)
+    , m_literal()
+    , m_patternNode(0)
+    , m_patternPeriod(0)
+    , m_patternOffset(0)
+    , m_patternRemaining(0) {
+      const RepeatTree::TreeNode& root = tree.node(0);
+      if (root.totalLength > 0) {
+        m_frames.push_back(Frame{0, root.repeat, 1});
+      }
+    }
+
+  bool done() const {
+    return m_frames.empty() && m_literal.empty() && m_patternRemaining == 0;
+  }
+
+  // Fills up to |size| bytes of |buf| and returns how many were written, 0
+  // once everything was decoded.
+  size_t read(char* buf, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+      if (m_patternRemaining > 0) {
+        size_t n = std::min<uint64_t>({size - written, m_patternRemaining, m_patternPeriod - m_patternOffset});
+        std::memcpy(buf + written, m_pattern.data() + m_patternOffset, n);
+        written += n;
+        m_patternRemaining -= n;
+        m_patternOffset = (m_patternOffset + n) % m_patternPeriod;
+        continue;
+      }
+      if (!m_literal.empty()) {
+        size_t n = std::min(size - written, m_literal.size());
+        std::memcpy(buf + written, m_literal.data(), n);
+        written += n;
+        m_literal.remove_prefix(n);
+        continue;
+      }
+      if (!advance()) {
+        break;
+      }
+    }
+    return written;
+  }
+
+  // Streams the whole decoded output to |sink(const char*, size_t)| in chunks
+  // of |chunkSize| bytes.
+  template<typename Sink>
+  void decodeTo(Sink&& sink, size_t chunkSize = 64 * 1024) {
+    std::vector<char> chunk(chunkSize);
+    while (size_t n = read(chunk.data(), chunk.size())) {
+      sink(chunk.data(), n);
+    }
+  }
+
+private:
+  // Moves to the next literal or pattern. Returns false once done.
+  bool advance() {
+    while (!m_frames.empty()) {
+      Frame& f = m_frames.back();
+      const RepeatTree::TreeNode& n = m_tree.node(f.node);
+      if (f.child >= n.end) {
+        if (--f.remaining > 0) {
+          f.child = f.node + 1;
+        } else {
+          m_frames.pop_back();
+        }
+        continue;
+      }
+      uint32_t c = f.child;
+      const RepeatTree::TreeNode& child = m_tree.node(c);
+      f.child = child.end;
+      if (child.totalLength == 0) {
+        continue;
+      }
+      if (!child.isRepeat) {
+        m_literal = m_tree.literal(child);
+        return true;
+      }
+      if (child.bodyLength <= kPatternBytes) {
+        startPattern(c);
+        return true;
+      }
+      m_frames.push_back(Frame{c, child.repeat, c + 1});
+    }
+    return false;
+  }
+
+  void startPattern(uint32_t i) {
+    const RepeatTree::TreeNode& n = m_tree.node(i);
+    // The enclosing repeat usually brings us back to the same node, whose
+    // pattern is still there.
+    if (m_patternNode != i) {
+      m_pattern.clear();
+      m_tree.expandBody(i, m_pattern);
+      uint64_t copies = std::min<uint64_t>(n.repeat, kPatternBytes / n.bodyLength);
+      for (uint64_t r = 1; r < copies; ++r) {
+        m_pattern.append(m_pattern.data(), n.bodyLength);
+      }
+      m_patternNode = i;
+      m_patternPeriod = m_pattern.size();
+    }
+    m_patternOffset = 0;
+    m_patternRemaining = n.totalLength;
+  }
+
+  const RepeatTree& m_tree;
+  std::vector<Frame> m_frames;
+  std::string_view m_literal;
+  std::string m_pattern;
+  // Node 0 is the root, which never uses a pattern.
+  uint32_t m_patternNode;
+  uint64_t m_patternPeriod;
+  uint64_t m_patternOffset;
+  uint64_t m_patternRemaining;
+};
+
+// Decodes with exactly one allocation, the output string.
+//
+// A first pass computes the exact decoded size, then the second one copies
+// literal segments straight from the input and fills each repeat by decoding
+// its body once and doubling it in place with memcpy. Both passes recurse on
+// the call stack, one frame per nesting level, so nothing else is allocated.
+//
+// Lengths saturate at kMaxLength, and decoding anything that long throws
+// std::length_error instead of writing past a wrapped around size.
+class DoublingSolution {
+    static uint64_t parseRepeat(std::string_view s, size_t& idx) {
+        uint64_t repeat = 0;
+        while (isDigit(s[idx])) {
+            repeat = saturatingAdd(saturatingMul(repeat, 10), s[idx] - '0');
+            ++idx;
+        }
+        return repeat;
+    }
+
+    static uint64_t measure(std::string_view s, size_t& idx) {
+        uint64_t length = 0;
+        while (idx < s.size() && s[idx] != ']') {
+            if (isEnglish(s[idx])) {
+                size_t begin = idx;
+                while (idx < s.size() && isEnglish(s[idx])) {
+                    ++idx;
+                }
+                length = saturatingAdd(length, idx - begin);
+                continue;
+            }
+            uint64_t repeat = parseRepeat(s, idx);
+            assert(s[idx] == '[');
+            ++idx;
+            length = saturatingAdd(length, saturatingMul(repeat, measure(s, idx)));
+            assert(s[idx] == ']');
+            ++idx;
+        }
+        return length;
+    }
+
+    // Moves |idx| from the start of a body to its closing ']'.
+    static void skip(std::string_view s, size_t& idx) {
+        for (size_t depth = 0; depth > 0 || s[idx] != ']'; ++idx) {
+            if (s[idx] == '[') {
+                ++depth;
+            } else if (s[idx] == ']') {
+                --depth;
+            }
+        }
+    }
+
+    static char* fill(std::string_view s, size_t& idx, char* out) {
+        while (idx < s.size() && s[idx] != ']') {
+            if (isEnglish(s[idx])) {
+                size_t begin = idx;
+                while (idx < s.size() && isEnglish(s[idx])) {
+                    ++idx;
+                }
+                std::memcpy(out, s.data() + begin, idx - begin);
+                out += idx - begin;
+                continue;
+            }
+            uint64_t repeat = parseRepeat(s, idx);
+            ++idx;
+            if (repeat == 0) {
+                // The body decodes to nothing, it must not be written either.
+                skip(s, idx);
+                ++idx;
+                continue;
+            }
+            char* begin = out;
+            out = fill(s, idx, out);
+            ++idx;
+            // Double the already decoded body until the repeat is filled.
+            uint64_t total = (out - begin) * repeat;
+            uint64_t done = out - begin;
+            while (done < total) {
+                uint64_t n = std::min(done, total - done);
+                std::memcpy(begin + done, begin, n);
+                done += n;
+            }
+            out = begin + total;
+        }
+        return out;
+    }
+
+public:
+    static uint64_t decodedLength(std::string_view s) {
+        size_t idx = 0;
+        return measure(s, idx);
+    }
+
+    // Writes the decoded(s) to |out|, which must hold decodedLength(s) bytes.
+    // decodedLength(s) must be less than kMaxLength.
+    static void decodeInto(std::string_view s, char* out) {
+        size_t idx = 0;
+        fill(s, idx, out);
+    }
+
+    static std::string decodeString(const std::string& s) {
+        uint64_t length = decodedLength(s);
+        if (length == kMaxLength) {
+            throw std::length_error("decoded string too long");
+        }
+        std::string res(length, '\0');
+        decodeInto(s, res.data());
+        return res;
+    }
+};
+
+// Fixed set of threads running parallel loops. Each loop is split evenly
+// between the threads, which take small grains from the front of their own
+// range and, once it's empty, steal the back half of another thread's range.
+// The calling thread takes part as worker 0.
+class WorkStealingPool {
+  static constexpr size_t kGrain = 64;
+
+  struct alignas(64) Worker {
+    std::mutex mutex;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+public:
+  explicit WorkStealingPool(size_t threads)
+    : m_workers(std::max<size_t>(threads, 1))
+    , m_generation(0)
+    , m_pending(0)
+    , m_stop(false) {
+      for (size_t id = 1; id < m_workers.size(); ++id) {
+        m_threads.emplace_back([this, id]() { threadMain(id); });
+      }
+    }
+
+  ~WorkStealingPool() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& t : m_threads) {
+      t.join();
+    }
+  }
+
+  size_t threads() const { return m_workers.size(); }
+
+  // Calls |task(begin, end)| on disjoint ranges covering [0, count) and
+  // returns once all of them are done.
+  void parallelFor(size_t count, const std::function<void(size_t, size_t)>& task) {
+    size_t n = m_workers.size();
+    for (size_t id = 0; id < n; ++id) {
+      std::lock_guard<std::mutex> lock(m_workers[id].mutex);
+      m_workers[id].begin = count * id / n;
+      m_workers[id].end = count * (id + 1) / n;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_task = &task;
+      m_pending = n - 1;
+      ++m_generation;
+    }
+    m_wake.notify_all();
+    run(0);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() { return m_pending == 0; });
+    m_task = nullptr;
+  }
+
+private:
+  void threadMain(size_t id) {
+    uint64_t seen = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wake.wait(lock, [&]() { return m_stop || m_generation != seen; });
+        if (m_stop) {
+          return;
+        }
+        seen = m_generation;
+      }
+      run(id);
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (--m_pending == 0) {
+        m_done.notify_one();
+      }
+    }
+  }
+
+  void run(size_t id) {
+    Worker& self = m_workers[id];
+    while (true) {
+      size_t begin, end;
+      {
+        std::lock_guard<std::mutex> lock(self.mutex);
+        begin = self.begin;
+        end = std::min(self.end, begin + kGrain);
+        self.begin = end;
+      }
+      if (begin < end) {
+        (*m_task)(begin, end);
+        continue;
+      }
+      if (!steal(id)) {
+        return;
+      }
+    }
+  }
+
+  // Moves the back half of some other worker's range into |id|'s.
+  bool steal(size_t id) {
+    size_t n = m_workers.size();
+    for (size_t i = 1; i < n; ++i) {
+      Worker& victim = m_workers[(id + i) % n];
+      size_t begin, end;
+      {
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.begin >= victim.end) {
+          continue;
+        }
+        begin = victim.begin + (victim.end - victim.begin) / 2;
+        end = victim.end;
+        victim.end = begin;
+      }
+      std::lock_guard<std::mutex> lock(m_workers[id].mutex);
+      m_workers[id].begin = begin;
+      m_workers[id].end = end;
+      return true;
+    }
+    return false;
+  }
+
+  std::vector<Worker> m_workers;
+  std::vector<std::thread> m_threads;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_done;
+  const std::function<void(size_t, size_t)>* m_task = nullptr;
+  uint64_t m_generation;
+  size_t m_pending;
+  bool m_stop;
+};
+
+// Decoded outputs of a batch, stored back to back in one buffer. Reusing the
+// arena across batches keeps its buffer, so steady state decoding allocates
+// nothing.
+class OutputArena {
+public:
+  OutputArena() : m_capacity(0) {}
+
+  size_t size() const { return m_offsets.empty() ? 0 : m_offsets.size() - 1; }
+
+  std::string_view operator[](size_t i) const {
+    return std::string_view(m_buffer.get() + m_offsets[i], m_offsets[i + 1] - m_offsets[i]);
+  }
+
+  // Output i is [offsets()[i], offsets()[i + 1]) of data().
+  const std::vector<uint64_t>& offsets() const { return m_offsets; }
+  const char* data() const { return m_buffer.get(); }
+
+private:
+  friend void decodeBatch(const std::string_view*, size_t, OutputArena&, WorkStealingPool&);
+
+  void reserve(uint64_t bytes) {
+    if (bytes > m_capacity) {
+      m_buffer.reset(new char[bytes]);
+      m_capacity = bytes;
+    }
+  }
+
+  std::unique_ptr<char[]> m_buffer;
+  uint64_t m_capacity;
+  std::vector<uint64_t> m_offsets;
+};
+
+// Decodes |count| inputs into |arena| on |pool|.
+//
+// Rather than per-thread arenas that would need to be stitched together, a
+// first parallel pass measures every output, a prefix sum turns the lengths
+// into offsets, and a second parallel pass decodes each input in place with
+// DoublingSolution. Workers never allocate nor share a cache line of output
+// except at the boundaries of their ranges. That relies on decodeInto() writing
+// exactly decodedLength() bytes, so a batch whose total length saturates
+// throws std::length_error before anything is written.
+void decodeBatch(const std::string_view* inputs, size_t count, OutputArena& arena, WorkStealingPool& pool) {
+  std::vector<uint64_t>& offsets = arena.m_offsets;
+  offsets.resize(count + 1);
+  offsets[0] = 0;
+  pool.parallelFor(count, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      offsets[i + 1] = DoublingSolution::decodedLength(inputs[i]);
+    }
+  });
+  for (size_t i = 0; i < count; ++i) {
+    offsets[i + 1] = saturatingAdd(offsets[i + 1], offsets[i]);
+  }
+  if (offsets[count] == kMaxLength) {
+    throw std::length_error("decoded batch too long");
+  }
+  arena.reserve(offsets[count]);
+  char* buffer = arena.m_buffer.get();
+  pool.parallelFor(count, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      DoublingSolution::decodeInto(inputs[i], buffer + offsets[i]);
+    }
+  });
+}
+
+void decodeBatch(const std::vector<std::string_view>& inputs, OutputArena& arena, WorkStealingPool& pool) {
+  decodeBatch(inputs.data(), inputs.size(), arena, pool);
+}
+
+// Structural characters of a decodeString input: the start of every letter
+// run, the start of every number, and every bracket, with each '[' matched to
+// its ']'. Decoders can then jump from token to token instead of walking and
+// classifying every byte.
+struct Tokens {
+  std::vector<uint32_t> positions;
+  // For the token of a '[', index of the token of the matching ']'.
+  std::vector<uint32_t> match;
+  // Scratch stacks of unmatched '[' tokens and of the decoders.
+  std::vector<uint32_t> open;
+  std::vector<std::pair<uint64_t, uint64_t>> frames;
+
+  void clear() {
+    positions.clear();
+    match.clear();
+    open.clear();
+  }
+};
+
+// Classifies 64 bytes at a time into bitmasks, bit i standing for byte i.
+struct CharMasks {
+  uint64_t letters;
+  uint64_t digits;
+  uint64_t open;
+  uint64_t close;
+};
+
+#if defined(__AVX2__)
+static CharMasks classify64(const char* p) {
+  CharMasks m{0, 0, 0, 0};
+  for (int k = 0; k < 2; ++k) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32 * k));
+    // Signed compares are fine: non ASCII bytes are negative and match none.
+    __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)),
+                                       _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));
+    __m256i digits = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                                      _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    int shift = 32 * k;
+    m.letters |= uint64_t(uint32_t(_mm256_movemask_epi8(letters))) << shift;
+    m.digits |= uint64_t(uint32_t(_mm256_movemask_epi8(digits))) << shift;
+    m.open |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('['))))) << shift;
+    m.close |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(']'))))) << shift;
+  }
+  return m;
+}
+#elif defined(__SSE2__)
+static CharMasks classify64(const char* p) {
+  CharMasks m{0, 0, 0, 0};
+  for (int k = 0; k < 4; ++k) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * k));
+    // Signed compares are fine: non ASCII bytes are negative and match none.
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)),
+                                    _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+    __m128i digits = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                   _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    int shift = 16 * k;
+    m.letters |= uint64_t(_mm_movemask_epi8(letters)) << shift;
+    m.digits |= uint64_t(_mm_movemask_epi8(digits)) << shift;
+    m.open |= uint64_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('[')))) << shift;
+    m.close |= uint64_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(']')))) << shift;
+  }
+  return m;
+}
+#else
+static CharMasks classify64(const char* p) {
+  CharMasks m{0, 0, 0, 0};
+  for (int i = 0; i < 64; ++i) {
+    m.letters |= uint64_t(isEnglish(p[i])) << i;
+    m.digits |= uint64_t(isDigit(p[i])) << i;
+    m.open |= uint64_t(p[i] == '[') << i;
+    m.close |= uint64_t(p[i] == ']') << i;
+  }
+  return m;
+}
+#endif
+
+// Fills |tokens| for |s| in a single pass: each block of 64 bytes is
+// classified at once, the first byte of every letter and digit run is found
+// with a shift against the previous byte's mask, and brackets are matched as
+// their tokens are extracted.
+void tokenize(std::string_view s, Tokens& tokens) {
+  tokens.clear();
+  uint64_t prevLetter = 0;
+  uint64_t prevDigit = 0;
+  for (size_t base = 0; base < s.size(); base += 64) {
+    CharMasks m;
+    if (base + 64 <= s.size()) {
+      m = classify64(s.data() + base);
+    } else {
+      char tail[64] = {};
+      std::memcpy(tail, s.data() + base, s.size() - base);
+      m = classify64(tail);
+    }
+    uint64_t letterStarts = m.letters & ~((m.letters << 1) | prevLetter);
+    uint64_t digitStarts = m.digits & ~((m.digits << 1) | prevDigit);
+    prevLetter = m.letters >> 63;
+    prevDigit = m.digits >> 63;
+    uint64_t structural = letterStarts | digitStarts | m.open | m.close;
+    while (structural != 0) {
+      uint64_t bit = structural & -structural;
+      uint32_t t = tokens.positions.size();
+      tokens.positions.push_back(base + __builtin_ctzll(structural));
+      tokens.match.push_back(0);
+      if (m.open & bit) {
+        tokens.open.push_back(t);
+      } else if (m.close & bit) {
+        assert(!tokens.open.empty());
+        tokens.match[tokens.open.back()] = t;
+        tokens.open.pop_back();
+      }
+      structural ^= bit;
+    }
+  }
+  assert(tokens.open.empty());
+}
+
+// Same two passes as DoublingSolution, but over the tokens: literal lengths
+// are the distance to the next token and repeats of 0 jump straight past
+// their matching ']'. The nesting is tracked on an explicit stack instead of
+// the call stack, so depth is only bounded by memory.
+class TokenSolution {
+    static uint64_t tokenEnd(std::string_view s, const Tokens& tokens, uint32_t t) {
+        return t + 1 < tokens.positions.size() ? tokens.positions[t + 1] : s.size();
+    }
+
+    static uint64_t parseRepeat(std::string_view s, uint32_t begin, uint32_t end) {
+        uint64_t repeat = 0;
+        for (uint32_t i = begin; i < end; ++i) {
+            repeat = saturatingAdd(saturatingMul(repeat, 10), s[i] - '0');
+        }
+        return repeat;
+    }
+
+    // Saturates at kMaxLength, like DoublingSolution.
+    static uint64_t measure(std::string_view s, Tokens& tokens) {
+        // Length decoded so far in the enclosing body, and repeat.
+        std::vector<std::pair<uint64_t, uint64_t>>& frames = tokens.frames;
+        frames.clear();
+        uint64_t length = 0;
+        uint32_t t = 0;
+        while (t < tokens.positions.size()) {
+            uint32_t pos = tokens.positions[t];
+            if (isEnglish(s[pos])) {
+                length = saturatingAdd(length, tokenEnd(s, tokens, t) - pos);
+                ++t;
+            } else if (isDigit(s[pos])) {
+                uint64_t repeat = parseRepeat(s, pos, tokens.positions[t + 1]);
+                if (repeat == 0) {
+                    t = tokens.match[t + 1] + 1;
+                    continue;
+                }
+                frames.emplace_back(length, repeat);
+                length = 0;
+                t += 2;
+            } else {
+                length = saturatingAdd(frames.back().first, saturatingMul(length, frames.back().second));
+                frames.pop_back();
+                ++t;
+            }
+        }
+        return length;
+    }
+
+    static void fill(std::string_view s, Tokens& tokens, char* base) {
+        // Offset of the body in |base|, and repeat.
+        std::vector<std::pair<uint64_t, uint64_t>>& frames = tokens.frames;
+        frames.clear();
+        char* out = base;
+        uint32_t t = 0;
+        while (t < tokens.positions.size()) {
+            uint32_t pos = tokens.positions[t];
+            if (isEnglish(s[pos])) {
+                uint64_t n = tokenEnd(s, tokens, t) - pos;
+                std::memcpy(out, s.data() + pos, n);
+                out += n;
+                ++t;
+            } else if (isDigit(s[pos])) {
+                uint64_t repeat = parseRepeat(s, pos, tokens.positions[t + 1]);
+                if (repeat == 0) {
+                    t = tokens.match[t + 1] + 1;
+                    continue;
+                }
+                frames.emplace_back(out - base, repeat);
+                t += 2;
+            } else {
+                char* begin = base + frames.back().first;
+                uint64_t total = (out - begin) * frames.back().second;
+                uint64_t done = out - begin;
+                while (done < total) {
+                    uint64_t n = std::min(done, total - done);
+                    std::memcpy(begin + done, begin, n);
+                    done += n;
+                }
+                out = begin + total;
+                frames.pop_back();
+                ++t;
+            }
+        }
+    }
+
+public:
+    // Decodes with caller provided |tokens|, so that repeated calls reuse
+    // their buffers.
+    static std::string decodeString(std::string_view s, Tokens& tokens) {
+        tokenize(s, tokens);
+        uint64_t length = measure(s, tokens);
+        if (length == kMaxLength) {
+            throw std::length_error("decoded string too long");
+        }
+        std::string res(length, '\0');
+        fill(s, tokens, res.data());
+        return res;
+    }
+
+    static std::string decodeString(const std::string& s) {
+        Tokens tokens;
+        return decodeString(s, tokens);
+    }
+};
+
+// Random access into the decoded output of a RepeatTree without expanding it.
+//
+// For every repeat node the view keeps its children in a contiguous array
+// together with their offset inside one repetition of the body, so a lookup
+// walks down the tree doing one modulo and one binary search per level.
+class DecodedView {
+public:
+  explicit DecodedView(const RepeatTree& tree)
+    : m_tree(tree)
+    , m_firstChild(tree.size() + 1, 0) {
+      for (uint32_t i = 0; i < tree.size(); ++i) {
+        m_firstChild[i] = m_children.size();
+        const RepeatTree::TreeNode& n = tree.node(i);
+        if (!n.isRepeat) {
+          continue;
+        }
+        uint64_t offset = 0;
+        for (uint32_t c = i + 1; c < n.end; c = tree.node(c).end) {
+          m_children.push_back(c);
+          m_offsets.push_back(offset);
+          offset += tree.node(c).totalLength;
+        }
+      }
+      m_firstChild[tree.size()] = m_children.size();
+    }
+
+  uint64_t size() const { return m_tree.decodedLength(); }
+
+  char charAt(uint64_t pos) const {
+    assert(pos < size());
+    uint32_t i = 0;
+    while (m_tree.node(i).isRepeat) {
+      pos %= m_tree.node(i).bodyLength;
+      size_t k = childAt(i, pos);
+      pos -= m_offsets[k];
+      i = m_children[k];
+    }
+    return m_tree.input()[m_tree.node(i).begin + pos];
+  }
+
+  // Same semantic as std::string::substr.
+  std::string substr(uint64_t pos, uint64_t len = std::numeric_limits<uint64_t>::max()) const {
+    assert(pos <= size());
+    len = std::min(len, size() - pos);
+    std::string out;
+    out.reserve(len);
+    appendRange(0, pos, len, out);
+    return out;
+  }
+
+private:
+  // Index in m_children of the child of |i| covering |pos| of its body.
+  size_t childAt(uint32_t i, uint64_t pos) const {
+    auto first = m_offsets.begin() + m_firstChild[i];
+    auto last = m_offsets.begin() + m_firstChild[i + 1];
+    return std::upper_bound(first, last, pos) - m_offsets.begin() - 1;
+  }
+
+  // Appends [pos, pos + len) of node |i| to |out|. Whole repetitions are
+  // copied from the first one already in |out| instead of walking the
+  // subtree again.
+  void appendRange(uint32_t i, uint64_t pos, uint64_t len, std::string& out) const {
+    const RepeatTree::TreeNode& n = m_tree.node(i);
+    if (len == 0) {
+      return;
+    }
+    if (!n.isRepeat) {
+      out.append(m_tree.input().substr(n.begin + pos, len));
+      return;
+    }
+    uint64_t body = n.bodyLength;
+    uint64_t offset = pos % body;
+    if (offset != 0) {
+      uint64_t head = std::min(len, body - offset);
+      appendBody(i, offset, head, out);
+      len -= head;
+    }
+    if (len >= body) {
+      size_t first = out.size();
+      appendBody(i, 0, body, out);
+      len -= body;
+      while (len >= body) {
+        out.append(out, first, body);
+        len -= body;
+      }
+    }
+    if (len > 0) {
+      appendBody(i, 0, len, out);
+    }
+  }
+
+  // Appends [pos, pos + len) of one repetition of the body of |i|.
+  void appendBody(uint32_t i, uint64_t pos, uint64_t len, std::string& out) const {
+    for (size_t k = childAt(i, pos); len > 0; ++k) {
+      uint64_t childPos = pos - m_offsets[k];
+      uint64_t n = std::min(len, m_tree.node(m_children[k]).totalLength - childPos);
+      appendRange(m_children[k], childPos, n, out);
+      pos += n;
+      len -= n;
+    }
+  }
+
+  const RepeatTree& m_tree;
+  // Children of node i are m_children[m_firstChild[i]..m_firstChild[i + 1]).
+  std::vector<uint32_t> m_firstChild;
+  std::vector<uint32_t> m_children;
+  // Offset of each child inside one repetition of its parent's body.
+  std::vector<uint64_t> m_offsets;
+};
+
+class StreamingSolution {
+public:
+    static std::string decodeString(const std::string& s) {
+      RepeatTree tree(s);
+      StreamingDecoder decoder(tree);
+      std::string res(tree.decodedLength(), '\0');
+      decoder.read(res.data(), res.size());
+      return res;
+    }
+};
+
 void test(const std::string& s, const std::string& expected) {
   std::cout << "Testing (recursive) \"" << s << "\" ... ";
   std::string res = RecursiveSolution::decodeString(s);
@@ -196,10 +1146,467 @@ void test(const std::string& s, const std::string& expected) {
   } else {
     std::cout << "PASSED (expected: \"" << expected << "\")" << std::endl;
   }
+
+  std::cout << "Testing (doubling) \"" << s << "\" ... ";
+  res = DoublingSolution::decodeString(s);
+  if (res != expected) {
+    std::cout << "!!!! FAILED, got: \"" << res << "\", but expected: \"" << expected << "\"" << std::endl;
+  } else {
+    std::cout << "PASSED (expected: \"" << expected << "\")" << std::endl;
+  }
+
+  std::cout << "Testing (tokens) \"" << s << "\" ... ";
+  res = TokenSolution::decodeString(s);
+  if (res != expected) {
+    std::cout << "!!!! FAILED, got: \"" << res << "\", but expected: \"" << expected << "\"" << std::endl;
+  } else {
+    std::cout << "PASSED (expected: \"" << expected << "\")" << std::endl;
+  }
+
+  std::cout << "Testing (streaming) \"" << s << "\" ... ";
+  res = StreamingSolution::decodeString(s);
+  uint64_t length = RepeatTree(s).decodedLength();
+  if (res != expected || length != expected.size()) {
+    std::cout << "!!!! FAILED, got: \"" << res << "\" (length " << length << "), but expected: \"" << expected << "\"" << std::endl;
+  } else {
+    std::cout << "PASSED (expected: \"" << expected << "\")" << std::endl;
+  }
+}
+
+size_t peakRssKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// Runs |decode| in a child process so that peak RSS isn't
+// shared between variants.
+template<typename Decode>
+void benchVariant(const char* name, Decode decode) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t bytes = decode();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  " << name << ": " << bytes / seconds / 1e9 << " GB/s, peak RSS=" << peakRssKb() << " KiB" << std::endl;
+    std::cout.flush();
+    _exit(0);
+  }
+  waitpid(pid, nullptr, 0);
+}
+
+std::string nested(const std::string& repeat, size_t depth, const std::string& body) {
+  std::string s;
+  for (size_t i = 0; i < depth; ++i) {
+    s += repeat + "[";
+  }
+  s += body;
+  s += std::string(depth, ']');
+  return s;
+}
+
+// The materializing solutions are only run when their output fits in memory.
+constexpr uint64_t kMaterializeLimit = 1ull << 28;
+
+int bench(uint64_t repeat) {
+  std::vector<std::string> inputs = {
+    nested(std::to_string(repeat), 2, "a"),
+    nested("2", 28, "ab"),
+    nested("3", 15, "abcdefghij"),
+    "2[" + nested("7", 8, "xyz") + "q" + nested("5", 9, "uvw") + "]",
+  };
+  for (const std::string& s : inputs) {
+    RepeatTree tree(s);
+    uint64_t length = tree.decodedLength();
+    std::cout << (s.size() > 40 ? s.substr(0, 37) + "..." : s) << " decodes to " << length << " bytes" << std::endl;
+    benchVariant("streaming", [&s]() {
+      RepeatTree tree(s);
+      StreamingDecoder decoder(tree);
+      uint64_t bytes = 0;
+      volatile char last = 0;
+      decoder.decodeTo([&](const char* data, size_t n) {
+        bytes += n;
+        last = data[n - 1];
+      });
+      return bytes;
+    });
+    if (length > kMaterializeLimit) {
+      std::cout << "  stack/recursive: skipped, output too large to materialize" << std::endl;
+      continue;
+    }
+    benchVariant("stack", [&s]() { return uint64_t(StackSolution::decodeString(s).size()); });
+    benchVariant("recursive", [&s]() { return uint64_t(RecursiveSolution::decodeString(s).size()); });
+  }
+  return 0;
+}
+
+// Checks every charAt and a spread of substr against the full expansion.
+void testView(const std::string& s) {
+  std::string expected = StackSolution::decodeString(s);
+  RepeatTree tree(s);
+  DecodedView view(tree);
+  bool ok = view.size() == expected.size();
+  for (size_t i = 0; ok && i < expected.size(); ++i) {
+    ok = view.charAt(i) == expected[i];
+  }
+  for (size_t pos = 0; ok && pos <= expected.size(); pos += 1 + pos / 3) {
+    for (size_t len : {size_t(0), size_t(1), size_t(7), size_t(64), expected.size()}) {
+      ok = ok && view.substr(pos, len) == expected.substr(pos, len);
+    }
+  }
+  std::cout << "Testing (view) \"" << (s.size() > 40 ? s.substr(0, 37) + "..." : s) << "\" ... "
+            << (ok ? "PASSED" : "!!!! FAILED") << std::endl;
+}
+
+// Random lookups through DecodedView, compared to expanding the whole string
+// when that fits in memory.
+int benchView(uint64_t repeat) {
+  std::vector<std::string> inputs = {
+    nested(std::to_string(repeat), 2, "abc"),
+    nested("2", 40, "ab"),
+    nested("3", 15, "abcdefghij"),
+    "2[" + nested("7", 8, "xyz") + "q" + nested("5", 9, "uvw") + "]",
+  };
+  constexpr size_t kLookups = 1000000;
+  for (const std::string& s : inputs) {
+    RepeatTree tree(s);
+    DecodedView view(tree);
+    std::cout << (s.size() > 40 ? s.substr(0, 37) + "..." : s) << " decodes to " << view.size() << " bytes" << std::endl;
+
+    uint64_t state = 88172645463325252ull;
+    auto next = [&state]() {
+      state ^= state << 13;
+      state ^= state >> 7;
+      state ^= state << 17;
+      return state;
+    };
+    auto start = std::chrono::steady_clock::now();
+    unsigned checksum = 0;
+    for (size_t i = 0; i < kLookups; ++i) {
+      checksum += view.charAt(next() % view.size());
+    }
+    double charAtNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / kLookups;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kLookups; ++i) {
+      checksum += view.substr(next() % view.size(), 64).size();
+    }
+    double substrNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / kLookups;
+    std::cout << "  view: charAt=" << charAtNs << "ns, substr(64)=" << substrNs << "ns (checksum " << checksum << ")" << std::endl;
+
+    if (view.size() > kMaterializeLimit) {
+      std::cout << "  full decode: skipped, output too large to materialize" << std::endl;
+      continue;
+    }
+    start = std::chrono::steady_clock::now();
+    std::string full = RecursiveSolution::decodeString(s);
+    double decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  full decode before the first lookup: " << decodeMs << "ms" << std::endl;
+  }
+  return 0;
+}
+
+// Decodes a corpus of mixed, LeetCode sized and larger, inputs with every
+// solution and reports time and allocations per decode.
+int benchCorpus(size_t rounds) {
+  std::vector<std::string> corpus = {
+    "3[a]2[bc]",
+    "3[a2[c]]",
+    "2[abc]3[cd]ef",
+    "abc3[cd]xyz",
+    "3[z]2[2[y]pq4[2[jk]e1[f]]]ef",
+    "100[leetcode]",
+    "20[a3[bc]d]",
+    nested("2", 10, "ab"),
+    "300[ab2[cd]]",
+    "2[" + nested("7", 4, "xyz") + "q" + nested("5", 4, "uvw") + "]",
+  };
+  uint64_t bytes = 0;
+  for (const std::string& s : corpus) {
+    bytes += DoublingSolution::decodeString(s).size();
+  }
+  std::cout << "Corpus of " << corpus.size() << " inputs decoding to " << bytes << " bytes, " << rounds << " rounds" << std::endl;
+
+  auto run = [&](const char* name, auto decode) {
+    size_t allocations = g_allocations;
+    auto start = std::chrono::steady_clock::now();
+    size_t checksum = 0;
+    for (size_t r = 0; r < rounds; ++r) {
+      for (const std::string& s : corpus) {
+        checksum += decode(s).size();
+      }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    double decodes = double(rounds) * corpus.size();
+    std::cout << "  " << name << ": " << ns / decodes << "ns/decode, "
+              << (g_allocations - allocations) / decodes << " allocations/decode"
+              << " (checksum " << checksum << ")" << std::endl;
+  };
+  run("stack", [](const std::string& s) { return StackSolution::decodeString(s); });
+  run("recursive", [](const std::string& s) { return RecursiveSolution::decodeString(s); });
+  run("streaming", [](const std::string& s) { return StreamingSolution::decodeString(s); });
+  run("doubling", [](const std::string& s) { return DoublingSolution::decodeString(s); });
+  return 0;
 }
 
-int main() {
+// Random LeetCode style input: a few literals and repeats nested up to
+// |depth| levels.
+std::string randomEncoded(std::mt19937_64& rng, int depth) {
+  std::string s;
+  int pieces = 1 + rng() % 3;
+  for (int p = 0; p < pieces; ++p) {
+    if (depth > 0 && rng() % 2 == 0) {
+      s += std::to_string(1 + rng() % 9) + "[" + randomEncoded(rng, depth - 1) + "]";
+      continue;
+    }
+    int letters = 1 + rng() % 4;
+    for (int l = 0; l < letters; ++l) {
+      s += char('a' + rng() % 26);
+    }
+  }
+  return s;
+}
+
+// Throughput of decoding a batch of small inputs one at a time versus
+// decodeBatch with 1 to N threads.
+int benchBatch(size_t count) {
+  std::mt19937_64 rng(42);
+  std::vector<std::string> encoded(count);
+  std::vector<std::string_view> inputs(count);
+  for (size_t i = 0; i < count; ++i) {
+    encoded[i] = randomEncoded(rng, 3);
+    inputs[i] = encoded[i];
+  }
+  constexpr int kRounds = 5;
+  std::cout << "Decoding " << count << " inputs, " << kRounds << " rounds (Minputs/s)" << std::endl;
+
+  auto report = [&](const std::string& name, auto decodeAll) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t bytes = 0;
+    for (int r = 0; r < kRounds; ++r) {
+      bytes += decodeAll();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  " << name << ": " << kRounds * count / seconds / 1e6 << " Minputs/s, "
+              << bytes / seconds / 1e9 << " GB/s" << std::endl;
+  };
+  report("stack, one at a time", [&]() {
+    uint64_t bytes = 0;
+    for (const std::string& s : encoded) {
+      bytes += StackSolution::decodeString(s).size();
+    }
+    return bytes;
+  });
+  report("doubling, one at a time", [&]() {
+    uint64_t bytes = 0;
+    for (const std::string& s : encoded) {
+      bytes += DoublingSolution::decodeString(s).size();
+    }
+    return bytes;
+  });
+  // Powers of two up to every core, which comes last even if it isn't one.
+  size_t maxThreads = std::max<size_t>(1, std::thread::hardware_concurrency());
+  for (size_t threads = 1;; threads = std::min(2 * threads, maxThreads)) {
+    WorkStealingPool pool(threads);
+    OutputArena arena;
+    report("decodeBatch, threads=" + std::to_string(threads), [&]() {
+      decodeBatch(inputs, arena, pool);
+      return arena.offsets().back();
+    });
+    if (threads == maxThreads) {
+      break;
+    }
+  }
+  return 0;
+}
+
+// Decode time of the scanning solutions on long flat and deeply nested
+// inputs, plus the tokenizer alone.
+int benchTokens(size_t bytes) {
+  std::mt19937_64 rng(1);
+  std::string flat;
+  while (flat.size() < bytes) {
+    size_t run = 1 + rng() % 200;
+    for (size_t i = 0; i < run; ++i) {
+      flat += char('a' + rng() % 26);
+    }
+    flat += "2[" + std::string(1 + rng() % 8, 'q') + "]";
+  }
+  size_t depth = bytes / 8;
+  std::string deep;
+  for (size_t i = 0; i < depth; ++i) {
+    deep += "x1[";
+  }
+  deep += "abc";
+  for (size_t i = 0; i < depth; ++i) {
+    deep += "]";
+  }
+  struct Input {
+    std::string name;
+    std::string s;
+    size_t depth;
+  };
+  std::vector<Input> inputs = {
+    {"flat, " + std::to_string(flat.size()) + " bytes", flat, 1},
+    {"nested " + std::to_string(depth) + " deep", deep, depth},
+  };
+  constexpr int kRounds = 5;
+  for (const auto& [name, s, inputDepth] : inputs) {
+    std::cout << name << " (ms per decode)" << std::endl;
+    auto time = [&](const char* solution, auto decode) {
+      auto start = std::chrono::steady_clock::now();
+      size_t checksum = 0;
+      for (int r = 0; r < kRounds; ++r) {
+        checksum += decode();
+      }
+      double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / kRounds;
+      std::cout << "  " << solution << ": " << ms << "ms (checksum " << checksum << ")" << std::endl;
+    };
+    // The recursive solution rescans every nested body, O(n * depth), and
+    // both recursive solutions run out of call stack on very deep inputs.
+    if (inputDepth <= 20000) {
+      time("recursive", [&]() { return RecursiveSolution::decodeString(s).size(); });
+      time("doubling", [&]() { return DoublingSolution::decodeString(s).size(); });
+    }
+    time("stack", [&]() { return StackSolution::decodeString(s).size(); });
+    Tokens tokens;
+    time("tokens", [&]() { return TokenSolution::decodeString(s, tokens).size(); });
+    time("tokenize only", [&]() {
+      tokenize(s, tokens);
+      return tokens.positions.size();
+    });
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "bench") {
+    return bench(argc > 2 ? std::stoull(argv[2]) : 100000);
+  }
+  if (argc > 1 && std::string(argv[1]) == "corpus") {
+    return benchCorpus(argc > 2 ? std::stoull(argv[2]) : 10000);
+  }
+  if (argc > 1 && std::string(argv[1]) == "batch") {
+    return benchBatch(argc > 2 ? std::stoull(argv[2]) : 1000000);
+  }
+  if (argc > 1 && std::string(argv[1]) == "tokens") {
+    return benchTokens(argc > 2 ? std::stoull(argv[2]) : 100000);
+  }
+  if (argc > 1 && std::string(argv[1]) == "view") {
+    return benchView(argc > 2 ? std::stoull(argv[2]) : 100000);
+  }
+
   test("3[a]2[bc]", "aaabcbc");
   test("3[a2[c]]", "accaccacc");
   test("2[abc]3[cd]ef", "abcabccdcdcdef");
+  test("abc", "abc");
+  test("10[a]", "aaaaaaaaaa");
+  test(nested("2", 4, "ab"), "abababababababababababababababab");
+  test("0[" + std::string(100, 'a') + "]", "");
+  test("x0[ab2[c]0[]d]y", "xy");
+
+  // 2^32 * 2^32 wraps around to 0 unless the length saturates.
+  std::string overflowing = nested("4294967296", 2, "a") + "b";
+  bool rejected = false;
+  try {
+    DoublingSolution::decodeString(overflowing);
+  } catch (const std::length_error&) {
+    rejected = true;
+  }
+  try {
+    TokenSolution::decodeString(overflowing);
+    rejected = false;
+  } catch (const std::length_error&) {
+  }
+  std::cout << "Testing (doubling, tokens) an overflowing repeat is rejected ... "
+            << (rejected && DoublingSolution::decodedLength(overflowing) == RepeatTree::kMaxLength
+                && DoublingSolution::decodedLength("99999999999999999999999[a]") == RepeatTree::kMaxLength
+                ? "PASSED" : "!!!! FAILED") << std::endl;
+
+  // Bodies larger than the pattern buffer go through the explicit stack, and
+  // a tiny read buffer exercises resuming in the middle of a literal.
+  std::string big = "3[" + nested("3", 8, "abcdefg") + "z]";
+  std::string expected = RecursiveSolution::decodeString(big);
+  RepeatTree tree(big);
+  StreamingDecoder decoder(tree);
+  std::string streamed;
+  char buf[7];
+  while (size_t n = decoder.read(buf, sizeof(buf))) {
+    streamed.append(buf, n);
+  }
+  std::cout << "Testing (streaming, 7 byte reads) " << expected.size() << " bytes ... "
+            << (streamed == expected && decoder.done() ? "PASSED" : "!!!! FAILED") << std::endl;
+
+  // A small body nesting 300^4 repeats of nothing must not walk them.
+  auto emptyStart = std::chrono::steady_clock::now();
+  bool emptyOk = StreamingSolution::decodeString("2[300[300[300[300[]]]]a]") == "aa";
+  double emptySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - emptyStart).count();
+  std::cout << "Testing (streaming) nested empty repeats in a pattern body ... "
+            << (emptyOk && emptySeconds < 0.1 ? "PASSED" : "!!!! FAILED") << std::endl;
+
+  testView("3[a]2[bc]");
+  testView("2[abc]3[cd]ef");
+  testView("xy3[a2[]b]2[c4[de]f]g");
+  testView(big);
+
+  RepeatTree hugeTree("ab100000[100000[cd]e]f");
+  DecodedView hugeView(hugeTree);
+  std::cout << "Testing (view) charAt/substr deep into a 2*10^10 byte expansion ... "
+            << (hugeView.charAt(2 + 5 * 200001) == 'c' && hugeView.charAt(hugeView.size() - 2) == 'e'
+                && hugeView.substr(hugeView.size() - 6) == "cdcdef"
+                ? "PASSED" : "!!!! FAILED") << std::endl;
+
+  std::mt19937_64 rng(7);
+  std::vector<std::string> encoded;
+  for (int i = 0; i < 5000; ++i) {
+    encoded.push_back(randomEncoded(rng, 3));
+  }
+  std::vector<std::string_view> inputs(encoded.begin(), encoded.end());
+  WorkStealingPool pool(4);
+  OutputArena arena;
+  bool batchOk = true;
+  // Twice to check that the arena is reused.
+  for (int round = 0; round < 2; ++round) {
+    decodeBatch(inputs, arena, pool);
+    batchOk = batchOk && arena.size() == encoded.size();
+    for (size_t i = 0; batchOk && i < encoded.size(); ++i) {
+      batchOk = arena[i] == StackSolution::decodeString(encoded[i]);
+    }
+  }
+  std::cout << "Testing decodeBatch on " << encoded.size() << " random inputs ... "
+            << (batchOk ? "PASSED" : "!!!! FAILED") << std::endl;
+
+  // Zero repeats between and at the end of the outputs, which must neither
+  // spill into the next output nor past the arena.
+  std::vector<std::string> zeros;
+  for (int i = 0; i < 1000; ++i) {
+    zeros.push_back(i % 3 == 0 ? "0[" + randomEncoded(rng, 3) + "]" : randomEncoded(rng, 2) + "0[abc]");
+  }
+  zeros.push_back("ab0[" + std::string(100, 'z') + "]");
+  std::vector<std::string_view> zeroInputs(zeros.begin(), zeros.end());
+  OutputArena zeroArena;
+  decodeBatch(zeroInputs, zeroArena, pool);
+  bool zerosOk = zeroArena.size() == zeros.size();
+  for (size_t i = 0; zerosOk && i < zeros.size(); ++i) {
+    zerosOk = zeroArena[i] == StackSolution::decodeString(zeros[i]);
+  }
+  std::vector<std::string_view> overflowingBatch = {"abc", overflowing};
+  try {
+    decodeBatch(overflowingBatch, zeroArena, pool);
+    zerosOk = false;
+  } catch (const std::length_error&) {
+  }
+  std::cout << "Testing decodeBatch with zero and overflowing repeats ... "
+            << (zerosOk ? "PASSED" : "!!!! FAILED") << std::endl;
+
+  // Long inputs so that runs and brackets straddle the 64 byte blocks.
+  bool tokensOk = true;
+  for (int i = 0; tokensOk && i < 200; ++i) {
+    std::string s = "2[" + randomEncoded(rng, 4) + "]" + randomEncoded(rng, 4) + "123[" + randomEncoded(rng, 2) + "]";
+    tokensOk = TokenSolution::decodeString(s) == StackSolution::decodeString(s);
+  }
+  std::cout << "Testing (tokens) on long random inputs ... " << (tokensOk ? "PASSED" : "!!!! FAILED") << std::endl;
+
+  uint64_t huge = RepeatTree("100000[100000[a]]").decodedLength();
+  std::cout << "Testing decodedLength(\"100000[100000[a]]\") ... "
+            << (huge == 10000000000ull ? "PASSED" : "!!!! FAILED") << std::endl;
 }
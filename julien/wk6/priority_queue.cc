@@ -1,140 +1,516 @@
 // Build using:
-//   g++ -Wall -Werror --sanitize=address -g -o priority_queue priority_queue.cc && ./priority_queue
+//   g++ -Wall -Werror --sanitize=address -g -pthread -o priority_queue priority_queue.cc && ./priority_queue
+// Benchmark using:
+//   g++ -Wall -Werror -O2 -DNDEBUG -pthread -o priority_queue priority_queue.cc && ./priority_queue bench [max size]
+//   ./priority_queue dijkstra [vertices] [degree]
+//   ./priority_queue timers [ticks] [timers per tick]
+//   ./priority_queue concurrent [elements]
+//   ./priority_queue rebuild [size]
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <numeric>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
 #include <vector>
 
-template<typename T>
-struct Node {
+#include "priority_queue.h"
+
+// Priority/value pair ordered by priority only for std::priority_queue.
+struct StdEntry {
   int priority;
-  T t;
+  int value;
+  bool operator<(const StdEntry& o) const { return priority < o.priority; }
 };
 
-template<typename T>
-class PriorityQueue {
-public:
-  PriorityQueue(size_t min_size)
-    : m_used(0), m_size(min_size) {
-      assert(m_size > 0);
-      m_backing = new Node<T>[m_size];
-    }
-
-  ~PriorityQueue() {
-    delete [] m_backing;
+template<typename Q>
+void pushPop(const char* name, const std::vector<int>& priorities) {
+  Q q(1);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < priorities.size(); ++i) {
+    q.push(priorities[i], i);
   }
+  double pushSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  start = std::chrono::steady_clock::now();
+  long long sum = 0;
+  while (!q.empty()) {
+    sum += q.pop();
+  }
+  double popSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "    " << name << ": push=" << (priorities.size() / pushSeconds / 1e6)
+            << " Mops/s, pop=" << (priorities.size() / popSeconds / 1e6) << " Mops/s"
+            << " (checksum " << sum << ")" << std::endl;
+}
 
-  bool empty() const { return m_used == 0; }
-
-  T pop() {
-    if (empty()) {
-      // TODO: Throw!
-      return T{};
-    }
+void stdPushPop(const std::vector<int>& priorities) {
+  std::priority_queue<StdEntry> q;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < priorities.size(); ++i) {
+    q.push(StdEntry{priorities[i], int(i)});
+  }
+  double pushSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  start = std::chrono::steady_clock::now();
+  long long sum = 0;
+  while (!q.empty()) {
+    sum += q.top().value;
+    q.pop();
+  }
+  double popSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "    std::priority_queue: push=" << (priorities.size() / pushSeconds / 1e6)
+            << " Mops/s, pop=" << (priorities.size() / popSeconds / 1e6) << " Mops/s"
+            << " (checksum " << sum << ")" << std::endl;
+}
 
-    Node<T> res = m_backing[0];
-    m_used--;
-    if (m_used > 0) {
-      m_backing[0] = m_backing[m_used];
-      bubbleDownRecursive(0);
+int bench(size_t maxSize) {
+  std::mt19937 rng(42);
+  for (size_t size = 1000; size <= maxSize; size *= 10) {
+    std::vector<int> priorities(size);
+    for (int& p : priorities) {
+      p = rng();
     }
-    return res.t;
+    std::cout << "  " << size << " random priorities" << std::endl;
+    pushPop<RecursivePriorityQueue<int>>("recursive binary heap", priorities);
+    pushPop<PriorityQueue<int, 2>>("iterative 2-ary heap", priorities);
+    pushPop<PriorityQueue<int, 4>>("iterative 4-ary heap", priorities);
+    pushPop<PriorityQueue<int, 8>>("iterative 8-ary heap", priorities);
+    stdPushPop(priorities);
   }
+  return 0;
+}
 
-  T peek() const {
-    if (empty()) {
-      // TODO: Throw!
-      return T{};
-    }
+// Random directed graph in compressed sparse row form.
+struct Graph {
+  std::vector<size_t> offsets;
+  std::vector<uint32_t> targets;
+  std::vector<int> weights;
+};
 
-    return m_backing[0].t;
+Graph randomGraph(uint32_t vertices, uint32_t degree) {
+  std::mt19937 rng(42);
+  Graph g;
+  g.offsets.resize(vertices + 1);
+  g.targets.resize(size_t(vertices) * degree);
+  g.weights.resize(size_t(vertices) * degree);
+  for (uint32_t v = 0; v <= vertices; ++v) {
+    g.offsets[v] = size_t(v) * degree;
   }
+  for (size_t e = 0; e < g.targets.size(); ++e) {
+    g.targets[e] = rng() % vertices;
+    g.weights[e] = 1 + rng() % 100;
+  }
+  return g;
+}
 
-  void push(int priority, T t) {
-    if (m_used == m_size) {
-      grow();
+struct DijkstraStats {
+  std::vector<int> dist;
+  size_t pushes;
+  size_t maxSize;
+  double seconds;
+};
+
+constexpr int kUnreached = std::numeric_limits<int>::max();
+
+// Pushes a new entry on every relaxation and skips stale ones when popped.
+DijkstraStats dijkstraLazy(const Graph& g) {
+  struct Visit {
+    int dist;
+    uint32_t vertex;
+  };
+  DijkstraStats st{std::vector<int>(g.offsets.size() - 1, kUnreached), 0, 0, 0};
+  auto start = std::chrono::steady_clock::now();
+  // The queue is a max-heap so negate distances.
+  PriorityQueue<Visit> q(1024);
+  st.dist[0] = 0;
+  q.push(0, Visit{0, 0});
+  st.pushes++;
+  while (!q.empty()) {
+    st.maxSize = std::max(st.maxSize, q.size());
+    Visit v = q.pop();
+    if (v.dist > st.dist[v.vertex]) {
+      continue;
+    }
+    for (size_t e = g.offsets[v.vertex]; e < g.offsets[v.vertex + 1]; ++e) {
+      int d = v.dist + g.weights[e];
+      uint32_t u = g.targets[e];
+      if (d < st.dist[u]) {
+        st.dist[u] = d;
+        q.push(-d, Visit{d, u});
+        st.pushes++;
+      }
     }
-    int idx = m_used++;
-    m_backing[idx] = Node<T>{priority, t};
-    bubbleUpRecursive(idx);
   }
+  st.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return st;
+}
 
-  void dump(std::ostream& o) const {
-    o << "[";
-    for (size_t i = 0; i < m_used; ++i) {
-      if (i > 0) {
-        o << ", ";
+// Keeps at most one entry per vertex and lowers its key in place.
+DijkstraStats dijkstraDecreaseKey(const Graph& g) {
+  using Queue = PriorityQueue<uint32_t>;
+  size_t vertices = g.offsets.size() - 1;
+  DijkstraStats st{std::vector<int>(vertices, kUnreached), 0, 0, 0};
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Queue::Handle> handles(vertices);
+  std::vector<bool> queued(vertices, false);
+  Queue q(1024);
+  st.dist[0] = 0;
+  handles[0] = q.push(0, 0);
+  queued[0] = true;
+  st.pushes++;
+  while (!q.empty()) {
+    st.maxSize = std::max(st.maxSize, q.size());
+    uint32_t v = q.pop();
+    queued[v] = false;
+    for (size_t e = g.offsets[v]; e < g.offsets[v + 1]; ++e) {
+      int d = st.dist[v] + g.weights[e];
+      uint32_t u = g.targets[e];
+      if (d < st.dist[u]) {
+        st.dist[u] = d;
+        if (queued[u]) {
+          q.updatePriority(handles[u], -d);
+        } else {
+          handles[u] = q.push(-d, u);
+          queued[u] = true;
+          st.pushes++;
+        }
       }
-      o << m_backing[i].t;
     }
-    o << "]";
   }
+  st.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return st;
+}
+
+int benchDijkstra(uint32_t vertices, uint32_t degree) {
+  Graph g = randomGraph(vertices, degree);
+  std::cout << "Shortest paths on " << vertices << " vertices, " << g.targets.size() << " edges" << std::endl;
+  DijkstraStats lazy = dijkstraLazy(g);
+  std::cout << "  lazy duplicates: " << lazy.seconds * 1e3 << " ms, pushes=" << lazy.pushes
+            << ", max queue size=" << lazy.maxSize << std::endl;
+  DijkstraStats dk = dijkstraDecreaseKey(g);
+  std::cout << "  decrease-key: " << dk.seconds * 1e3 << " ms, pushes=" << dk.pushes
+            << ", max queue size=" << dk.maxSize << std::endl;
+  bool same = lazy.dist == dk.dist;
+  std::cout << "  same distances? " << same << std::endl;
+  return same ? 0 : 1;
+}
+
+// Adapts PriorityQueue, a max-heap on int, to the timer interface.
+template<size_t kArity>
+class HeapTimers {
+public:
+  using Handle = typename PriorityQueue<uint64_t, kArity>::Handle;
+
+  HeapTimers() : m_queue(1024) {}
+
+  bool empty() const { return m_queue.empty(); }
+  Handle push(uint64_t deadline, uint64_t t) { return m_queue.push(-int(deadline), t); }
+  uint64_t peekPriority() const { return -m_queue.priority(m_queue.topHandle()); }
+  uint64_t pop() { return m_queue.pop(); }
+  void cancel(Handle h) { m_queue.erase(h); }
 
 private:
-  void bubbleDownRecursive(size_t idx) {
-    assert(idx < m_used);
+  PriorityQueue<uint64_t, kArity> m_queue;
+};
 
-    size_t left = 2 * idx + 1;
-    size_t right = 2 * idx + 2;
-    size_t largest = idx;
+// Every tick inserts |perTick| timers, cancels a third of the previous tick's
+// timers and expires the ones that are due.
+template<typename Timers>
+void timerWorkload(const char* name, size_t ticks, size_t perTick, uint64_t horizon) {
+  Timers timers;
+  std::mt19937_64 rng(42);
+  std::vector<typename Timers::Handle> toCancel;
+  double insertSeconds = 0, cancelSeconds = 0, expireSeconds = 0;
+  size_t inserted = 0, cancelled = 0, expired = 0;
+  std::vector<uint64_t> deadlines(perTick);
+  for (uint64_t now = 1; now <= ticks; ++now) {
+    auto start = std::chrono::steady_clock::now();
+    for (typename Timers::Handle h : toCancel) {
+      timers.cancel(h);
+    }
+    cancelled += toCancel.size();
+    toCancel.clear();
+    auto mid = std::chrono::steady_clock::now();
+    cancelSeconds += std::chrono::duration<double>(mid - start).count();
 
-    if (left < m_used && m_backing[left].priority > m_backing[idx].priority) {
-      largest = left;
+    for (uint64_t& d : deadlines) {
+      d = now + 1 + rng() % horizon;
+    }
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < perTick; ++i) {
+      typename Timers::Handle h = timers.push(deadlines[i], i);
+      if (i % 3 == 0) {
+        toCancel.push_back(h);
+      }
     }
+    inserted += perTick;
+    mid = std::chrono::steady_clock::now();
+    insertSeconds += std::chrono::duration<double>(mid - start).count();
 
-    if (right < m_used && m_backing[right].priority >= m_backing[idx].priority) {
-      largest = right;
+    while (!timers.empty() && timers.peekPriority() <= now) {
+      timers.pop();
+      expired++;
     }
+    expireSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - mid).count();
+  }
+  std::cout << "  " << name << ": insert=" << (inserted / insertSeconds / 1e6)
+            << " Mops/s, cancel=" << (cancelled / cancelSeconds / 1e6)
+            << " Mops/s, expire=" << (expired / expireSeconds / 1e6) << " Mops/s" << std::endl;
+}
+
+int benchTimers(size_t ticks, size_t perTick) {
+  const uint64_t horizon = 1000;
+  std::cout << "Timers: " << ticks << " ticks, " << perTick << " timers per tick, deadlines up to "
+            << horizon << " ticks ahead" << std::endl;
+  timerWorkload<HeapTimers<2>>("binary heap", ticks, perTick, horizon);
+  timerWorkload<HeapTimers<4>>("4-ary heap", ticks, perTick, horizon);
+  timerWorkload<RadixHeap<uint64_t>>("radix heap", ticks, perTick, horizon);
+  return 0;
+}
 
-    if (largest != idx) {
-      Node<T> tmp = m_backing[largest];
-      m_backing[largest] = m_backing[idx];
-      m_backing[idx] = tmp;
-      bubbleDownRecursive(largest);
+// Counts, for every pop in global order, how many elements still queued had a
+// higher priority. |pops| holds the popped priorities (a permutation of
+// [0, n)) in the order they were popped.
+void rankErrors(const std::vector<int>& pops, double& mean, size_t& max) {
+  size_t n = pops.size();
+  // Fenwick tree over priorities still in the queue.
+  std::vector<int> tree(n + 1, 0);
+  auto add = [&](size_t i, int delta) {
+    for (++i; i <= n; i += i & -i) {
+      tree[i] += delta;
+    }
+  };
+  auto prefix = [&](size_t i) {
+    int sum = 0;
+    for (; i > 0; i -= i & -i) {
+      sum += tree[i];
     }
+    return sum;
+  };
+  for (size_t i = 0; i < n; ++i) {
+    add(i, 1);
   }
+  double total = 0;
+  max = 0;
+  size_t remaining = n;
+  for (int p : pops) {
+    // Elements with a priority strictly above |p| that are still queued.
+    size_t above = remaining - prefix(p + 1);
+    total += above;
+    max = std::max(max, above);
+    add(p, -1);
+    remaining--;
+  }
+  mean = total / n;
+}
+
+template<typename Q>
+void concurrentWorkload(const char* name, size_t threads, size_t elements) {
+  Q q(threads);
+  std::vector<int> priorities(elements);
+  std::iota(priorities.begin(), priorities.end(), 0);
+  std::shuffle(priorities.begin(), priorities.end(), std::mt19937(42));
 
-  void bubbleUpRecursive(size_t idx) {
-    if (idx == 0) {
-      return;
+  auto runThreads = [&](auto&& body) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads; ++t) {
+      workers.emplace_back(body, t);
     }
+    for (std::thread& w : workers) {
+      w.join();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  };
 
-    size_t parent = floor((idx - 1.0) / 2.0);
-    if (m_backing[parent].priority < m_backing[idx].priority) {
-      Node<T> tmp = m_backing[parent];
-      m_backing[parent] = m_backing[idx];
-      m_backing[idx] = tmp;
-      bubbleUpRecursive(parent);
+  double pushSeconds = runThreads([&](size_t t) {
+    for (size_t i = t; i < elements; i += threads) {
+      q.push(priorities[i], priorities[i]);
     }
+  });
+
+  // Tickets give a global pop order to compute rank errors.
+  std::vector<int> pops(elements);
+  std::atomic<size_t> ticket{0};
+  double popSeconds = runThreads([&](size_t) {
+    int v;
+    while (q.pop(v)) {
+      pops[ticket.fetch_add(1, std::memory_order_relaxed)] = v;
+    }
+  });
+  pops.resize(ticket.load());
+  double mean;
+  size_t max;
+  rankErrors(pops, mean, max);
+  std::cout << "    " << name << ": push=" << (elements / pushSeconds / 1e6) << " Mops/s, pop="
+            << (pops.size() / popSeconds / 1e6) << " Mops/s, rank error mean=" << mean
+            << " max=" << max << (pops.size() == elements ? "" : " (LOST ELEMENTS)") << std::endl;
+}
+
+int benchConcurrent(size_t elements) {
+  std::cout << "Concurrent push then pop of " << elements << " unique priorities" << std::endl;
+  for (size_t threads = 1; threads <= 64; threads *= 2) {
+    std::cout << "  threads=" << threads << std::endl;
+    concurrentWorkload<LockedPriorityQueue<int>>("locked PriorityQueue", threads, elements);
+    concurrentWorkload<ConcurrentPriorityQueue<int>>("MultiQueue c=2", threads, elements);
   }
+  return 0;
+}
 
-  void grow() {
-    // TODO: Magic constant.
-    size_t new_size = 2 * m_size;
-    // TODO: Use memset.
-    Node<T>* new_backing = new Node<T>[new_size];
-    for (size_t i = 0; i < m_used; ++i) {
-      new_backing[i] = m_backing[i];
+int benchRebuild(size_t size) {
+  std::mt19937 rng(42);
+  std::vector<Node<int>> nodes(size);
+  for (size_t i = 0; i < size; ++i) {
+    nodes[i] = Node<int>{int(rng()), int(i)};
+  }
+  auto seconds = [](std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  };
+  std::cout << "Rebuilding a queue of " << size << " elements" << std::endl;
+
+  auto start = std::chrono::steady_clock::now();
+  {
+    PriorityQueue<int> q(1);
+    for (const Node<int>& n : nodes) {
+      q.push(n.priority, n.t);
+    }
+    std::cout << "  " << size << " x push(): " << seconds(start) * 1e3 << " ms" << std::endl;
+    std::vector<int> out;
+    out.reserve(size);
+    start = std::chrono::steady_clock::now();
+    while (!q.empty()) {
+      out.push_back(q.pop());
     }
-    delete [] m_backing;
-    m_backing = new_backing;
-    m_size = new_size;
+    std::cout << "  " << size << " x pop(): " << seconds(start) * 1e3 << " ms" << std::endl;
   }
 
-  Node<T>* m_backing;
-  size_t m_used;
-  size_t m_size;
-};
+  start = std::chrono::steady_clock::now();
+  {
+    PriorityQueue<int> q(nodes);
+    std::cout << "  heapify constructor: " << seconds(start) * 1e3 << " ms" << std::endl;
+    std::vector<int> out;
+    start = std::chrono::steady_clock::now();
+    q.popBatch(size / 10, out);
+    std::cout << "  popBatch(10%): " << seconds(start) * 1e3 << " ms" << std::endl;
+    start = std::chrono::steady_clock::now();
+    q.popBatch(size, out);
+    std::cout << "  popBatch(rest): " << seconds(start) * 1e3 << " ms" << std::endl;
+  }
+
+  start = std::chrono::steady_clock::now();
+  {
+    PriorityQueue<int> q(1);
+    q.pushBatch(nodes.data(), size / 2);
+    q.pushBatch(nodes.data() + size / 2, size - size / 2);
+    std::cout << "  2 x pushBatch(50%): " << seconds(start) * 1e3 << " ms" << std::endl;
+  }
+  return 0;
+}
 
-template <typename U>
-std::ostream& operator<<(std::ostream& o, const PriorityQueue<U>& b) {
-  b.dump(o);
-  return o;
+// Runs the same random operations on both layouts, with payloads that own
+// memory, and checks they agree at every step.
+void testColumnar(size_t ops, uint64_t seed) {
+  PriorityQueue<std::string, 4, std::allocator<std::string>, RowLayout> row(1);
+  PriorityQueue<std::string, 4, std::allocator<std::string>, ColumnarLayout> columnar(1);
+  std::vector<size_t> handles;
+  std::mt19937_64 rng(seed);
+  // Distinct priorities, so that both layouts pop in the same order.
+  int next = 0;
+  auto priority = [&] { return int(rng() % 1000) * 1000000 + next++; };
+  for (size_t i = 0; i < ops; ++i) {
+    switch (rng() % 6) {
+      case 0:
+      case 1: {
+        int p = priority();
+        std::string payload(rng() % 40, 'a' + p % 26);
+        size_t h = row.push(p, payload);
+        size_t h2 = columnar.push(p, payload);
+        assert(h == h2);
+        (void)h2;
+        handles.push_back(h);
+        break;
+      }
+      case 2: {
+        std::string a = row.pop();
+        std::string b = columnar.pop();
+        assert(a == b);
+        (void)a;
+        (void)b;
+        break;
+      }
+      case 3:
+      case 4: {
+        if (handles.empty()) {
+          break;
+        }
+        size_t h = handles[rng() % handles.size()];
+        assert(row.contains(h) == columnar.contains(h));
+        if (!row.contains(h)) {
+          break;
+        }
+        if (rng() % 2) {
+          int p = priority();
+          row.updatePriority(h, p);
+          columnar.updatePriority(h, p);
+          assert(columnar.priority(h) == p);
+        } else {
+          row.erase(h);
+          columnar.erase(h);
+        }
+        break;
+      }
+      default: {
+        std::vector<Node<std::string>> batch(rng() % 8);
+        for (Node<std::string>& n : batch) {
+          n.priority = priority();
+          n.t = std::to_string(n.priority);
+        }
+        std::vector<size_t> a, b;
+        row.pushBatch(batch, &a);
+        columnar.pushBatch(batch, &b);
+        assert(a == b);
+        handles.insert(handles.end(), a.begin(), a.end());
+        break;
+      }
+    }
+    assert(row.size() == columnar.size());
+    assert(row.empty() || row.peek() == columnar.peek());
+  }
+  size_t left = row.size();
+  std::vector<std::string> a, b;
+  row.popBatch(left / 2, a);
+  columnar.popBatch(left / 2, b);
+  row.popBatch(left, a);
+  columnar.popBatch(left, b);
+  assert(a == b && a.size() == left && columnar.empty());
+  std::cout << "Columnar PriorityQueue matches the row layout after " << ops << " ops, drained " << left
+            << " elements" << std::endl;
 }
 
-int main() {
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "bench") {
+    return bench(argc > 2 ? std::stoull(argv[2]) : 10000000);
+  }
+  if (argc > 1 && std::string(argv[1]) == "dijkstra") {
+    return benchDijkstra(argc > 2 ? std::stoul(argv[2]) : 1000000, argc > 3 ? std::stoul(argv[3]) : 10);
+  }
+  if (argc > 1 && std::string(argv[1]) == "timers") {
+    return benchTimers(argc > 2 ? std::stoull(argv[2]) : 10000, argc > 3 ? std::stoull(argv[3]) : 1000);
+  }
+  if (argc > 1 && std::string(argv[1]) == "concurrent") {
+    return benchConcurrent(argc > 2 ? std::stoull(argv[2]) : 1000000);
+  }
+  if (argc > 1 && std::string(argv[1]) == "rebuild") {
+    return benchRebuild(argc > 2 ? std::stoull(argv[2]) : 10000000);
+  }
+
   PriorityQueue<int> q(1);
   std::cout << "Empty PriorityQueue: " << q << std::endl;
   std::cout << "PriorityQueue.empty()? " << q.empty() << std::endl;
@@ -163,5 +539,98 @@ int main() {
   std::cout << "PriorityQueue after popped 10: " << q << std::endl;
   std::cout << "PriorityQueue.peek() after popped 10: " << q.peek() << std::endl;
 
+  PriorityQueue<int, 8> wide(1);
+  for (int i = 0; i < 100; ++i) {
+    wide.push((i * 37) % 100, (i * 37) % 100);
+  }
+  bool ordered = true;
+  int last = wide.pop();
+  while (!wide.empty()) {
+    int curr = wide.pop();
+    ordered = ordered && curr <= last;
+    last = curr;
+  }
+  std::cout << "8-ary PriorityQueue popped 100 elements in order? " << ordered << std::endl;
+
+  PriorityQueue<int> a(1);
+  PriorityQueue<int>::Handle h5 = a.push(5, 5);
+  PriorityQueue<int>::Handle h10 = a.push(10, 10);
+  a.push(15, 15);
+  a.updatePriority(h5, 20);
+  std::cout << "PriorityQueue.peek() after raising 5 above 15: " << a.peek() << std::endl;
+  a.erase(h10);
+  std::cout << "PriorityQueue after erasing 10: " << a << ", contains 10? " << a.contains(h10) << std::endl;
+
+  // Erased payloads are released right away, whether or not they were last.
+  std::shared_ptr<int> resource = std::make_shared<int>(0);
+  PriorityQueue<std::shared_ptr<int>> owners(4);
+  PriorityQueue<std::shared_ptr<int>>::Handle first = owners.push(1, resource);
+  PriorityQueue<std::shared_ptr<int>>::Handle second = owners.push(2, resource);
+  owners.push(3, nullptr);
+  owners.erase(first);
+  owners.erase(second);
+  std::cout << "PriorityQueue released erased payloads? " << (resource.use_count() == 1) << std::endl;
+  assert(resource.use_count() == 1);
+
+  RadixHeap<int> timers;
+  timers.push(30, 30);
+  RadixHeap<int>::Handle h20 = timers.push(20, 20);
+  timers.push(10, 10);
+  timers.push(25, 25);
+  std::cout << "RadixHeap after pushing 30, 20, 10, 25: " << timers << std::endl;
+  std::cout << "RadixHeap.pop(): " << timers.pop() << std::endl;
+  timers.cancel(h20);
+  std::cout << "RadixHeap after cancelling 20: " << timers << std::endl;
+  std::cout << "RadixHeap.pop(): " << timers.pop() << ", then: " << timers.pop()
+            << ", empty()? " << timers.empty() << std::endl;
+
+  ConcurrentPriorityQueue<int> mq(4);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < 4; ++t) {
+    workers.emplace_back([&mq, t] {
+      for (int i = 0; i < 100; ++i) {
+        mq.push(t * 100 + i, t * 100 + i);
+      }
+    });
+  }
+  for (std::thread& w : workers) {
+    w.join();
+  }
+  long long sum = 0;
+  int v;
+  while (mq.pop(v)) {
+    sum += v;
+  }
+  std::cout << "ConcurrentPriorityQueue popped sum: " << sum << " (expected 79800)" << std::endl;
+
+  // The lowest priority must not read as an empty shard.
+  ConcurrentPriorityQueue<int> lowest(4);
+  for (int i = 0; i < 100; ++i) {
+    lowest.push(std::numeric_limits<int>::min(), i);
+  }
+  int lowestPopped = 0;
+  while (lowest.pop(v)) {
+    ++lowestPopped;
+  }
+  std::cout << "ConcurrentPriorityQueue popped " << lowestPopped << " of 100 INT_MIN priorities" << std::endl;
+  assert(lowestPopped == 100 && lowest.empty());
+
+  std::vector<Node<int>> nodes;
+  for (int i = 0; i < 10; ++i) {
+    nodes.push_back(Node<int>{(i * 7) % 10, (i * 7) % 10});
+  }
+  PriorityQueue<int> heapified(nodes);
+  heapified.pushBatch(std::vector<Node<int>>{{42, 42}, {-1, -1}});
+  std::vector<int> drained;
+  heapified.popBatch(3, drained);
+  heapified.popBatch(100, drained);
+  std::cout << "PriorityQueue heapified, batch pushed 42 and -1 then drained:";
+  for (int d : drained) {
+    std::cout << " " << d;
+  }
+  std::cout << std::endl;
+
+  testColumnar(100000, 7);
+
   return 0;
 }
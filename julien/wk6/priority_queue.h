@@ -0,0 +1,905 @@
+// PriorityQueue, RadixHeap, ConcurrentPriorityQueue and the baselines used by
+// the benchmarks, see priority_queue.cc for a demo.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "../memory/allocators.h"
+#include "../memory/layout.h"
+
+template<typename T>
+struct Node {
+  int priority;
+  T t;
+};
+
+// Max-heap where every node has kArity children. With kArity = 4 or 8 the
+// children of a node share a cache line so a sift down touches one line per
+// level, and the tree is log2(kArity) times shallower than a binary heap.
+//
+// push() returns a Handle which stays valid until its element is popped or
+// erased, so that priorities can be updated in place instead of pushing
+// duplicates. The heap keeps a handle -> position index in sync during sifts.
+//
+// Layout is RowLayout or ColumnarLayout, see layout.h. With the latter the
+// heap is an array of bare priorities, 16 per cache line, and payloads sit in
+// a vector indexed by handle which sifts never touch. Like the heap array, that
+// vector reallocates as it grows: references from top() don't survive push().
+template<typename T, size_t kArity = 4, typename Allocator = std::allocator<T>, typename Layout = RowLayout>
+class PriorityQueue {
+  static_assert(kArity >= 2, "A heap needs at least 2 children per node");
+  static constexpr bool kColumnar = std::is_same_v<Layout, ColumnarLayout>;
+  static_assert(kColumnar || std::is_same_v<Layout, RowLayout>, "Unknown layout");
+
+  // What the heap array holds, and what a sift carries around.
+  using Slot = std::conditional_t<kColumnar, int, Node<T>>;
+  static constexpr size_t kCacheLineSize = 64;
+  static constexpr size_t kNodesPerLine =
+    sizeof(Slot) < kCacheLineSize ? kCacheLineSize / sizeof(Slot) : 1;
+
+  using IndexVector = std::vector<size_t, RebindAlloc<Allocator, size_t>>;
+
+public:
+  using Handle = size_t;
+  static constexpr size_t kInvalidPosition = static_cast<size_t>(-1);
+
+  PriorityQueue(size_t min_size, const Allocator& alloc = Allocator())
+    : m_alloc(alloc), m_raw(nullptr), m_backing(nullptr), m_used(0), m_size(min_size)
+    , m_handles(alloc), m_positions(alloc), m_freeHandles(alloc), m_payloads(alloc) {
+      assert(m_size > 0);
+      allocate(m_size);
+      m_handles.resize(m_size);
+    }
+
+  // Builds the heap from |count| nodes in O(n) with Floyd's heapify. The
+  // handle of nodes[i] is i.
+  PriorityQueue(const Node<T>* nodes, size_t count, const Allocator& alloc = Allocator())
+    : PriorityQueue(std::max<size_t>(count, 1), alloc) {
+      pushBatch(nodes, count);
+    }
+
+  PriorityQueue(const std::vector<Node<T>>& nodes, const Allocator& alloc = Allocator())
+    : PriorityQueue(nodes.data(), nodes.size(), alloc) {}
+
+  ~PriorityQueue() {
+    deleteArray(m_alloc, m_raw, m_size + kNodesPerLine);
+  }
+
+  // Make non-copiable for now.
+  PriorityQueue(const PriorityQueue&) = delete;
+  void operator=(const PriorityQueue&) = delete;
+
+  bool empty() const { return m_used == 0; }
+  size_t size() const { return m_used; }
+
+  T pop() {
+    if (empty()) {
+      // TODO: Throw!
+      return T{};
+    }
+
+    T res = std::move(payload(0));
+    releaseHandle(m_handles[0]);
+    m_used--;
+    if (m_used > 0) {
+      moveNode(0, m_used);
+      siftDown(0);
+    }
+    return res;
+  }
+
+  T peek() const {
+    if (empty()) {
+      // TODO: Throw!
+      return T{};
+    }
+
+    return payload(0);
+  }
+
+  Handle push(int priority, T t) {
+    if (m_used == m_size) {
+      grow();
+    }
+    size_t idx = m_used++;
+    Handle h = acquireHandle();
+    store(idx, Node<T>{priority, std::move(t)}, h);
+    siftUp(idx);
+    return h;
+  }
+
+  // Pushes |count| nodes with at most one reallocation. A batch at least as
+  // big as the queue rebuilds the heap in O(n + count) rather than sifting
+  // every node up. If |handles| is set it receives the handle of each node.
+  void pushBatch(const Node<T>* nodes, size_t count, Handle* handles = nullptr) {
+    reserve(m_used + count);
+    size_t start = m_used;
+    for (size_t i = 0; i < count; ++i) {
+      Handle h = acquireHandle();
+      store(m_used++, Node<T>(nodes[i]), h);
+      if (handles) {
+        handles[i] = h;
+      }
+    }
+    if (count >= start) {
+      heapify();
+    } else {
+      for (size_t i = start; i < m_used; ++i) {
+        siftUp(i);
+      }
+    }
+  }
+
+  void pushBatch(const std::vector<Node<T>>& nodes, std::vector<Handle>* handles = nullptr) {
+    if (handles) {
+      handles->resize(nodes.size());
+    }
+    pushBatch(nodes.data(), nodes.size(), handles ? handles->data() : nullptr);
+  }
+
+  // Pops up to |k| elements in priority order, appends them to |out| and
+  // returns how many were popped.
+  size_t popBatch(size_t k, std::vector<T>& out) {
+    k = std::min(k, m_used);
+    out.reserve(out.size() + k);
+    if (k > 0 && k == m_used) {
+      // Draining everything: one sort is cheaper than n sifts.
+      for (size_t i = 0; i < m_used; ++i) {
+        releaseHandle(m_handles[i]);
+      }
+      if constexpr (kColumnar) {
+        // Sort the positions and leave the payloads where they are.
+        std::vector<size_t> order(m_used);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return m_backing[a] > m_backing[b]; });
+        for (size_t i : order) {
+          out.push_back(std::move(payload(i)));
+        }
+      } else {
+        std::sort(m_backing, m_backing + m_used, [](const Node<T>& a, const Node<T>& b) {
+          return a.priority > b.priority;
+        });
+        for (size_t i = 0; i < m_used; ++i) {
+          out.push_back(std::move(m_backing[i].t));
+        }
+      }
+      m_used = 0;
+      return k;
+    }
+    for (size_t i = 0; i < k; ++i) {
+      out.push_back(pop());
+    }
+    return k;
+  }
+
+  // Makes room for |size| elements with a single reallocation.
+  void reserve(size_t size) {
+    if (size > m_size) {
+      resize(std::max(size, 2 * m_size));
+    }
+  }
+
+  Handle topHandle() const {
+    assert(!empty());
+    return m_handles[0];
+  }
+
+  // Whether |h| still refers to an element of the queue.
+  bool contains(Handle h) const {
+    return h < m_positions.size() && m_positions[h] != kInvalidPosition;
+  }
+
+  int priority(Handle h) const {
+    assert(contains(h));
+    return priorityAt(m_positions[h]);
+  }
+
+  // O(log n), works both for increasing and decreasing the priority.
+  void updatePriority(Handle h, int priority) {
+    assert(contains(h));
+    size_t idx = m_positions[h];
+    int old = priorityAt(idx);
+    priorityAt(idx) = priority;
+    if (priority > old) {
+      siftUp(idx);
+    } else if (priority < old) {
+      siftDown(idx);
+    }
+  }
+
+  // O(log n), removes the element referred to by |h|.
+  void erase(Handle h) {
+    assert(contains(h));
+    size_t idx = m_positions[h];
+    if constexpr (kColumnar) {
+      // Nothing else would release its resources before the handle is reused.
+      m_payloads[h] = T{};
+    }
+    releaseHandle(h);
+    m_used--;
+    if (idx != m_used) {
+      int old = priorityAt(idx);
+      moveNode(idx, m_used);
+      if (priorityAt(idx) > old) {
+        siftUp(idx);
+      } else {
+        siftDown(idx);
+      }
+    }
+    if constexpr (!kColumnar) {
+      // The vacated slot holds the erased payload, or whatever the move into
+      // its place left behind: release it rather than wait for a push.
+      m_backing[m_used] = Slot{};
+    }
+  }
+
+  void dump(std::ostream& o) const {
+    o << "[";
+    for (size_t i = 0; i < m_used; ++i) {
+      if (i > 0) {
+        o << ", ";
+      }
+      o << payload(i);
+    }
+    o << "]";
+  }
+
+private:
+  static size_t parent(size_t idx) { return (idx - 1) / kArity; }
+  static size_t firstChild(size_t idx) { return kArity * idx + 1; }
+
+  static int priorityOf(const Slot& n) {
+    if constexpr (kColumnar) {
+      return n;
+    } else {
+      return n.priority;
+    }
+  }
+
+  int& priorityAt(size_t idx) {
+    if constexpr (kColumnar) {
+      return m_backing[idx];
+    } else {
+      return m_backing[idx].priority;
+    }
+  }
+
+  int priorityAt(size_t idx) const { return priorityOf(m_backing[idx]); }
+
+  T& payload(size_t idx) {
+    if constexpr (kColumnar) {
+      return m_payloads[m_handles[idx]];
+    } else {
+      return m_backing[idx].t;
+    }
+  }
+
+  const T& payload(size_t idx) const {
+    if constexpr (kColumnar) {
+      return m_payloads[m_handles[idx]];
+    } else {
+      return m_backing[idx].t;
+    }
+  }
+
+  Handle acquireHandle() {
+    if (m_freeHandles.empty()) {
+      m_positions.push_back(kInvalidPosition);
+      if constexpr (kColumnar) {
+        m_payloads.emplace_back();
+      }
+      return m_positions.size() - 1;
+    }
+    Handle h = m_freeHandles.back();
+    m_freeHandles.pop_back();
+    return h;
+  }
+
+  void releaseHandle(Handle h) {
+    m_positions[h] = kInvalidPosition;
+    m_freeHandles.push_back(h);
+  }
+
+  // Moves the node at |from| to |to|, keeping its handle in sync.
+  void moveNode(size_t to, size_t from) {
+    m_backing[to] = std::move(m_backing[from]);
+    m_handles[to] = m_handles[from];
+    m_positions[m_handles[to]] = to;
+  }
+
+  void place(size_t idx, Slot&& n, Handle h) {
+    m_backing[idx] = std::move(n);
+    m_handles[idx] = h;
+    m_positions[h] = idx;
+  }
+
+  // Places a new element, whose payload goes apart in the columnar layout.
+  void store(size_t idx, Node<T>&& n, Handle h) {
+    if constexpr (kColumnar) {
+      m_payloads[h] = std::move(n.t);
+      place(idx, int(n.priority), h);
+    } else {
+      place(idx, std::move(n), h);
+    }
+  }
+
+  // Sifts move a hole instead of swapping: the sifted node is only written
+  // once it reaches its final position.
+  void siftUp(size_t idx) {
+    Slot n = std::move(m_backing[idx]);
+    Handle h = m_handles[idx];
+    while (idx > 0) {
+      size_t p = parent(idx);
+      if (!(priorityAt(p) < priorityOf(n))) {
+        break;
+      }
+      moveNode(idx, p);
+      idx = p;
+    }
+    place(idx, std::move(n), h);
+  }
+
+  // Bottom-up sift: the hole first sinks to a leaf following the largest
+  // children, then |n| is sifted up from there. The node moved to the root by
+  // pop() comes from the bottom and almost always belongs near it, so this
+  // saves comparing it at every level.
+  void siftDown(size_t idx) {
+    assert(idx < m_used);
+
+    Slot n = std::move(m_backing[idx]);
+    Handle h = m_handles[idx];
+    size_t start = idx;
+    while (true) {
+      size_t first = firstChild(idx);
+      if (first >= m_used) {
+        break;
+      }
+      size_t largest = first;
+      int best = priorityAt(first);
+      // Fixed trip count when all children exist so that the loop unrolls.
+      size_t last = first + kArity <= m_used ? first + kArity : m_used;
+      for (size_t c = first + 1; c < last; ++c) {
+        int priority = priorityAt(c);
+        // Written as selects so that it compiles to cmovs, the outcome is
+        // unpredictable for random priorities.
+        bool larger = priority > best;
+        best = larger ? priority : best;
+        largest = larger ? c : largest;
+      }
+      moveNode(idx, largest);
+      idx = largest;
+    }
+    while (idx > start) {
+      size_t p = parent(idx);
+      if (!(priorityAt(p) < priorityOf(n))) {
+        break;
+      }
+      moveNode(idx, p);
+      idx = p;
+    }
+    place(idx, std::move(n), h);
+  }
+
+  // Offsets m_backing so that the children of every node, which start at
+  // kArity * idx + 1, begin on a cache line boundary when the node size allows.
+  void allocate(size_t size) {
+    m_raw = newArray(m_alloc, size + kNodesPerLine);
+    m_backing = m_raw;
+    for (size_t i = 0; i < kNodesPerLine; ++i) {
+      if (reinterpret_cast<uintptr_t>(m_raw + i + 1) % kCacheLineSize == 0) {
+        m_backing = m_raw + i;
+        break;
+      }
+    }
+  }
+
+  // Floyd's heapify: sift down every internal node, deepest first.
+  void heapify() {
+    if (m_used < 2) {
+      return;
+    }
+    for (size_t i = parent(m_used - 1) + 1; i > 0; --i) {
+      siftDown(i - 1);
+    }
+  }
+
+  void grow() {
+    // TODO: Magic constant.
+    resize(2 * m_size);
+  }
+
+  void resize(size_t new_size) {
+    assert(new_size >= m_used);
+    Slot* old_raw = m_raw;
+    Slot* old_backing = m_backing;
+    allocate(new_size);
+    std::move(old_backing, old_backing + m_used, m_backing);
+    deleteArray(m_alloc, old_raw, m_size + kNodesPerLine);
+    m_handles.resize(new_size);
+    m_size = new_size;
+  }
+
+  RebindAlloc<Allocator, Slot> m_alloc;
+  Slot* m_raw;
+  Slot* m_backing;
+  size_t m_used;
+  size_t m_size;
+  // Heap position -> handle, parallel to m_backing.
+  IndexVector m_handles;
+  // Handle -> heap position, or kInvalidPosition once popped/erased.
+  IndexVector m_positions;
+  IndexVector m_freeHandles;
+  // Handle -> payload, only used by the columnar layout.
+  std::vector<T, RebindAlloc<Allocator, T>> m_payloads;
+};
+
+template <typename U, size_t kArity, typename A, typename L>
+std::ostream& operator<<(std::ostream& o, const PriorityQueue<U, kArity, A, L>& b) {
+  b.dump(o);
+  return o;
+}
+
+// Monotone min-queue for integer priorities such as timer deadlines: pop()
+// returns the smallest priority first and no priority below the last popped
+// one may be pushed. Entries live in 65 buckets by the highest bit where they
+// differ from the last popped key. pop() only redistributes the first
+// non-empty bucket into lower ones and every entry moves at most 64 times,
+// so push/pop are amortized O(1) instead of a heap's O(log n).
+//
+// Same Handle scheme as PriorityQueue so that timers can be cancelled.
+template<typename T>
+class RadixHeap {
+  static constexpr int kBuckets = 65;
+  static constexpr uint64_t kNoPriority = std::numeric_limits<uint64_t>::max();
+
+  struct Entry {
+    uint64_t priority;
+    T t;
+    size_t handle;
+  };
+
+  struct Location {
+    int bucket;
+    size_t idx;
+  };
+
+public:
+  using Handle = size_t;
+
+  RadixHeap() : m_last(0), m_used(0) {
+    for (int b = 0; b < kBuckets; ++b) {
+      m_bucketMin[b] = kNoPriority;
+      m_bucketMinDirty[b] = false;
+    }
+  }
+
+  // Make non-copiable for now.
+  RadixHeap(const RadixHeap&) = delete;
+  void operator=(const RadixHeap&) = delete;
+
+  bool empty() const { return m_used == 0; }
+  size_t size() const { return m_used; }
+  // The smallest priority that can still be pushed.
+  uint64_t lastPopped() const { return m_last; }
+
+  Handle push(uint64_t priority, T t) {
+    assert(priority >= m_last);
+    Handle h = acquireHandle();
+    insert(Entry{priority, std::move(t), h});
+    m_used++;
+    return h;
+  }
+
+  T pop() {
+    if (empty()) {
+      // TODO: Throw!
+      return T{};
+    }
+
+    refill();
+    Entry e = std::move(m_buckets[0].back());
+    m_buckets[0].pop_back();
+    if (m_buckets[0].empty()) {
+      m_bucketMin[0] = kNoPriority;
+    }
+    releaseHandle(e.handle);
+    m_used--;
+    return std::move(e.t);
+  }
+
+  T peek() const {
+    if (empty()) {
+      // TODO: Throw!
+      return T{};
+    }
+
+    return m_buckets[minBucket()][minIndex(minBucket())].t;
+  }
+
+  // Cheaper than peek() as every bucket caches its minimum priority.
+  uint64_t peekPriority() const {
+    assert(!empty());
+    return bucketMin(minBucket());
+  }
+
+  bool contains(Handle h) const {
+    return h < m_locations.size() && m_locations[h].bucket >= 0;
+  }
+
+  // O(1): swap-removes the entry from its bucket.
+  void cancel(Handle h) {
+    assert(contains(h));
+    Location loc = m_locations[h];
+    std::vector<Entry>& bucket = m_buckets[loc.bucket];
+    uint64_t priority = bucket[loc.idx].priority;
+    if (loc.idx != bucket.size() - 1) {
+      bucket[loc.idx] = std::move(bucket.back());
+      m_locations[bucket[loc.idx].handle].idx = loc.idx;
+    }
+    bucket.pop_back();
+    if (bucket.empty()) {
+      m_bucketMin[loc.bucket] = kNoPriority;
+      m_bucketMinDirty[loc.bucket] = false;
+    } else if (priority == m_bucketMin[loc.bucket]) {
+      m_bucketMinDirty[loc.bucket] = true;
+    }
+    releaseHandle(h);
+    m_used--;
+  }
+
+  void dump(std::ostream& o) const {
+    o << "[";
+    bool addComma = false;
+    for (const std::vector<Entry>& bucket : m_buckets) {
+      for (const Entry& e : bucket) {
+        if (addComma) {
+          o << ", ";
+        }
+        o << e.t;
+        addComma = true;
+      }
+    }
+    o << "] (last=" << m_last << ")";
+  }
+
+private:
+  int bucketFor(uint64_t priority) const {
+    return priority == m_last ? 0 : 64 - __builtin_clzll(priority ^ m_last);
+  }
+
+  void insert(Entry&& e) {
+    int b = bucketFor(e.priority);
+    m_locations[e.handle] = Location{b, m_buckets[b].size()};
+    m_bucketMin[b] = std::min(m_bucketMin[b], e.priority);
+    m_buckets[b].push_back(std::move(e));
+  }
+
+  uint64_t bucketMin(int b) const {
+    if (m_bucketMinDirty[b]) {
+      m_bucketMin[b] = m_buckets[b][minIndex(b)].priority;
+      m_bucketMinDirty[b] = false;
+    }
+    return m_bucketMin[b];
+  }
+
+  int minBucket() const {
+    int b = 0;
+    while (m_buckets[b].empty()) {
+      ++b;
+    }
+    return b;
+  }
+
+  size_t minIndex(int b) const {
+    const std::vector<Entry>& bucket = m_buckets[b];
+    size_t best = 0;
+    for (size_t i = 1; i < bucket.size(); ++i) {
+      if (bucket[i].priority < bucket[best].priority) {
+        best = i;
+      }
+    }
+    return best;
+  }
+
+  // Makes sure bucket 0 holds the minimum by moving m_last to it and
+  // redistributing the first non-empty bucket.
+  void refill() {
+    if (!m_buckets[0].empty()) {
+      return;
+    }
+    int b = minBucket();
+    m_last = bucketMin(b);
+    std::vector<Entry> entries;
+    entries.swap(m_buckets[b]);
+    m_bucketMin[b] = kNoPriority;
+    for (Entry& e : entries) {
+      // Every entry lands in a lower bucket as they now share the bits above b.
+      insert(std::move(e));
+    }
+    // Keep the capacity around for the next time this bucket fills up.
+    entries.clear();
+    m_buckets[b].swap(entries);
+    assert(m_buckets[b].empty());
+  }
+
+  Handle acquireHandle() {
+    if (m_freeHandles.empty()) {
+      m_locations.push_back(Location{-1, 0});
+      return m_locations.size() - 1;
+    }
+    Handle h = m_freeHandles.back();
+    m_freeHandles.pop_back();
+    return h;
+  }
+
+  void releaseHandle(Handle h) {
+    m_locations[h].bucket = -1;
+    m_freeHandles.push_back(h);
+  }
+
+  uint64_t m_last;
+  size_t m_used;
+  std::vector<Entry> m_buckets[kBuckets];
+  // Lazily recomputed after cancelling the minimum of a bucket.
+  mutable uint64_t m_bucketMin[kBuckets];
+  mutable bool m_bucketMinDirty[kBuckets];
+  std::vector<Location> m_locations;
+  std::vector<Handle> m_freeHandles;
+};
+
+template <typename U>
+std::ostream& operator<<(std::ostream& o, const RadixHeap<U>& b) {
+  b.dump(o);
+  return o;
+}
+
+// Relaxed concurrent max-queue (MultiQueue): c * P PriorityQueue shards each
+// behind a try-lock. push() goes to a random shard and pop() samples two
+// random shards and takes the better top. Elements come out in roughly, not
+// strictly, descending priority in exchange for near-linear scaling.
+template<typename T>
+class ConcurrentPriorityQueue {
+  // Below every int priority, INT_MIN included.
+  static constexpr int64_t kEmptyTop = std::numeric_limits<int64_t>::min();
+  // Failed pop attempts before checking whether every shard is empty.
+  static constexpr int kAttemptsBeforeScan = 8;
+
+  struct alignas(64) Shard {
+    Shard() : queue(64), top(kEmptyTop) {}
+    std::mutex mutex;
+    PriorityQueue<T> queue;
+    // Top priority readable without the lock, only a hint for pop(), or
+    // kEmptyTop. Wider than a priority so that every priority can be pushed.
+    std::atomic<int64_t> top;
+  };
+
+public:
+  // |threads| is the expected number of threads and |c| the number of shards
+  // per thread. More shards means less contention but larger rank errors.
+  ConcurrentPriorityQueue(size_t threads, size_t c = 2)
+    : m_shards(std::max<size_t>(2, c * threads)) {}
+
+  // Make non-copiable for now.
+  ConcurrentPriorityQueue(const ConcurrentPriorityQueue&) = delete;
+  void operator=(const ConcurrentPriorityQueue&) = delete;
+
+  void push(int priority, T t) {
+    while (true) {
+      Shard& s = m_shards[randomShard()];
+      std::unique_lock<std::mutex> lock(s.mutex, std::try_to_lock);
+      if (!lock.owns_lock()) {
+        continue;
+      }
+      s.queue.push(priority, std::move(t));
+      updateTop(s);
+      return;
+    }
+  }
+
+  // Returns false if every shard looked empty. Concurrent pushes may make it
+  // miss elements, like any non-linearizable emptiness check.
+  bool pop(T& out) {
+    int attempts = 0;
+    while (true) {
+      if (++attempts % kAttemptsBeforeScan == 0 && allEmpty()) {
+        return false;
+      }
+      size_t i = randomShard();
+      size_t j = randomShard();
+      int64_t ti = m_shards[i].top.load(std::memory_order_relaxed);
+      int64_t tj = m_shards[j].top.load(std::memory_order_relaxed);
+      if (ti == kEmptyTop && tj == kEmptyTop) {
+        continue;
+      }
+      Shard& s = m_shards[ti >= tj ? i : j];
+      std::unique_lock<std::mutex> lock(s.mutex, std::try_to_lock);
+      if (!lock.owns_lock() || s.queue.empty()) {
+        continue;
+      }
+      out = s.queue.pop();
+      updateTop(s);
+      return true;
+    }
+  }
+
+  bool empty() const { return allEmpty(); }
+
+private:
+  static void updateTop(Shard& s) {
+    int64_t top = s.queue.empty() ? kEmptyTop : s.queue.priority(s.queue.topHandle());
+    s.top.store(top, std::memory_order_relaxed);
+  }
+
+  bool allEmpty() const {
+    for (const Shard& s : m_shards) {
+      if (s.top.load(std::memory_order_relaxed) != kEmptyTop) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  size_t randomShard() const {
+    // xorshift, seeded per thread.
+    thread_local uint64_t state = 0x9e3779b97f4a7c15ULL ^ std::hash<std::thread::id>{}(std::this_thread::get_id());
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state % m_shards.size();
+  }
+
+  std::vector<Shard> m_shards;
+};
+
+// A single PriorityQueue behind a mutex, the strict baseline for the benchmark.
+template<typename T>
+class LockedPriorityQueue {
+public:
+  LockedPriorityQueue(size_t /*threads*/) : m_queue(64) {}
+
+  void push(int priority, T t) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.push(priority, std::move(t));
+  }
+
+  bool pop(T& out) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_queue.empty()) {
+      return false;
+    }
+    out = m_queue.pop();
+    return true;
+  }
+
+private:
+  std::mutex m_mutex;
+  PriorityQueue<T> m_queue;
+};
+
+// The previous recursive binary heap, kept as a baseline for the benchmark.
+template<typename T>
+class RecursivePriorityQueue {
+public:
+  RecursivePriorityQueue(size_t min_size)
+    : m_used(0), m_size(min_size) {
+      assert(m_size > 0);
+      m_backing = new Node<T>[m_size];
+    }
+
+  ~RecursivePriorityQueue() {
+    delete [] m_backing;
+  }
+
+  bool empty() const { return m_used == 0; }
+
+  T pop() {
+    if (empty()) {
+      // TODO: Throw!
+      return T{};
+    }
+
+    Node<T> res = m_backing[0];
+    m_used--;
+    if (m_used > 0) {
+      m_backing[0] = m_backing[m_used];
+      bubbleDownRecursive(0);
+    }
+    return res.t;
+  }
+
+  T peek() const {
+    if (empty()) {
+      // TODO: Throw!
+      return T{};
+    }
+
+    return m_backing[0].t;
+  }
+
+  void push(int priority, T t) {
+    if (m_used == m_size) {
+      grow();
+    }
+    int idx = m_used++;
+    m_backing[idx] = Node<T>{priority, t};
+    bubbleUpRecursive(idx);
+  }
+
+  void dump(std::ostream& o) const {
+    o << "[";
+    for (size_t i = 0; i < m_used; ++i) {
+      if (i > 0) {
+        o << ", ";
+      }
+      o << m_backing[i].t;
+    }
+    o << "]";
+  }
+
+private:
+  void bubbleDownRecursive(size_t idx) {
+    assert(idx < m_used);
+
+    size_t left = 2 * idx + 1;
+    size_t right = 2 * idx + 2;
+    size_t largest = idx;
+
+    if (left < m_used && m_backing[left].priority > m_backing[idx].priority) {
+      largest = left;
+    }
+
+    if (right < m_used && m_backing[right].priority > m_backing[largest].priority) {
+      largest = right;
+    }
+
+    if (largest != idx) {
+      Node<T> tmp = m_backing[largest];
+      m_backing[largest] = m_backing[idx];
+      m_backing[idx] = tmp;
+      bubbleDownRecursive(largest);
+    }
+  }
+
+  void bubbleUpRecursive(size_t idx) {
+    if (idx == 0) {
+      return;
+    }
+
+    size_t parent = floor((idx - 1.0) / 2.0);
+    if (m_backing[parent].priority < m_backing[idx].priority) {
+      Node<T> tmp = m_backing[parent];
+      m_backing[parent] = m_backing[idx];
+      m_backing[idx] = tmp;
+      bubbleUpRecursive(parent);
+    }
+  }
+
+  void grow() {
+    // TODO: Magic constant.
+    size_t new_size = 2 * m_size;
+    // TODO: Use memset.
+    Node<T>* new_backing = new Node<T>[new_size];
+    for (size_t i = 0; i < m_used; ++i) {
+      new_backing[i] = m_backing[i];
+    }
+    delete [] m_backing;
+    m_backing = new_backing;
+    m_size = new_size;
+  }
+
+  Node<T>* m_backing;
+  size_t m_used;
+  size_t m_size;
+};
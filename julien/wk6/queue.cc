@@ -1,100 +1,86 @@
 // Build using:
 //   g++ -Wall -Werror --sanitize=address -g -o queue queue.cc && ./queue
+// Benchmark using:
+//   g++ -Wall -Werror -O2 -DNDEBUG -o queue queue.cc && ./queue bench [pushes]
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <iostream>
 #include <numeric>
+#include <string>
 #include <vector>
 
-template<typename T>
-class Queue {
-public:
-  Queue(size_t min_size)
-    : m_read(0), m_wrote(0), m_size(min_size) {
-      assert(m_size > 0);
-      m_backing = new T[m_size];
-    }
-
-  ~Queue() {
-    delete [] m_backing;
-  }
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
-  bool empty() const { return m_read == m_wrote; }
+#include "queue.h"
 
-  T pop() {
-    if (empty()) {
-      // TODO: Throw!
-      return T{};
+// Evaluated by the compiler: FIFO order across the wrap of a 3 element ring.
+constexpr int fixedQueueChecksum() {
+  FixedQueue<int, 3> q;
+  int sum = 0;
+  for (int i = 1; i <= 10; ++i) {
+    q.push(i);
+    if (q.full()) {
+      sum = 10 * sum + q.pop();
     }
-
-    const T& res = m_backing[m_read];
-    m_read = (m_read + 1) % m_size;
-    return res;
   }
+  return sum;
+}
+static_assert(fixedQueueChecksum() == 12345678, "FixedQueue must be FIFO");
 
-  T peek() const {
-    if (empty()) {
-      // TODO: Throw!
-      return T{};
-    }
-
-    return m_backing[m_read];
-  }
+size_t peakRssKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
 
-  void push(T t) {
-    size_t next = (m_wrote + 1) % m_size;
-    if (next == m_read) {
-      grow();
-    }
-    m_backing[m_wrote] = t;
-    m_wrote = (m_wrote + 1) % m_size;
+// Times every single push and reports latency percentiles.
+template<typename C>
+void pushLatency(const char* name, size_t pushes) {
+  std::vector<uint32_t> latencies(pushes);
+  C c(1);
+  for (size_t i = 0; i < pushes; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    c.push(i);
+    auto end = std::chrono::steady_clock::now();
+    latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
   }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) { return latencies[std::min(pushes - 1, size_t(p * pushes))]; };
+  std::cout << "  " << name << ": p50=" << percentile(0.5) << "ns, p99=" << percentile(0.99)
+            << "ns, p99.9=" << percentile(0.999) << "ns, max=" << latencies.back()
+            << "ns, peak RSS=" << peakRssKb() << " KiB" << std::endl;
+}
 
-  void dump(std::ostream& o) const {
-    o << "[";
-    size_t toRead = m_read;
-    while (toRead != m_wrote) {
-      if (toRead != m_read) {
-        o << ", ";
+// Each variant runs in its own process so that peak RSS isn't shared.
+template<typename Segmented, typename Doubling>
+int benchGrowth(size_t pushes) {
+  std::cout << "Push latency over " << pushes << " pushes from an initial size of 1" << std::endl;
+  for (int variant = 0; variant < 2; ++variant) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      if (variant == 0) {
+        pushLatency<Doubling>("doubling", pushes);
+      } else {
+        pushLatency<Segmented>("segmented", pushes);
       }
-      o << m_backing[toRead];
-      toRead = (toRead + 1) % m_size;
+      std::cout.flush();
+      _exit(0);
     }
-    o << "]";
+    waitpid(pid, nullptr, 0);
   }
+  return 0;
+}
 
-private:
-  void grow() {
-    // TODO: Magic constant.
-    size_t new_size = 2 * m_size;
-    T* new_backing = new T[new_size];
-    size_t toCopy = m_read;
-    size_t i = 0;
-    while (toCopy != m_wrote) {
-      new_backing[i++] = m_backing[toCopy];
-      toCopy = (toCopy + 1) % m_size;
-    }
-    delete [] m_backing;
-    m_read = 0;
-    m_wrote = i;
-    m_backing = new_backing;
-    m_size = new_size;
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "bench") {
+    return benchGrowth<Queue<size_t>, DoublingQueue<size_t>>(argc > 2 ? std::stoull(argv[2]) : 20000000);
   }
 
-  T* m_backing;
-  size_t m_read;
-  size_t m_wrote;
-  size_t m_size;
-};
-
-template <typename U>
-std::ostream& operator<<(std::ostream& o, const Queue<U>& b) {
-  b.dump(o);
-  return o;
-}
-
-int main() {
   Queue<int> q(1);
   std::cout << "Empty Queue: " << q << std::endl;
   std::cout << "Queue.empty()? " << q.empty() << std::endl;
@@ -123,5 +109,28 @@ int main() {
   std::cout << "Queue after popped 10: " << q << std::endl;
   std::cout << "Queue.peek() after popped 10: " << q.peek() << std::endl;
 
+  Queue<int> big(1);
+  for (int i = 0; i < 5000; ++i) {
+    big.push(i);
+  }
+  long long sum = 0;
+  bool ordered = true;
+  for (int i = 0; i < 5000; ++i) {
+    int v = big.pop();
+    ordered = ordered && v == i;
+    sum += v;
+  }
+  std::cout << "Queue popped 5000 elements across blocks in order? " << ordered
+            << " (sum=" << sum << "), empty()? " << big.empty() << std::endl;
+
+  FixedQueue<int, 4> f;
+  for (int i = 1; i <= 5; ++i) {
+    bool pushed = f.push(i);
+    std::cout << "FixedQueue<int, 4> push " << i << ": " << pushed << std::endl;
+  }
+  f.pop();
+  f.push(6);
+  std::cout << "FixedQueue after popping 1 and pushing 6: " << f << ", peek(): " << f.peek() << std::endl;
+
   return 0;
 }
@@ -0,0 +1,309 @@
+// Queue, FixedQueue and DoublingQueue, see queue.cc for a demo and benchmarks.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <iostream>
+#include <memory>
+
+#include "../memory/allocators.h"
+
+// Queue backed by a chain of fixed size blocks: push fills the tail block and
+// pop drains the head one. Growing links a new block and never copies existing
+// elements, so pushes don't stall and addresses are stable.
+template<typename T, typename Allocator = std::allocator<T>>
+class Queue {
+  // Elements per block, roughly a page worth.
+  static constexpr size_t kBlockSize = sizeof(T) >= 4096 ? 1 : 4096 / sizeof(T);
+
+  struct Block {
+    T values[kBlockSize];
+    Block* next;
+  };
+  using BlockAllocator = RebindAlloc<Allocator, Block>;
+
+public:
+  Queue(size_t min_size, const Allocator& alloc = Allocator())
+    : m_alloc(alloc), m_read(0), m_wrote(0), m_spares(nullptr), m_spareCount(0) {
+      assert(min_size > 0);
+      m_head = m_tail = newBlock();
+      m_head->next = nullptr;
+      // Keep the blocks needed for |min_size| elements around once drained.
+      m_maxSpares = std::max<size_t>(1, (min_size + kBlockSize - 1) / kBlockSize - 1);
+      for (size_t i = 0; i < m_maxSpares; ++i) {
+        recycle(newBlock());
+      }
+    }
+
+  ~Queue() {
+    freeChain(m_head);
+    freeChain(m_spares);
+  }
+
+  // Make non-copiable for now.
+  Queue(const Queue&) = delete;
+  void operator=(const Queue&) = delete;
+
+  bool empty() const { return m_head == m_tail && m_read == m_wrote; }
+
+  T pop() {
+    if (empty()) {
+      // TODO: Throw!
+      return T{};
+    }
+
+    T res = m_head->values[m_read++];
+    if (m_read == kBlockSize) {
+      if (m_head == m_tail) {
+        // Drained the only block, rewind it.
+        m_wrote = 0;
+      } else {
+        Block* drained = m_head;
+        m_head = m_head->next;
+        recycle(drained);
+      }
+      m_read = 0;
+    }
+    return res;
+  }
+
+  T peek() const {
+    if (empty()) {
+      // TODO: Throw!
+      return T{};
+    }
+
+    return m_head->values[m_read];
+  }
+
+  void push(T t) {
+    if (m_wrote == kBlockSize) {
+      grow();
+    }
+    m_tail->values[m_wrote++] = t;
+  }
+
+  void dump(std::ostream& o) const {
+    o << "[";
+    bool addComma = false;
+    for (const Block* b = m_head; b; b = b->next) {
+      size_t begin = b == m_head ? m_read : 0;
+      size_t end = b == m_tail ? m_wrote : kBlockSize;
+      for (size_t i = begin; i < end; ++i) {
+        if (addComma) {
+          o << ", ";
+        }
+        o << b->values[i];
+        addComma = true;
+      }
+    }
+    o << "]";
+  }
+
+private:
+  // Links a new tail block, reusing a drained one if possible.
+  void grow() {
+    Block* b = m_spares;
+    if (b) {
+      m_spares = b->next;
+      m_spareCount--;
+    } else {
+      b = newBlock();
+    }
+    b->next = nullptr;
+    m_tail->next = b;
+    m_tail = b;
+    m_wrote = 0;
+  }
+
+  void recycle(Block* b) {
+    if (m_spareCount >= m_maxSpares) {
+      deleteArray(m_alloc, b, 1);
+      return;
+    }
+    b->next = m_spares;
+    m_spares = b;
+    m_spareCount++;
+  }
+
+  Block* newBlock() {
+    return newArray(m_alloc, 1);
+  }
+
+  void freeChain(Block* b) {
+    while (b) {
+      Block* next = b->next;
+      deleteArray(m_alloc, b, 1);
+      b = next;
+    }
+  }
+
+  BlockAllocator m_alloc;
+  Block* m_head;
+  Block* m_tail;
+  // Read index in m_head and write index in m_tail.
+  size_t m_read;
+  size_t m_wrote;
+  Block* m_spares;
+  size_t m_spareCount;
+  size_t m_maxSpares;
+};
+
+template <typename U, typename A>
+std::ostream& operator<<(std::ostream& o, const Queue<U, A>& b) {
+  b.dump(o);
+  return o;
+}
+
+// Queue with a compile time capacity: the elements live inline in a ring,
+// nothing is allocated and everything but dump() is constexpr. push() fails
+// once full, and pop() and peek() assert that the queue isn't empty.
+//
+// The read and write counters run freely and are only reduced modulo N when
+// indexing, which is a mask for a power of two N.
+template<typename T, size_t N>
+class FixedQueue {
+  static_assert(N > 0, "FixedQueue needs room for at least 1 element");
+
+public:
+  constexpr FixedQueue() : m_backing{}, m_read(0), m_wrote(0) {}
+
+  static constexpr size_t capacity() { return N; }
+  constexpr size_t size() const { return m_wrote - m_read; }
+  constexpr bool empty() const { return m_read == m_wrote; }
+  constexpr bool full() const { return m_wrote - m_read == N; }
+
+  constexpr T pop() {
+    assert(!empty());
+    return m_backing[slot(m_read++)];
+  }
+
+  constexpr T peek() const {
+    assert(!empty());
+    return m_backing[slot(m_read)];
+  }
+
+  constexpr bool push(T t) {
+    if (full()) {
+      return false;
+    }
+    m_backing[slot(m_wrote++)] = t;
+    return true;
+  }
+
+  void dump(std::ostream& o) const {
+    o << "[";
+    for (size_t i = m_read; i != m_wrote; ++i) {
+      if (i != m_read) {
+        o << ", ";
+      }
+      o << m_backing[slot(i)];
+    }
+    o << "]";
+  }
+
+private:
+  static constexpr size_t slot(size_t counter) {
+    if constexpr ((N & (N - 1)) == 0) {
+      return counter & (N - 1);
+    } else {
+      return counter % N;
+    }
+  }
+
+  std::array<T, N> m_backing;
+  // Elements ever popped and pushed. 64 bit counters don't wrap in practice.
+  size_t m_read;
+  size_t m_wrote;
+};
+
+template <typename U, size_t N>
+std::ostream& operator<<(std::ostream& o, const FixedQueue<U, N>& b) {
+  b.dump(o);
+  return o;
+}
+
+// The previous array doubling queue, kept as a baseline for the growth
+// benchmark.
+template<typename T>
+class DoublingQueue {
+public:
+  DoublingQueue(size_t min_size)
+    : m_read(0), m_wrote(0), m_size(min_size) {
+      assert(m_size > 0);
+      m_backing = new T[m_size];
+    }
+
+  ~DoublingQueue() {
+    delete [] m_backing;
+  }
+
+  bool empty() const { return m_read == m_wrote; }
+
+  T pop() {
+    if (empty()) {
+      // TODO: Throw!
+      return T{};
+    }
+
+    const T& res = m_backing[m_read];
+    m_read = (m_read + 1) % m_size;
+    return res;
+  }
+
+  T peek() const {
+    if (empty()) {
+      // TODO: Throw!
+      return T{};
+    }
+
+    return m_backing[m_read];
+  }
+
+  void push(T t) {
+    size_t next = (m_wrote + 1) % m_size;
+    if (next == m_read) {
+      grow();
+    }
+    m_backing[m_wrote] = t;
+    m_wrote = (m_wrote + 1) % m_size;
+  }
+
+  void dump(std::ostream& o) const {
+    o << "[";
+    size_t toRead = m_read;
+    while (toRead != m_wrote) {
+      if (toRead != m_read) {
+        o << ", ";
+      }
+      o << m_backing[toRead];
+      toRead = (toRead + 1) % m_size;
+    }
+    o << "]";
+  }
+
+private:
+  void grow() {
+    // TODO: Magic constant.
+    size_t new_size = 2 * m_size;
+    T* new_backing = new T[new_size];
+    size_t toCopy = m_read;
+    size_t i = 0;
+    while (toCopy != m_wrote) {
+      new_backing[i++] = m_backing[toCopy];
+      toCopy = (toCopy + 1) % m_size;
+    }
+    delete [] m_backing;
+    m_read = 0;
+    m_wrote = i;
+    m_backing = new_backing;
+    m_size = new_size;
+  }
+
+  T* m_backing;
+  size_t m_read;
+  size_t m_wrote;
+  size_t m_size;
+};
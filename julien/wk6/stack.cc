@@ -1,89 +1,141 @@
 // Build using:
-//   g++ -Wall -Werror --sanitize=address -g -o stack stack.cc && ./stack
+//   g++ -Wall -Werror --sanitize=address -g -pthread -o stack stack.cc && ./stack
+// Benchmark using:
+//   g++ -Wall -Werror -O2 -DNDEBUG -pthread -o stack stack.cc && ./stack bench [ops per thread]
+//   ./stack grow [pushes]
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <iostream>
+#include <mutex>
 #include <numeric>
+#include <random>
+#include <string>
+#include <thread>
 #include <vector>
 
-template<typename T>
-class Stack {
-public:
-  Stack(size_t min_size)
-    : m_used(0), m_size(min_size) {
-      assert(m_size > 0);
-      m_backing = new T[m_size];
-    }
-
-  ~Stack() {
-    delete [] m_backing;
-  }
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
-  bool empty() const { return m_used <= 0; }
-
-  T pop() {
-    if (empty()) {
-      // TODO: Throw!
-      return T{};
-    }
+#include "stack.h"
 
-    return m_backing[--m_used];
+// Evaluated by the compiler: reverses the digits of |n|.
+constexpr int reverseDigits(int n) {
+  FixedStack<int, 10> s;
+  for (; n > 0; n /= 10) {
+    s.push(n % 10);
   }
+  int reversed = 0;
+  for (int pow = 1; !s.empty(); pow *= 10) {
+    reversed += s.pop() * pow;
+  }
+  return reversed;
+}
+static_assert(reverseDigits(12345) == 54321, "FixedStack must be LIFO");
 
-  T peek() const {
-    if (empty()) {
-      // TODO: Throw!
-      return T{};
-    }
-
-    return m_backing[m_used - 1];
+// Free-list pattern: every thread pops a buffer and pushes it back.
+template<typename S>
+double contention(S& s, size_t threads, size_t opsPerThread) {
+  for (size_t i = 0; i < threads; ++i) {
+    s.push(i);
   }
+  std::vector<std::thread> workers;
+  std::atomic<bool> go{false};
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&] {
+      while (!go.load()) {
+      }
+      size_t buf;
+      for (size_t i = 0; i < opsPerThread; ++i) {
+        if (s.pop(buf)) {
+          s.push(buf);
+        } else {
+          s.push(i);
+        }
+      }
+    });
+  }
+  auto start = std::chrono::steady_clock::now();
+  go.store(true);
+  for (std::thread& w : workers) {
+    w.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  // One push and one pop per iteration.
+  return 2.0 * threads * opsPerThread / seconds / 1e6;
+}
 
-  void push(T t) {
-    if (m_used >= m_size) {
-      grow();
-    }
-    m_backing[m_used++] = t;
+size_t peakRssKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// Times every single push and reports latency percentiles.
+template<typename C>
+void pushLatency(const char* name, size_t pushes) {
+  std::vector<uint32_t> latencies(pushes);
+  C c(1);
+  for (size_t i = 0; i < pushes; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    c.push(i);
+    auto end = std::chrono::steady_clock::now();
+    latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
   }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) { return latencies[std::min(pushes - 1, size_t(p * pushes))]; };
+  std::cout << "  " << name << ": p50=" << percentile(0.5) << "ns, p99=" << percentile(0.99)
+            << "ns, p99.9=" << percentile(0.999) << "ns, max=" << latencies.back()
+            << "ns, peak RSS=" << peakRssKb() << " KiB" << std::endl;
+}
 
-  void dump(std::ostream& o) const {
-    o << "[";
-    for (size_t i = 0; i < m_used; ++i) {
-      if (i != 0) {
-        o << ", ";
+// Each variant runs in its own process so that peak RSS isn't shared.
+template<typename Segmented, typename Doubling>
+int benchGrowth(size_t pushes) {
+  std::cout << "Push latency over " << pushes << " pushes from an initial size of 1" << std::endl;
+  for (int variant = 0; variant < 2; ++variant) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      if (variant == 0) {
+        pushLatency<Doubling>("doubling", pushes);
+      } else {
+        pushLatency<Segmented>("segmented", pushes);
       }
-      o << m_backing[i];
+      std::cout.flush();
+      _exit(0);
     }
-    o << "]";
+    waitpid(pid, nullptr, 0);
   }
+  return 0;
+}
 
-private:
-  void grow() {
-    // TODO: Magic constant.
-    size_t new_size = 2 * m_size;
-    // TODO: Use memset.
-    T* new_backing = new T[new_size];
-    for (size_t i = 0; i < m_size; ++i) {
-      new_backing[i] = m_backing[i];
-    }
-    delete [] m_backing;
-    m_backing = new_backing;
-    m_size = new_size;
+int bench(size_t opsPerThread) {
+  std::cout << "Push/pop pairs, " << opsPerThread << " per thread (Mops/s)" << std::endl;
+  for (size_t threads = 1; threads <= 64; threads *= 2) {
+    MutexStack<size_t> locked;
+    ConcurrentStack<size_t> treiber(/*elimination*/ false);
+    ConcurrentStack<size_t> elimination(/*elimination*/ true);
+    std::cout << "  threads=" << threads
+              << ": mutex=" << contention(locked, threads, opsPerThread)
+              << ", treiber=" << contention(treiber, threads, opsPerThread)
+              << ", treiber+elimination=" << contention(elimination, threads, opsPerThread)
+              << std::endl;
   }
-
-  T* m_backing;
-  size_t m_used;
-  size_t m_size;
-};
-
-template <typename U>
-std::ostream& operator<<(std::ostream& o, const Stack<U>& b) {
-  b.dump(o);
-  return o;
+  return 0;
 }
 
-int main() {
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "bench") {
+    return bench(argc > 2 ? std::stoull(argv[2]) : 200000);
+  }
+  if (argc > 1 && std::string(argv[1]) == "grow") {
+    return benchGrowth<Stack<size_t>, DoublingStack<size_t>>(argc > 2 ? std::stoull(argv[2]) : 20000000);
+  }
+
   Stack<int> b(1);
   std::cout << "Empty Stack: " << b << std::endl;
   std::cout << "Stack.empty()? " << b.empty() << std::endl;
@@ -112,5 +164,37 @@ int main() {
   std::cout << "Stack after popped 15: " << b << std::endl;
   std::cout << "Stack.peek() after popped 15: " << b.peek() << std::endl;
 
+  FixedStack<int, 2> f;
+  bool pushed = f.push(5) && f.push(15);
+  std::cout << "FixedStack<int, 2> after pushing 5, 15: " << f << " (pushed=" << pushed
+            << "), push(10) when full: " << f.push(10) << ", pop(): " << f.pop() << std::endl;
+
+  ConcurrentStack<int> c;
+  c.push(5);
+  c.push(15);
+  int value = 0;
+  bool found = c.pop(value);
+  std::cout << "ConcurrentStack popped: " << found << " (" << value << ")" << std::endl;
+  std::atomic<int> total{0};
+  std::vector<std::thread> workers;
+  for (int t = 0; t < 4; ++t) {
+    workers.emplace_back([&] {
+      for (int i = 0; i < 1000; ++i) {
+        c.push(1);
+        int v;
+        if (c.pop(v)) {
+          total += v;
+        }
+      }
+    });
+  }
+  for (std::thread& w : workers) {
+    w.join();
+  }
+  while (c.pop(value)) {
+    total += value;
+  }
+  std::cout << "ConcurrentStack total after 4 threads pushed 1000 ones: " << total << " (expected 4005)" << std::endl;
+
   return 0;
 }
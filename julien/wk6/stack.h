@@ -0,0 +1,437 @@
+// Stack, FixedStack, ConcurrentStack, MutexStack and DoublingStack, see stack.cc for a
+// demo and benchmarks.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../memory/allocators.h"
+
+// Stack backed by fixed size blocks. Growing appends a new block and never
+// copies existing elements, so pushes don't stall and addresses are stable.
+template<typename T, typename Allocator = std::allocator<T>>
+class Stack {
+  // Elements per block, roughly a page worth.
+  static constexpr size_t kBlockSize = sizeof(T) >= 4096 ? 1 : 4096 / sizeof(T);
+
+public:
+  Stack(size_t min_size, const Allocator& alloc = Allocator())
+    : m_alloc(alloc), m_blocks(RebindAlloc<Allocator, T*>(alloc)), m_used(0) {
+      assert(min_size > 0);
+      size_t blocks = (min_size + kBlockSize - 1) / kBlockSize;
+      for (size_t i = 0; i < blocks; ++i) {
+        grow();
+      }
+    }
+
+  ~Stack() {
+    for (T* block : m_blocks) {
+      deleteArray(m_alloc, block, kBlockSize);
+    }
+  }
+
+  // Make non-copiable for now.
+  Stack(const Stack&) = delete;
+  void operator=(const Stack&) = delete;
+
+  bool empty() const { return m_used <= 0; }
+
+  T pop() {
+    if (empty()) {
+      // TODO: Throw!
+      return T{};
+    }
+
+    return at(--m_used);
+  }
+
+  T peek() const {
+    if (empty()) {
+      // TODO: Throw!
+      return T{};
+    }
+
+    return at(m_used - 1);
+  }
+
+  void push(T t) {
+    if (m_used >= m_blocks.size() * kBlockSize) {
+      grow();
+    }
+    at(m_used++) = t;
+  }
+
+  void dump(std::ostream& o) const {
+    o << "[";
+    for (size_t i = 0; i < m_used; ++i) {
+      if (i != 0) {
+        o << ", ";
+      }
+      o << at(i);
+    }
+    o << "]";
+  }
+
+private:
+  T& at(size_t i) const { return m_blocks[i / kBlockSize][i % kBlockSize]; }
+
+  // Only the block directory is ever copied, not the elements.
+  void grow() {
+    m_blocks.push_back(newArray(m_alloc, kBlockSize));
+  }
+
+  Allocator m_alloc;
+  std::vector<T*, RebindAlloc<Allocator, T*>> m_blocks;
+  size_t m_used;
+};
+
+template <typename U, typename A>
+std::ostream& operator<<(std::ostream& o, const Stack<U, A>& b) {
+  b.dump(o);
+  return o;
+}
+
+// Stack with a compile time capacity: the elements live inline, nothing is
+// allocated and everything but dump() is constexpr. push() fails once full,
+// and pop() and peek() assert that the stack isn't empty.
+template<typename T, size_t N>
+class FixedStack {
+  static_assert(N > 0, "FixedStack needs room for at least 1 element");
+
+public:
+  constexpr FixedStack() : m_backing{}, m_used(0) {}
+
+  static constexpr size_t capacity() { return N; }
+  constexpr size_t size() const { return m_used; }
+  constexpr bool empty() const { return m_used == 0; }
+  constexpr bool full() const { return m_used == N; }
+
+  constexpr T pop() {
+    assert(!empty());
+    return m_backing[--m_used];
+  }
+
+  constexpr T peek() const {
+    assert(!empty());
+    return m_backing[m_used - 1];
+  }
+
+  constexpr bool push(T t) {
+    if (full()) {
+      return false;
+    }
+    m_backing[m_used++] = t;
+    return true;
+  }
+
+  void dump(std::ostream& o) const {
+    o << "[";
+    for (size_t i = 0; i < m_used; ++i) {
+      if (i != 0) {
+        o << ", ";
+      }
+      o << m_backing[i];
+    }
+    o << "]";
+  }
+
+private:
+  std::array<T, N> m_backing;
+  size_t m_used;
+};
+
+template <typename U, size_t N>
+std::ostream& operator<<(std::ostream& o, const FixedStack<U, N>& b) {
+  b.dump(o);
+  return o;
+}
+
+// Lock-free Treiber stack.
+//
+// ABA protection uses tagged pointers: the top of the stack packs a 16 bit
+// modification counter in the unused upper bits of the node address. Popped
+// nodes are never freed while the stack is alive, they go to an internal
+// free list (itself a tagged Treiber stack) so that a stale reader can always
+// dereference them.
+//
+// When the CAS on the top fails, the thread tries to meet an opposite
+// operation in an elimination array instead: a push and a pop that meet there
+// cancel each other without touching the top pointer.
+template<typename T>
+class ConcurrentStack {
+  struct Node {
+    T value;
+    std::atomic<Node*> next;
+  };
+
+  static_assert(sizeof(void*) == 8, "Tagged pointers need 64 bit pointers");
+  static constexpr int kPointerBits = 48;
+  static constexpr uint64_t kPointerMask = (1ULL << kPointerBits) - 1;
+  // Marks an elimination slot whose offered node was taken by a pop.
+  static constexpr uintptr_t kTaken = 1;
+  static constexpr size_t kEliminationSlots = 16;
+  static constexpr int kEliminationSpins = 128;
+
+  // Stack of Nodes with an ABA-safe top.
+  class TaggedStack {
+  public:
+    TaggedStack() : m_top(0) {}
+
+    bool tryPush(Node* n) {
+      uint64_t top = m_top.load(std::memory_order_relaxed);
+      n->next.store(pointer(top), std::memory_order_relaxed);
+      return m_top.compare_exchange_weak(top, pack(n, tag(top) + 1),
+                                         std::memory_order_release, std::memory_order_relaxed);
+    }
+
+    void push(Node* n) {
+      while (!tryPush(n)) {
+      }
+    }
+
+    // Returns false if the CAS lost a race, |n| is null if the stack is empty.
+    bool tryPop(Node*& n) {
+      uint64_t top = m_top.load(std::memory_order_acquire);
+      n = pointer(top);
+      if (!n) {
+        return true;
+      }
+      // |n| may have been popped and reused meanwhile but is never freed so
+      // reading it is fine, the tag makes the CAS fail in that case.
+      Node* next = n->next.load(std::memory_order_relaxed);
+      return m_top.compare_exchange_weak(top, pack(next, tag(top) + 1),
+                                         std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    Node* pop() {
+      Node* n;
+      while (!tryPop(n)) {
+      }
+      return n;
+    }
+
+    // Not thread safe.
+    Node* releaseAll() {
+      Node* n = pointer(m_top.load());
+      m_top.store(0);
+      return n;
+    }
+
+  private:
+    static Node* pointer(uint64_t v) { return reinterpret_cast<Node*>(v & kPointerMask); }
+    static uint64_t tag(uint64_t v) { return v >> kPointerBits; }
+    static uint64_t pack(Node* n, uint64_t tag) {
+      assert((reinterpret_cast<uint64_t>(n) & ~kPointerMask) == 0);
+      return reinterpret_cast<uint64_t>(n) | (tag << kPointerBits);
+    }
+
+    // Keep the top on its own cache line.
+    alignas(64) std::atomic<uint64_t> m_top;
+  };
+
+  struct alignas(64) EliminationSlot {
+    std::atomic<uintptr_t> offer{0};
+  };
+
+public:
+  ConcurrentStack(bool elimination = true) : m_elimination(elimination) {}
+
+  ~ConcurrentStack() {
+    freeAll(m_stack.releaseAll());
+    freeAll(m_freeList.releaseAll());
+  }
+
+  // Make non-copiable for now.
+  ConcurrentStack(const ConcurrentStack&) = delete;
+  void operator=(const ConcurrentStack&) = delete;
+
+  void push(const T& t) {
+    Node* n = m_freeList.pop();
+    if (!n) {
+      n = new Node{t, {nullptr}};
+    } else {
+      n->value = t;
+    }
+    while (!m_stack.tryPush(n)) {
+      if (m_elimination && eliminatePush(n)) {
+        return;
+      }
+    }
+  }
+
+  // Returns false if the stack was empty.
+  bool pop(T& out) {
+    Node* n;
+    while (!m_stack.tryPop(n)) {
+      if (m_elimination && (n = eliminatePop())) {
+        break;
+      }
+    }
+    if (!n) {
+      return false;
+    }
+    out = n->value;
+    m_freeList.push(n);
+    return true;
+  }
+
+private:
+  static void freeAll(Node* n) {
+    while (n) {
+      Node* next = n->next.load(std::memory_order_relaxed);
+      delete n;
+      n = next;
+    }
+  }
+
+  static size_t randomSlot() {
+    thread_local std::minstd_rand rng(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    return rng() % kEliminationSlots;
+  }
+
+  // Offers |n| in a random slot for a while. Returns true if a pop took it.
+  bool eliminatePush(Node* n) {
+    EliminationSlot& slot = m_slots[randomSlot()];
+    uintptr_t expected = 0;
+    uintptr_t offer = reinterpret_cast<uintptr_t>(n);
+    if (!slot.offer.compare_exchange_strong(expected, offer, std::memory_order_release)) {
+      return false;
+    }
+    for (int i = 0; i < kEliminationSpins; ++i) {
+      if (slot.offer.load(std::memory_order_acquire) == kTaken) {
+        break;
+      }
+    }
+    // Withdraw the offer, if that fails a pop took the node.
+    if (slot.offer.compare_exchange_strong(offer, 0, std::memory_order_acquire)) {
+      return false;
+    }
+    assert(offer == kTaken);
+    slot.offer.store(0, std::memory_order_release);
+    return true;
+  }
+
+  // Returns a node offered by a concurrent push or null.
+  Node* eliminatePop() {
+    EliminationSlot& slot = m_slots[randomSlot()];
+    uintptr_t offer = slot.offer.load(std::memory_order_acquire);
+    if (offer == 0 || offer == kTaken) {
+      return nullptr;
+    }
+    if (!slot.offer.compare_exchange_strong(offer, kTaken, std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return reinterpret_cast<Node*>(offer);
+  }
+
+  TaggedStack m_stack;
+  TaggedStack m_freeList;
+  bool m_elimination;
+  EliminationSlot m_slots[kEliminationSlots];
+};
+
+// Stack guarded by a mutex, this is the baseline for the benchmark.
+template<typename T>
+class MutexStack {
+public:
+  MutexStack() : m_stack(16) {}
+
+  void push(const T& t) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stack.push(t);
+  }
+
+  bool pop(T& out) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stack.empty()) {
+      return false;
+    }
+    out = m_stack.pop();
+    return true;
+  }
+
+private:
+  std::mutex m_mutex;
+  Stack<T> m_stack;
+};
+
+// The previous array doubling stack, kept as a baseline for the growth
+// benchmark.
+template<typename T>
+class DoublingStack {
+public:
+  DoublingStack(size_t min_size)
+    : m_used(0), m_size(min_size) {
+      assert(m_size > 0);
+      m_backing = new T[m_size];
+    }
+
+  ~DoublingStack() {
+    delete [] m_backing;
+  }
+
+  bool empty() const { return m_used <= 0; }
+
+  T pop() {
+    if (empty()) {
+      // TODO: Throw!
+      return T{};
+    }
+
+    return m_backing[--m_used];
+  }
+
+  T peek() const {
+    if (empty()) {
+      // TODO: Throw!
+      return T{};
+    }
+
+    return m_backing[m_used - 1];
+  }
+
+  void push(T t) {
+    if (m_used >= m_size) {
+      grow();
+    }
+    m_backing[m_used++] = t;
+  }
+
+  void dump(std::ostream& o) const {
+    o << "[";
+    for (size_t i = 0; i < m_used; ++i) {
+      if (i != 0) {
+        o << ", ";
+      }
+      o << m_backing[i];
+    }
+    o << "]";
+  }
+
+private:
+  void grow() {
+    // TODO: Magic constant.
+    size_t new_size = 2 * m_size;
+    // TODO: Use memset.
+    T* new_backing = new T[new_size];
+    for (size_t i = 0; i < m_size; ++i) {
+      new_backing[i] = m_backing[i];
+    }
+    delete [] m_backing;
+    m_backing = new_backing;
+    m_size = new_size;
+  }
+
+  T* m_backing;
+  size_t m_used;
+  size_t m_size;
+};
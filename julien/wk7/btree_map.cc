@@ -0,0 +1,132 @@
+// Build using:
+//   g++ -Wall -Werror --sanitize=address -g -o btree_map btree_map.cc && ./btree_map
+// See bench/bench.cc for the benchmarks against std::map and HashTable.
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "btree_map.h"
+
+// Checks every operation against std::map under random inserts and erases.
+template<typename K, size_t kFanout>
+void testAgainstMap(size_t ops, K range, uint64_t seed) {
+  BTreeMap<K, std::string, kFanout> b;
+  std::map<K, std::string> m;
+  std::mt19937_64 rng(seed);
+  for (size_t i = 0; i < ops; ++i) {
+    K k = K(rng() % uint64_t(range));
+    switch (rng() % 4) {
+      case 0:
+      case 1: {
+        std::string v = std::to_string(i);
+        bool added = b.insert(k, v);
+        assert(added == (m.count(k) == 0));
+        (void)added;
+        m[k] = v;
+        break;
+      }
+      case 2: {
+        bool erased = b.erase(k);
+        assert(erased == (m.erase(k) == 1));
+        (void)erased;
+        break;
+      }
+      default: {
+        std::string* v = b.find(k);
+        auto it = m.find(k);
+        assert((v == nullptr) == (it == m.end()));
+        assert(!v || *v == it->second);
+        (void)v;
+        (void)it;
+        auto lb = b.lower_bound(k);
+        auto mlb = m.lower_bound(k);
+        assert((lb == b.end()) == (mlb == m.end()));
+        assert(lb == b.end() || (lb.key() == mlb->first && lb.value() == mlb->second));
+        (void)lb;
+        (void)mlb;
+        break;
+      }
+    }
+  }
+  assert(b.size() == m.size());
+
+  auto it = b.begin();
+  for (const auto& kv : m) {
+    assert(it != b.end() && it.key() == kv.first && it.value() == kv.second);
+    (void)kv;
+    ++it;
+  }
+  assert(it == b.end());
+
+  K lo = range / 4;
+  K hi = range / 2;
+  size_t scanned = 0;
+  auto mit = m.lower_bound(lo);
+  b.scan(lo, hi, [&](K k, const std::string& v) {
+    assert(mit != m.end() && mit->first == k && mit->second == v);
+    ++mit;
+    ++scanned;
+  });
+  assert(mit == m.lower_bound(hi));
+  std::cout << "BTreeMap<" << sizeof(K) * 8 << " bit keys, fanout " << kFanout << "> matches std::map after "
+            << ops << " ops: " << b.size() << " keys, height " << b.height() << ", " << scanned << " in ["
+            << lo << ", " << hi << ")" << std::endl;
+}
+
+void testBulkLoad() {
+  for (size_t n : {0, 1, 16, 17, 289, 10000}) {
+    std::vector<std::pair<int64_t, int64_t>> sorted;
+    for (size_t i = 0; i < n; ++i) {
+      sorted.emplace_back(3 * i, i);
+    }
+    BTreeMap<int64_t, int64_t> b(sorted);
+    assert(b.size() == n);
+    for (size_t i = 0; i < n; ++i) {
+      assert(*b.find(3 * i) == int64_t(i));
+      assert(!b.contains(3 * i + 1));
+      auto lb = b.lower_bound(3 * i - 1);
+      assert(lb.key() == int64_t(3 * i));
+      (void)lb;
+    }
+    // Inserts still work on full nodes.
+    for (size_t i = 0; i < n; ++i) {
+      b.insert(3 * i + 1, -1);
+    }
+    assert(b.size() == 2 * n);
+    size_t count = 0;
+    int64_t prev = -1;
+    for (auto it = b.begin(); it != b.end(); ++it, ++count) {
+      assert(it.key() > prev);
+      prev = it.key();
+    }
+    (void)prev;
+    assert(count == 2 * n);
+    std::cout << "Bulk loaded " << n << " keys: height " << b.height() << std::endl;
+  }
+}
+
+int main() {
+  BTreeMap<int, std::string> b;
+  std::cout << "Empty BTreeMap: " << b << std::endl;
+  b.insert(5, "five");
+  b.insert(15, "fifteen");
+  b.insert(10, "ten");
+  std::cout << "BTreeMap after inserting 5, 15, 10: " << b << std::endl;
+  std::cout << "BTreeMap lower_bound(6): " << b.lower_bound(6).key() << std::endl;
+  b.erase(10);
+  std::cout << "BTreeMap after erasing 10: " << b << std::endl;
+
+  testAgainstMap<int64_t, 16>(100000, 5000, 1);
+  testAgainstMap<int32_t, 8>(100000, 2000, 2);
+  testAgainstMap<int32_t, 64>(100000, 100000, 3);
+  testAgainstMap<uint16_t, 16>(50000, 1000, 4);
+  testAgainstMap<double, 16>(50000, 3000, 5);
+  testBulkLoad();
+
+  return 0;
+}
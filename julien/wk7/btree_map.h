@@ -0,0 +1,498 @@
+// BTreeMap, see btree_map.cc for a demo.
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "../memory/allocators.h"
+
+// Ordered map from arithmetic keys to values, as a B+-tree: values only live
+// in the leaves, which are chained for range scans, and inner nodes only hold
+// separators.
+//
+// Nodes hold kFanout keys in a fixed size array aligned on a cache line, the
+// unused slots padded with kPadKey. A search is then a count of the keys below
+// the target over the whole array: no branch depends on the data and, for
+// signed integer keys, it is a handful of SIMD compares. The largest key is
+// reserved for the padding, like HashSet reserves kEmptyBucket.
+//
+// erase() doesn't rebalance: leaves may get sparse or empty but the
+// separators stay valid, which keeps lookups and scans correct.
+template<typename K, typename V, size_t kFanout = 16,
+         typename Allocator = std::allocator<std::pair<K, V>>>
+class BTreeMap {
+  static_assert(std::is_arithmetic_v<K>, "Node searches compare keys as numbers");
+  static_assert(kFanout >= 8 && kFanout % 8 == 0, "Searches go 8 keys at a time");
+
+  static constexpr K kPadKey = std::numeric_limits<K>::max();
+
+  struct alignas(64) Leaf {
+    K keys[kFanout];
+    V values[kFanout];
+    size_t count;
+    Leaf* next;
+  };
+
+  struct alignas(64) Inner {
+    K keys[kFanout];
+    // children[i] holds the keys in [keys[i - 1], keys[i]).
+    void* children[kFanout + 1];
+    size_t count;
+  };
+
+  using LeafAllocator = RebindAlloc<Allocator, Leaf>;
+  using InnerAllocator = RebindAlloc<Allocator, Inner>;
+
+  // A node split in two while inserting: |right| must be linked after the
+  // node, everything in it is >= |key|.
+  struct Split {
+    void* right;
+    K key;
+  };
+
+public:
+  class Iterator {
+  public:
+    K key() const { return m_leaf->keys[m_idx]; }
+    V& value() const { return m_leaf->values[m_idx]; }
+
+    Iterator& operator++() {
+      ++m_idx;
+      skipExhausted();
+      return *this;
+    }
+
+    bool operator==(const Iterator& o) const { return m_leaf == o.m_leaf && m_idx == o.m_idx; }
+    bool operator!=(const Iterator& o) const { return !(*this == o); }
+
+  private:
+    friend class BTreeMap;
+    Iterator(Leaf* leaf, size_t idx) : m_leaf(leaf), m_idx(idx) { skipExhausted(); }
+
+    // Moves past the end of the leaf, and past empty leaves, to the next key.
+    void skipExhausted() {
+      while (m_leaf && m_idx >= m_leaf->count) {
+        m_leaf = m_leaf->next;
+        m_idx = 0;
+      }
+    }
+
+    Leaf* m_leaf;
+    size_t m_idx;
+  };
+
+  explicit BTreeMap(const Allocator& alloc = Allocator())
+    : m_leafAlloc(alloc), m_innerAlloc(alloc), m_root(nullptr), m_height(0), m_size(0) {}
+
+  // Bulk loads |count| pairs sorted by strictly increasing key, in O(n) and
+  // with full nodes instead of the half full ones left by splits.
+  BTreeMap(const std::pair<K, V>* sorted, size_t count, const Allocator& alloc = Allocator())
+    : BTreeMap(alloc) {
+      bulkLoad(sorted, count);
+    }
+
+  BTreeMap(const std::vector<std::pair<K, V>>& sorted, const Allocator& alloc = Allocator())
+    : BTreeMap(sorted.data(), sorted.size(), alloc) {}
+
+  ~BTreeMap() {
+    if (m_root) {
+      freeNode(m_root, m_height);
+    }
+  }
+
+  // Make non-copiable for now.
+  BTreeMap(const BTreeMap&) = delete;
+  void operator=(const BTreeMap&) = delete;
+
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  // Number of inner levels above the leaves.
+  size_t height() const { return m_height; }
+
+  // Inserts or overwrites. Returns whether |k| is new.
+  bool insert(K k, V v) {
+    assert(k != kPadKey);
+    if (!m_root) {
+      m_root = newLeaf();
+    }
+    Split split{nullptr, K{}};
+    bool added = insertInto(m_root, m_height, k, std::move(v), split);
+    if (split.right) {
+      Inner* root = newInner();
+      root->keys[0] = split.key;
+      root->children[0] = m_root;
+      root->children[1] = split.right;
+      root->count = 1;
+      m_root = root;
+      m_height++;
+    }
+    m_size += added;
+    return added;
+  }
+
+  // Returns nullptr if |k| isn't there.
+  V* find(K k) const {
+    if (!m_root) {
+      return nullptr;
+    }
+    Leaf* leaf = leafFor(k);
+    size_t pos = countLess(leaf->keys, k);
+    return pos < leaf->count && leaf->keys[pos] == k ? &leaf->values[pos] : nullptr;
+  }
+
+  bool contains(K k) const { return find(k) != nullptr; }
+
+  // Returns whether |k| was there.
+  bool erase(K k) {
+    if (!m_root) {
+      return false;
+    }
+    Leaf* leaf = leafFor(k);
+    size_t pos = countLess(leaf->keys, k);
+    if (pos >= leaf->count || leaf->keys[pos] != k) {
+      return false;
+    }
+    for (size_t i = pos + 1; i < leaf->count; ++i) {
+      leaf->keys[i - 1] = leaf->keys[i];
+      leaf->values[i - 1] = std::move(leaf->values[i]);
+    }
+    leaf->count--;
+    leaf->keys[leaf->count] = kPadKey;
+    m_size--;
+    return true;
+  }
+
+  Iterator begin() const {
+    if (!m_root) {
+      return end();
+    }
+    void* node = m_root;
+    for (size_t level = m_height; level > 0; --level) {
+      node = static_cast<Inner*>(node)->children[0];
+    }
+    return Iterator(static_cast<Leaf*>(node), 0);
+  }
+
+  Iterator end() const { return Iterator(nullptr, 0); }
+
+  // First key >= |k|.
+  Iterator lower_bound(K k) const {
+    if (!m_root) {
+      return end();
+    }
+    Leaf* leaf = leafFor(k);
+    return Iterator(leaf, countLess(leaf->keys, k));
+  }
+
+  // Calls f(key, value) for every key in [lo, hi) in order. Faster than
+  // iterating as it walks each leaf in a tight loop.
+  template<typename F>
+  void scan(K lo, K hi, F&& f) const {
+    if (!m_root || !(lo < hi)) {
+      return;
+    }
+    Leaf* leaf = leafFor(lo);
+    size_t i = countLess(leaf->keys, lo);
+    for (; leaf; leaf = leaf->next, i = 0) {
+      // Keys of the leaf before |hi|, the padding never is.
+      size_t end = countLess(leaf->keys, hi);
+      for (; i < end; ++i) {
+        f(leaf->keys[i], leaf->values[i]);
+      }
+      if (end < leaf->count) {
+        return;
+      }
+    }
+  }
+
+  void dump(std::ostream& o) const {
+    o << "[";
+    for (Iterator it = begin(); it != end(); ++it) {
+      if (it != begin()) {
+        o << ", ";
+      }
+      o << it.key() << ": " << it.value();
+    }
+    o << "]";
+  }
+
+private:
+  // Number of keys < k among all kFanout slots of |keys|, padding included.
+  static size_t countLess(const K* keys, K k) {
+    // A true compare is -1 in its lane: subtracting the masks counts them
+    // without leaving the vector registers, popcount isn't an instruction
+    // before -mpopcnt.
+#if defined(__AVX2__)
+    if constexpr (std::is_integral_v<K> && std::is_signed_v<K> && sizeof(K) == 8) {
+      __m256i target = _mm256_set1_epi64x(k);
+      __m256i n = _mm256_setzero_si256();
+      for (size_t i = 0; i < kFanout; i += 4) {
+        __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(keys + i));
+        n = _mm256_sub_epi64(n, _mm256_cmpgt_epi64(target, v));
+      }
+      __m128i half = _mm_add_epi64(_mm256_castsi256_si128(n), _mm256_extracti128_si256(n, 1));
+      return _mm_cvtsi128_si64(_mm_add_epi64(half, _mm_unpackhi_epi64(half, half)));
+    }
+    if constexpr (std::is_integral_v<K> && std::is_signed_v<K> && sizeof(K) == 4) {
+      __m256i target = _mm256_set1_epi32(k);
+      __m256i n = _mm256_setzero_si256();
+      for (size_t i = 0; i < kFanout; i += 8) {
+        __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(keys + i));
+        n = _mm256_sub_epi32(n, _mm256_cmpgt_epi32(target, v));
+      }
+      return horizontalSum(_mm_add_epi32(_mm256_castsi256_si128(n), _mm256_extracti128_si256(n, 1)));
+    }
+#elif defined(__SSE2__)
+    if constexpr (std::is_integral_v<K> && std::is_signed_v<K> && sizeof(K) == 4) {
+      __m128i target = _mm_set1_epi32(k);
+      __m128i n = _mm_setzero_si128();
+      for (size_t i = 0; i < kFanout; i += 4) {
+        __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(keys + i));
+        n = _mm_sub_epi32(n, _mm_cmpgt_epi32(target, v));
+      }
+      return horizontalSum(n);
+    }
+#endif
+    size_t n = 0;
+    for (size_t i = 0; i < kFanout; ++i) {
+      n += keys[i] < k;
+    }
+    return n;
+  }
+
+#if defined(__SSE2__)
+  static size_t horizontalSum(__m128i n) {
+    n = _mm_add_epi32(n, _mm_shuffle_epi32(n, _MM_SHUFFLE(1, 0, 3, 2)));
+    n = _mm_add_epi32(n, _mm_shuffle_epi32(n, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(n);
+  }
+#endif
+
+  // Number of keys <= k, which is the child to descend into. The padding is
+  // never counted.
+  static size_t countLessEqual(const K* keys, K k) {
+    if (k == kPadKey) {
+      return countLess(keys, k);
+    }
+    if constexpr (std::is_integral_v<K>) {
+      return countLess(keys, k + 1);
+    } else {
+      size_t n = 0;
+      for (size_t i = 0; i < kFanout; ++i) {
+        n += keys[i] <= k;
+      }
+      return n;
+    }
+  }
+
+  Leaf* leafFor(K k) const {
+    void* node = m_root;
+    for (size_t level = m_height; level > 0; --level) {
+      Inner* inner = static_cast<Inner*>(node);
+      node = inner->children[countLessEqual(inner->keys, k)];
+    }
+    return static_cast<Leaf*>(node);
+  }
+
+  bool insertInto(void* node, size_t level, K k, V&& v, Split& split) {
+    if (level == 0) {
+      return insertIntoLeaf(static_cast<Leaf*>(node), k, std::move(v), split);
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+    size_t idx = countLessEqual(inner->keys, k);
+    Split child{nullptr, K{}};
+    bool added = insertInto(inner->children[idx], level - 1, k, std::move(v), child);
+    if (child.right) {
+      insertIntoInner(inner, idx, child, split);
+    }
+    return added;
+  }
+
+  bool insertIntoLeaf(Leaf* leaf, K k, V&& v, Split& split) {
+    size_t pos = countLess(leaf->keys, k);
+    if (pos < leaf->count && leaf->keys[pos] == k) {
+      leaf->values[pos] = std::move(v);
+      return false;
+    }
+
+    if (leaf->count == kFanout) {
+      // Split in two halves and insert in the one |k| falls in.
+      Leaf* right = newLeaf();
+      size_t half = kFanout / 2;
+      for (size_t i = half; i < kFanout; ++i) {
+        right->keys[i - half] = leaf->keys[i];
+        right->values[i - half] = std::move(leaf->values[i]);
+        leaf->keys[i] = kPadKey;
+      }
+      leaf->count = half;
+      right->count = kFanout - half;
+      right->next = leaf->next;
+      leaf->next = right;
+      split = Split{right, right->keys[0]};
+      if (pos > half) {
+        leaf = right;
+        pos -= half;
+      }
+    }
+
+    for (size_t i = leaf->count; i > pos; --i) {
+      leaf->keys[i] = leaf->keys[i - 1];
+      leaf->values[i] = std::move(leaf->values[i - 1]);
+    }
+    leaf->keys[pos] = k;
+    leaf->values[pos] = std::move(v);
+    leaf->count++;
+    return true;
+  }
+
+  // Links |child.right| after children[idx], splitting |inner| if full.
+  void insertIntoInner(Inner* inner, size_t idx, const Split& child, Split& split) {
+    if (inner->count < kFanout) {
+      for (size_t i = inner->count; i > idx; --i) {
+        inner->keys[i] = inner->keys[i - 1];
+        inner->children[i + 1] = inner->children[i];
+      }
+      inner->keys[idx] = child.key;
+      inner->children[idx + 1] = child.right;
+      inner->count++;
+      return;
+    }
+
+    // kFanout + 1 keys for kFanout + 2 children: the middle key moves up.
+    K keys[kFanout + 1];
+    void* children[kFanout + 2];
+    for (size_t i = 0, j = 0; i <= kFanout; ++i) {
+      keys[i] = i == idx ? child.key : inner->keys[j++];
+    }
+    for (size_t i = 0, j = 0; i <= kFanout + 1; ++i) {
+      children[i] = i == idx + 1 ? child.right : inner->children[j++];
+    }
+
+    size_t mid = (kFanout + 1) / 2;
+    Inner* right = newInner();
+    inner->count = mid;
+    for (size_t i = 0; i < kFanout; ++i) {
+      inner->keys[i] = i < mid ? keys[i] : kPadKey;
+    }
+    for (size_t i = 0; i <= mid; ++i) {
+      inner->children[i] = children[i];
+    }
+    right->count = kFanout - mid;
+    for (size_t i = 0; i < right->count; ++i) {
+      right->keys[i] = keys[mid + 1 + i];
+    }
+    for (size_t i = 0; i <= right->count; ++i) {
+      right->children[i] = children[mid + 1 + i];
+    }
+    split = Split{right, keys[mid]};
+  }
+
+  void bulkLoad(const std::pair<K, V>* sorted, size_t count) {
+    if (count == 0) {
+      return;
+    }
+
+    // Full leaves, the last one taking the remainder.
+    std::vector<void*> level;
+    std::vector<K> mins;
+    Leaf* prev = nullptr;
+    for (size_t i = 0; i < count; i += kFanout) {
+      Leaf* leaf = newLeaf();
+      leaf->count = std::min(kFanout, count - i);
+      for (size_t j = 0; j < leaf->count; ++j) {
+        assert(sorted[i + j].first != kPadKey);
+        assert(i + j == 0 || sorted[i + j - 1].first < sorted[i + j].first);
+        leaf->keys[j] = sorted[i + j].first;
+        leaf->values[j] = sorted[i + j].second;
+      }
+      if (prev) {
+        prev->next = leaf;
+      }
+      prev = leaf;
+      level.push_back(leaf);
+      mins.push_back(leaf->keys[0]);
+    }
+
+    // Then inner levels, spreading the children evenly so that no node ends
+    // up with a single child.
+    while (level.size() > 1) {
+      size_t nodes = (level.size() + kFanout) / (kFanout + 1);
+      std::vector<void*> parents;
+      std::vector<K> parentMins;
+      for (size_t n = 0, begin = 0; n < nodes; ++n) {
+        size_t end = level.size() * (n + 1) / nodes;
+        Inner* inner = newInner();
+        inner->count = end - begin - 1;
+        for (size_t c = begin; c < end; ++c) {
+          inner->children[c - begin] = level[c];
+          if (c > begin) {
+            inner->keys[c - begin - 1] = mins[c];
+          }
+        }
+        parents.push_back(inner);
+        parentMins.push_back(mins[begin]);
+        begin = end;
+      }
+      level.swap(parents);
+      mins.swap(parentMins);
+      m_height++;
+    }
+    m_root = level[0];
+    m_size = count;
+  }
+
+  Leaf* newLeaf() {
+    Leaf* leaf = newArray(m_leafAlloc, 1);
+    for (size_t i = 0; i < kFanout; ++i) {
+      leaf->keys[i] = kPadKey;
+    }
+    leaf->count = 0;
+    leaf->next = nullptr;
+    return leaf;
+  }
+
+  Inner* newInner() {
+    Inner* inner = newArray(m_innerAlloc, 1);
+    for (size_t i = 0; i < kFanout; ++i) {
+      inner->keys[i] = kPadKey;
+    }
+    inner->count = 0;
+    return inner;
+  }
+
+  void freeNode(void* node, size_t level) {
+    if (level == 0) {
+      deleteArray(m_leafAlloc, static_cast<Leaf*>(node), 1);
+      return;
+    }
+    Inner* inner = static_cast<Inner*>(node);
+    for (size_t i = 0; i <= inner->count; ++i) {
+      freeNode(inner->children[i], level - 1);
+    }
+    deleteArray(m_innerAlloc, inner, 1);
+  }
+
+  LeafAllocator m_leafAlloc;
+  InnerAllocator m_innerAlloc;
+  void* m_root;
+  size_t m_height;
+  size_t m_size;
+};
+
+template <typename K, typename V, size_t kFanout, typename A>
+std::ostream& operator<<(std::ostream& o, const BTreeMap<K, V, kFanout, A>& m) {
+  m.dump(o);
+  return o;
+}
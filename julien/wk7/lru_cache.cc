@@ -0,0 +1,580 @@
+// Build using:
+//   g++ -Wall -Werror --sanitize=address -g -pthread -o lru_cache lru_cache.cc && ./lru_cache
+// Benchmark using:
+//   g++ -Wall -Werror -O2 -DNDEBUG -pthread -o lru_cache lru_cache.cc && ./lru_cache bench [ops] [keys] [theta]
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../wk5/hash.h"
+
+// Count-min sketch of 4 bit counters estimating how often a key was seen
+// recently. This is the "TinyLFU" part of the admission policy: counters are
+// halved every |m_sampleSize| increments so that old popularity fades away.
+class FrequencySketch {
+  static constexpr int kDepth = 4;
+  static constexpr uint64_t kResetMask = 0x7777777777777777ULL;
+  static constexpr uint64_t kSeeds[kDepth] = {
+    0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL,
+    0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL,
+  };
+
+public:
+  FrequencySketch(size_t expectedEntries)
+    : m_additions(0) {
+      // 16 counters per word, aim for ~1 word per expected entry.
+      size_t words = 1;
+      while (words < expectedEntries) {
+        words <<= 1;
+      }
+      m_table.assign(words, 0);
+      m_counterMask = words * 16 - 1;
+      m_sampleSize = 10 * std::max<size_t>(expectedEntries, 1);
+    }
+
+  void increment(size_t hash) {
+    bool added = false;
+    for (int i = 0; i < kDepth; ++i) {
+      size_t idx = counterIndex(hash, i);
+      uint64_t& word = m_table[idx >> 4];
+      int shift = (idx & 15) << 2;
+      if (((word >> shift) & 0xf) != 0xf) {
+        word += 1ULL << shift;
+        added = true;
+      }
+    }
+    if (added && ++m_additions == m_sampleSize) {
+      reset();
+    }
+  }
+
+  int estimate(size_t hash) const {
+    int freq = 0xf;
+    for (int i = 0; i < kDepth; ++i) {
+      size_t idx = counterIndex(hash, i);
+      int count = (m_table[idx >> 4] >> ((idx & 15) << 2)) & 0xf;
+      freq = std::min(freq, count);
+    }
+    return freq;
+  }
+
+private:
+  size_t counterIndex(size_t hash, int row) const {
+    return mix_fasthash(hash ^ kSeeds[row]) & m_counterMask;
+  }
+
+  // Aging: halve every counter.
+  void reset() {
+    for (uint64_t& word : m_table) {
+      word = (word >> 1) & kResetMask;
+    }
+    m_additions /= 2;
+  }
+
+  std::vector<uint64_t> m_table;
+  size_t m_counterMask;
+  size_t m_sampleSize;
+  size_t m_additions;
+};
+
+// Bounded least-recently-used cache with O(1) get/put/evict.
+//
+// We can't reuse HashTable and DoublyLinkedList directly: HashTable grows on
+// every collision and DoublyLinkedList::remove() is O(n) as it walks from the
+// head. Instead each Entry is both a node of an intrusive LRU list and of a
+// chained hash bucket so that we never walk anything but a single bucket.
+//
+// Capacity is expressed in bytes, using |Weigher| to size each entry.
+template<typename K, typename V>
+class LruCache {
+  static constexpr size_t kInitialBuckets = 16;
+
+  struct Entry {
+    K key;
+    V val;
+    size_t hash;
+    size_t bytes;
+    // LRU list, m_head is the most recently used.
+    Entry* prev;
+    Entry* next;
+    // Hash bucket chain.
+    Entry* chain;
+  };
+
+public:
+  using EvictionCallback = std::function<void(const K&, const V&)>;
+  using Weigher = std::function<size_t(const K&, const V&)>;
+
+  // What the default weigher charges per entry.
+  static constexpr size_t kEntryBytes = sizeof(Entry);
+
+  // If |admission| is set, a new key only replaces the LRU victim if the
+  // frequency sketch has seen it more often than the victim (TinyLFU). The
+  // sketch is sized for |expectedEntries|, by default as many as fit with the
+  // default weigher: pass it along with a weigher that charges otherwise.
+  LruCache(size_t capacityBytes, bool admission = false, size_t expectedEntries = 0)
+    : m_capacity(capacityBytes)
+    , m_bytes(0)
+    , m_count(0)
+    , m_head(nullptr)
+    , m_tail(nullptr)
+    , m_weigher([](const K&, const V&) { return kEntryBytes; }) {
+      m_buckets.assign(kInitialBuckets, nullptr);
+      if (admission) {
+        m_sketch = std::make_unique<FrequencySketch>(expectedEntries ? expectedEntries
+                                                                     : capacityBytes / kEntryBytes + 1);
+      }
+    }
+
+  ~LruCache() {
+    clear();
+  }
+
+  // Make non-copiable for now.
+  LruCache(const LruCache&) = delete;
+  void operator=(const LruCache&) = delete;
+
+  // The callback is only called for entries evicted to make room, not for
+  // explicit remove() or overwrites.
+  void setEvictionCallback(EvictionCallback cb) { m_onEvict = std::move(cb); }
+  // Must be set before inserting anything.
+  void setWeigher(Weigher w) {
+    assert(m_count == 0);
+    m_weigher = std::move(w);
+  }
+
+  size_t size() const { return m_count; }
+  size_t bytes() const { return m_bytes; }
+  size_t capacity() const { return m_capacity; }
+  bool empty() const { return m_count == 0; }
+
+  bool get(const K& k, V& out) {
+    size_t hash = hashKey(k);
+    if (m_sketch) {
+      m_sketch->increment(hash);
+    }
+    Entry* e = find(k, hash);
+    if (!e) {
+      return false;
+    }
+    moveToFront(e);
+    out = e->val;
+    return true;
+  }
+
+  bool contains(const K& k) const {
+    return find(k, hashKey(k)) != nullptr;
+  }
+
+  // Returns false if the entry was not stored, either because it is bigger
+  // than the whole cache or because the admission policy rejected it.
+  bool put(const K& k, const V& v) {
+    size_t hash = hashKey(k);
+    if (m_sketch) {
+      m_sketch->increment(hash);
+    }
+    size_t bytes = m_weigher(k, v);
+    if (bytes > m_capacity) {
+      remove(k);
+      return false;
+    }
+
+    Entry* e = find(k, hash);
+    if (e) {
+      m_bytes -= e->bytes;
+      e->val = v;
+      e->bytes = bytes;
+      m_bytes += bytes;
+      moveToFront(e);
+      evictUntil(0, e);
+      return true;
+    }
+
+    if (m_sketch && m_bytes + bytes > m_capacity) {
+      int candidateFreq = m_sketch->estimate(hash);
+      // Only check the first victim, this is what TinyLFU does.
+      if (m_tail && candidateFreq <= m_sketch->estimate(m_tail->hash)) {
+        return false;
+      }
+    }
+    evictUntil(bytes, nullptr);
+
+    e = new Entry{k, v, hash, bytes, nullptr, nullptr, nullptr};
+    linkFront(e);
+    size_t b = hash & (m_buckets.size() - 1);
+    e->chain = m_buckets[b];
+    m_buckets[b] = e;
+    m_bytes += bytes;
+    if (++m_count > m_buckets.size()) {
+      grow();
+    }
+    return true;
+  }
+
+  bool remove(const K& k) {
+    size_t hash = hashKey(k);
+    Entry* e = find(k, hash);
+    if (!e) {
+      return false;
+    }
+    erase(e);
+    return true;
+  }
+
+  void clear() {
+    Entry* curr = m_head;
+    while (curr) {
+      Entry* next = curr->next;
+      delete curr;
+      curr = next;
+    }
+    m_head = m_tail = nullptr;
+    std::fill(m_buckets.begin(), m_buckets.end(), nullptr);
+    m_count = 0;
+    m_bytes = 0;
+  }
+
+  // Dumps from most to least recently used.
+  void dump(std::ostream& o) const {
+    o << "[";
+    for (const Entry* e = m_head; e; e = e->next) {
+      if (e != m_head) {
+        o << ", ";
+      }
+      o << e->key << ": " << e->val;
+    }
+    o << "] (bytes=" << m_bytes << "/" << m_capacity << ")";
+  }
+
+private:
+  static size_t hashKey(const K& k) {
+    return mix_fasthash(std::hash<K>{}(k));
+  }
+
+  Entry* find(const K& k, size_t hash) const {
+    Entry* e = m_buckets[hash & (m_buckets.size() - 1)];
+    while (e && !(e->hash == hash && e->key == k)) {
+      e = e->chain;
+    }
+    return e;
+  }
+
+  void linkFront(Entry* e) {
+    e->prev = nullptr;
+    e->next = m_head;
+    if (m_head) {
+      m_head->prev = e;
+    }
+    m_head = e;
+    if (!m_tail) {
+      m_tail = e;
+    }
+  }
+
+  void unlink(Entry* e) {
+    if (e->prev) {
+      e->prev->next = e->next;
+    } else {
+      m_head = e->next;
+    }
+    if (e->next) {
+      e->next->prev = e->prev;
+    } else {
+      m_tail = e->prev;
+    }
+  }
+
+  void moveToFront(Entry* e) {
+    if (e == m_head) {
+      return;
+    }
+    unlink(e);
+    linkFront(e);
+  }
+
+  void erase(Entry* e) {
+    Entry** slot = &m_buckets[e->hash & (m_buckets.size() - 1)];
+    while (*slot != e) {
+      slot = &(*slot)->chain;
+    }
+    *slot = e->chain;
+    unlink(e);
+    m_bytes -= e->bytes;
+    m_count--;
+    delete e;
+  }
+
+  // Evicts from the tail until |extra| more bytes fit. |keep| is never evicted.
+  void evictUntil(size_t extra, const Entry* keep) {
+    while (m_tail && m_tail != keep && m_bytes + extra > m_capacity) {
+      Entry* victim = m_tail;
+      if (m_onEvict) {
+        m_onEvict(victim->key, victim->val);
+      }
+      erase(victim);
+    }
+  }
+
+  void grow() {
+    std::vector<Entry*> newBuckets(2 * m_buckets.size(), nullptr);
+    size_t mask = newBuckets.size() - 1;
+    for (Entry* e = m_head; e; e = e->next) {
+      size_t b = e->hash & mask;
+      e->chain = newBuckets[b];
+      newBuckets[b] = e;
+    }
+    m_buckets.swap(newBuckets);
+  }
+
+  size_t m_capacity;
+  size_t m_bytes;
+  size_t m_count;
+  Entry* m_head;
+  Entry* m_tail;
+  std::vector<Entry*> m_buckets;
+  std::unique_ptr<FrequencySketch> m_sketch;
+  Weigher m_weigher;
+  EvictionCallback m_onEvict;
+};
+
+template <typename K, typename V>
+std::ostream& operator<<(std::ostream& o, const LruCache<K, V>& c) {
+  c.dump(o);
+  return o;
+}
+
+// Concurrent mode: the key space is split into independent LruCache shards
+// each protected by its own mutex. The byte capacity is split evenly so the
+// LRU order is only approximate across shards.
+template<typename K, typename V>
+class ShardedLruCache {
+  struct Shard {
+    Shard(size_t capacityBytes, bool admission, size_t expectedEntries)
+      : cache(capacityBytes, admission, expectedEntries) {}
+    std::mutex mutex;
+    LruCache<K, V> cache;
+  };
+
+public:
+  // |expectedEntries| is across all shards, see LruCache.
+  ShardedLruCache(size_t capacityBytes, size_t shards, bool admission = false, size_t expectedEntries = 0) {
+    assert(shards > 0);
+    for (size_t i = 0; i < shards; ++i) {
+      m_shards.push_back(std::make_unique<Shard>(capacityBytes / shards, admission,
+                                                 (expectedEntries + shards - 1) / shards));
+    }
+  }
+
+  // Callbacks are run with the shard lock held.
+  void setEvictionCallback(typename LruCache<K, V>::EvictionCallback cb) {
+    for (auto& s : m_shards) {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      s->cache.setEvictionCallback(cb);
+    }
+  }
+
+  void setWeigher(typename LruCache<K, V>::Weigher w) {
+    for (auto& s : m_shards) {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      s->cache.setWeigher(w);
+    }
+  }
+
+  bool get(const K& k, V& out) {
+    Shard& s = shardFor(k);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.cache.get(k, out);
+  }
+
+  bool put(const K& k, const V& v) {
+    Shard& s = shardFor(k);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.cache.put(k, v);
+  }
+
+  bool remove(const K& k) {
+    Shard& s = shardFor(k);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.cache.remove(k);
+  }
+
+  size_t size() const {
+    size_t total = 0;
+    for (auto& s : m_shards) {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      total += s->cache.size();
+    }
+    return total;
+  }
+
+private:
+  Shard& shardFor(const K& k) {
+    // The shard uses the low bits for its buckets so pick on the high ones.
+    size_t hash = mix_fasthash(std::hash<K>{}(k));
+    return *m_shards[(hash >> (sizeof(size_t) * 4)) % m_shards.size()];
+  }
+
+  std::vector<std::unique_ptr<Shard>> m_shards;
+};
+
+// Draws keys in [0, n) following a Zipfian distribution of parameter |theta|
+// (key 0 is the most popular one).
+class ZipfGenerator {
+public:
+  ZipfGenerator(size_t n, double theta, uint64_t seed)
+    : m_rng(seed), m_uniform(0.0, 1.0) {
+      m_cdf.resize(n);
+      double sum = 0;
+      for (size_t i = 0; i < n; ++i) {
+        sum += 1.0 / std::pow(i + 1.0, theta);
+        m_cdf[i] = sum;
+      }
+      for (double& c : m_cdf) {
+        c /= sum;
+      }
+    }
+
+  size_t next() {
+    double u = m_uniform(m_rng);
+    size_t idx = std::lower_bound(m_cdf.begin(), m_cdf.end(), u) - m_cdf.begin();
+    return std::min(idx, m_cdf.size() - 1);
+  }
+
+private:
+  std::vector<double> m_cdf;
+  std::mt19937_64 m_rng;
+  std::uniform_real_distribution<double> m_uniform;
+};
+
+struct BenchResult {
+  size_t hits;
+  size_t ops;
+  double seconds;
+};
+
+// Cache-aside replay: get() and put() on a miss.
+template<typename Cache>
+BenchResult replay(Cache& cache, const std::vector<uint64_t>& trace, size_t begin, size_t end) {
+  BenchResult r{0, 0, 0};
+  auto start = std::chrono::steady_clock::now();
+  uint64_t v;
+  for (size_t i = begin; i < end; ++i) {
+    if (cache.get(trace[i], v)) {
+      r.hits++;
+    } else {
+      cache.put(trace[i], trace[i]);
+    }
+    r.ops++;
+  }
+  r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return r;
+}
+
+void report(const std::string& name, const BenchResult& r) {
+  std::cout << "  " << name << ": hit rate=" << (100.0 * r.hits / r.ops) << "%"
+            << ", " << (r.ops / r.seconds / 1e6) << " Mops/s" << std::endl;
+}
+
+int bench(size_t ops, size_t keys, double theta) {
+  std::cout << "Zipfian trace: ops=" << ops << ", keys=" << keys << ", theta=" << theta << std::endl;
+  ZipfGenerator zipf(keys, theta, 42);
+  std::vector<uint64_t> trace(ops);
+  for (uint64_t& k : trace) {
+    // Scatter popular keys so they don't land in neighbouring buckets.
+    k = mix_fasthash(zipf.next());
+  }
+
+  const size_t entryBytes = LruCache<uint64_t, uint64_t>::kEntryBytes;
+  for (double fraction : {0.001, 0.01, 0.1}) {
+    size_t capacity = std::max<size_t>(1, keys * fraction) * entryBytes;
+    std::cout << "Cache holding " << (100 * fraction) << "% of the keys" << std::endl;
+    {
+      LruCache<uint64_t, uint64_t> cache(capacity);
+      report("lru", replay(cache, trace, 0, trace.size()));
+    }
+    {
+      LruCache<uint64_t, uint64_t> cache(capacity, /*admission*/ true);
+      report("lru+tinylfu", replay(cache, trace, 0, trace.size()));
+    }
+    for (size_t threads : {1, 2, 4, 8}) {
+      ShardedLruCache<uint64_t, uint64_t> cache(capacity, 4 * threads, /*admission*/ true);
+      std::vector<BenchResult> results(threads);
+      std::vector<std::thread> workers;
+      auto start = std::chrono::steady_clock::now();
+      for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+          size_t slice = trace.size() / threads;
+          results[t] = replay(cache, trace, t * slice, (t + 1) * slice);
+        });
+      }
+      for (std::thread& w : workers) {
+        w.join();
+      }
+      BenchResult total{0, 0, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+      for (const BenchResult& r : results) {
+        total.hits += r.hits;
+        total.ops += r.ops;
+      }
+      report("sharded lru+tinylfu, threads=" + std::to_string(threads), total);
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "bench") {
+    size_t ops = argc > 2 ? std::stoull(argv[2]) : 2000000;
+    size_t keys = argc > 3 ? std::stoull(argv[3]) : 100000;
+    double theta = argc > 4 ? std::stod(argv[4]) : 0.99;
+    return bench(ops, keys, theta);
+  }
+
+  LruCache<int, int> c(3);
+  c.setWeigher([](const int&, const int&) { return 1; });
+  c.setEvictionCallback([](const int& k, const int& v) {
+    std::cout << "  evicted " << k << ": " << v << std::endl;
+  });
+  std::cout << "Empty LruCache: " << c << std::endl;
+  c.put(1, 10);
+  c.put(2, 20);
+  c.put(3, 30);
+  std::cout << "LruCache after putting 1,2,3: " << c << std::endl;
+  int v = 0;
+  bool found = c.get(1, v);
+  std::cout << "LruCache get(1): " << found << " (" << v << ")" << std::endl;
+  std::cout << "LruCache after get(1): " << c << std::endl;
+  std::cout << "LruCache putting 4:" << std::endl;
+  c.put(4, 40);
+  std::cout << "LruCache after putting 4: " << c << std::endl;
+  std::cout << "LruCache contains 2? " << c.contains(2) << std::endl;
+  c.remove(3);
+  std::cout << "LruCache after removing 3: " << c << std::endl;
+
+  LruCache<int, int> lfu(2, /*admission*/ true, /*expectedEntries*/ 2);
+  lfu.setWeigher([](const int&, const int&) { return 1; });
+  lfu.put(1, 10);
+  lfu.put(2, 20);
+  for (int i = 0; i < 5; ++i) {
+    lfu.get(1, v);
+    lfu.get(2, v);
+  }
+  bool admitted = lfu.put(3, 30);
+  std::cout << "TinyLFU cache admitted cold key 3? " << admitted << ": " << lfu << std::endl;
+
+  ShardedLruCache<int, int> sharded(4 * LruCache<int, int>::kEntryBytes, 4);
+  sharded.put(1, 10);
+  found = sharded.get(1, v);
+  std::cout << "ShardedLruCache get(1): " << found << " (" << v << ")" << std::endl;
+
+  return 0;
+}